@@ -0,0 +1,619 @@
+/* *******************************************************************************
+ *	                              batchAnalysis.cpp
+ *
+ * Sessions are independent and differ a lot in length, so they are the
+ * unit of parallel work: threads take the next session when they are free,
+ * the largest first so a long session does not start last and hold up the
+ * end of the run. Each thread keeps one workspace for all its sessions.
+ * Cache keys are FNV-1a hashes of the files' contents, so sessions copied
+ * or moved in the archive are still found in the cache.
+ *********************************************************************************/
+
+#include "batchAnalysis.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "kindataLog.h"
+#include "resampler.h"
+
+static const double pi = 3.14159265358979323846;
+static const int grid_start = 4096; // grid samples allocated first
+static const unsigned long long fnv_offset = 14695981039346656037ULL;
+static const unsigned long long fnv_prime = 1099511628211ULL;
+static const char cache_magic[8] = "KBATCH2";
+
+void defaultBatchParams(struct batch_params * params) {
+	defaultOrientParams(&params->orient);
+	defaultFitParams(&params->fit);
+	params->rate = 100;
+	params->cutoff = 0.01;
+	params->max_gap = 0.25;
+	params->skip = 50;
+}
+
+
+/* --------------------------------------------------
+	Sessions
+-------------------------------------------------- */
+
+struct dir_entry {
+	char name[256];
+	bool directory;
+};
+
+static int compareEntries(const void * a, const void * b) {
+	return strcmp(((const struct dir_entry *)a)->name, ((const struct dir_entry *)b)->name);
+}
+
+static int compareSessions(const void * a, const void * b) {
+	return strcmp(((const struct batch_session *)a)->name, ((const struct batch_session *)b)->name);
+}
+
+/* Entries of dir but . and .., sorted by name. entries is malloc'ed */
+static int readDirectory(const char * dir, struct dir_entry ** entries) {
+	int count = 0, capacity = 0;
+	*entries = NULL;
+	struct dir_entry e;
+#ifdef _WIN32
+	char pattern[BATCH_PATH_SIZE];
+	snprintf(pattern, sizeof(pattern), "%s\\*", dir);
+	WIN32_FIND_DATAA fd;
+	HANDLE h = FindFirstFileA(pattern, &fd);
+	if (h == INVALID_HANDLE_VALUE) return 0;
+	do {
+		snprintf(e.name, sizeof(e.name), "%s", fd.cFileName);
+		e.directory = (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+#else
+	DIR * d = opendir(dir);
+	if (!d) return 0;
+	while (struct dirent * de = readdir(d)) {
+		char path[BATCH_PATH_SIZE];
+		struct stat st;
+		snprintf(e.name, sizeof(e.name), "%s", de->d_name);
+		snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+		if (stat(path, &st) != 0) continue;
+		e.directory = S_ISDIR(st.st_mode);
+#endif
+		if (strcmp(e.name, ".") == 0 || strcmp(e.name, "..") == 0) continue;
+		if (count == capacity) {
+			capacity = capacity ? 2 * capacity : 64;
+			struct dir_entry * grown = (struct dir_entry *)realloc(*entries, capacity * sizeof(struct dir_entry));
+			if (!grown) break;
+			*entries = grown;
+		}
+		(*entries)[count++] = e;
+#ifdef _WIN32
+	} while (FindNextFileA(h, &fd));
+	FindClose(h);
+#else
+	}
+	closedir(d);
+#endif
+	if (count > 1) qsort(*entries, count, sizeof(struct dir_entry), compareEntries);
+	return count;
+}
+
+static bool endsWith(const char * s, const char * suffix) {
+	size_t n = strlen(s), m = strlen(suffix);
+	return n >= m && strcmp(s + n - m, suffix) == 0;
+}
+
+/* Size of a file, -1 if it cannot be opened */
+static long long fileSize(const char * path) {
+	FILE * f = fopen(path, "rb");
+	if (!f) return -1;
+	fseek(f, 0, SEEK_END);
+	long long size = ftell(f);
+	fclose(f);
+	return size;
+}
+
+/* path of <prefix><suffix> in dir if the file exists, else "" */
+static long long sessionFile(const char * dir, const char * prefix, const char * suffix, char * path) {
+	snprintf(path, BATCH_PATH_SIZE, "%s/%s%s", dir, prefix, suffix);
+	long long size = fileSize(path);
+	if (size < 0) path[0] = 0;
+	return size < 0 ? 0 : size;
+}
+
+static void findIn(const char * dir, struct batch_session ** sessions, int * count, int * capacity) {
+	struct dir_entry * entries;
+	int n = readDirectory(dir, &entries);
+	const char * kindata = NULL;
+	for (int i = 0; i < n && !kindata; i++) {
+		if (!entries[i].directory && strncmp(entries[i].name, "kindata", 7) == 0 && endsWith(entries[i].name, ".txt")) kindata = entries[i].name;
+	}
+	for (int i = 0; i < n; i++) {
+		const struct dir_entry & e = entries[i];
+		if (e.directory) {
+			if (e.name[0] == '.') continue;
+			char sub[BATCH_PATH_SIZE];
+			snprintf(sub, sizeof(sub), "%s/%s", dir, e.name);
+			findIn(sub, sessions, count, capacity);
+			continue;
+		}
+		if (!endsWith(e.name, "_gyro.txt")) continue;
+		if (*count == *capacity) {
+			int grown = *capacity ? 2 * *capacity : 64;
+			struct batch_session * s = (struct batch_session *)realloc(*sessions, grown * sizeof(struct batch_session));
+			if (!s) break;
+			*sessions = s;
+			*capacity = grown;
+		}
+		struct batch_session & s = (*sessions)[(*count)++];
+		char prefix[256];
+		snprintf(prefix, sizeof(prefix), "%.*s", (int)(strlen(e.name) - strlen("_gyro.txt")), e.name);
+		snprintf(s.name, sizeof(s.name), "%s/%s", dir, prefix);
+		s.bytes = sessionFile(dir, prefix, "_gyro.txt", s.gyro);
+		s.bytes += sessionFile(dir, prefix, "_accel.txt", s.accel);
+		s.bytes += sessionFile(dir, prefix, "_rotVector.txt", s.rot_vector);
+		s.bytes += kindata ? sessionFile(dir, kindata, "", s.kindata) : 0;
+		if (!kindata) s.kindata[0] = 0;
+	}
+	free(entries);
+}
+
+int findSessions(const char * root, struct batch_session ** sessions) {
+	int count = 0, capacity = 0;
+	*sessions = NULL;
+	findIn(root, sessions, &count, &capacity);
+	if (count > 1) qsort(*sessions, count, sizeof(struct batch_session), compareSessions);
+	return count;
+}
+
+
+/* --------------------------------------------------
+	Bias and drift
+-------------------------------------------------- */
+
+// q = a * b, w x y z
+static void quatProd(const double * a, const double * b, double * q) {
+	q[0] = a[0] * b[0] - a[1] * b[1] - a[2] * b[2] - a[3] * b[3];
+	q[1] = a[0] * b[1] + a[1] * b[0] + a[2] * b[3] - a[3] * b[2];
+	q[2] = a[0] * b[2] - a[1] * b[3] + a[2] * b[0] + a[3] * b[1];
+	q[3] = a[0] * b[3] + a[1] * b[2] - a[2] * b[1] + a[3] * b[0];
+}
+
+/* Rotation vector sample i (x y z w) as a unit w x y z quaternion */
+static void rotVectorQuat(const struct imu_log & rv, int i, double * q) {
+	q[0] = rv.v[3][i];
+	q[1] = rv.v[0][i];
+	q[2] = rv.v[1][i];
+	q[3] = rv.v[2][i];
+	double n = sqrt(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+	for (int c = 0; c < 4; c++) q[c] = n > 0 ? q[c] / n : c == 0;
+}
+
+static void gyroQuat(const struct quat_array & q, int i, double * out) {
+	out[0] = q.w[i];
+	out[1] = q.x[i];
+	out[2] = q.y[i];
+	out[3] = q.z[i];
+}
+
+/* Degrees between the gyro orientation and the rotation vector at the end of the recording,
+   with both starting at the rotation vector's orientation once the bias is known */
+static double orientationDrift(const struct imu_log & gyro, const struct quat_array & q, const struct imu_log & rv,
+	const struct orient_params & params) {
+	int i0 = params.bias_first + params.bias_count;
+	while (i0 < gyro.rows && gyro.t[i0] < rv.t[0]) i0++;
+	if (i0 >= gyro.rows) return -1;
+	int j0 = 0;
+	while (j0 + 1 < rv.rows && rv.t[j0 + 1] <= gyro.t[i0]) j0++;
+	int j1 = rv.rows - 1;
+	while (j1 > 0 && rv.t[j1] > gyro.t[gyro.rows - 1]) j1--;
+	// the gyro sample nearest to the last rotation vector sample
+	int i1 = gyro.rows - 1;
+	while (i1 > i0 && gyro.t[i1] > rv.t[j1]) i1--;
+	double a[4], b[4], start[4], ref[4], predicted[4], actual[4];
+	rotVectorQuat(rv, j0, a);
+	gyroQuat(q, i0, b);
+	b[1] = -b[1];
+	b[2] = -b[2];
+	b[3] = -b[3];
+	quatProd(a, b, ref); // world from the gyro's start frame
+	gyroQuat(q, i1, start);
+	quatProd(ref, start, predicted);
+	rotVectorQuat(rv, j1, actual);
+	double d = 0;
+	for (int c = 0; c < 4; c++) d += predicted[c] * actual[c];
+	d = fabs(d);
+	return 2 * acos(d > 1 ? 1 : d) * 180 / pi;
+}
+
+
+/* --------------------------------------------------
+	Sync and fit
+-------------------------------------------------- */
+
+/* Room for count grid samples of recording which (0 kinect, 1 watch) */
+static bool growGrid(struct batch_workspace * ws, int which, int count) {
+	if (count <= ws->capacity[which]) return true;
+	int capacity = ws->capacity[which] ? ws->capacity[which] : grid_start;
+	while (capacity < count) capacity *= 2;
+	for (int c = 0; c < 3; c++) {
+		for (int copy = which; copy < 4; copy += 2) {
+			float * v = (float *)realloc(ws->grid[copy][c], capacity * sizeof(float));
+			if (!v) return false;
+			ws->grid[copy][c] = v;
+		}
+	}
+	float * power = (float *)realloc(ws->power[which], capacity * sizeof(float));
+	if (!power) return false;
+	ws->power[which] = power;
+	unsigned char * valid = (unsigned char *)realloc(ws->valid[which], capacity);
+	if (!valid) return false;
+	ws->valid[which] = valid;
+	ws->capacity[which] = capacity;
+	return true;
+}
+
+/* Take the grid samples the resampler has into recording which. Returns the samples now held, -1 out of memory */
+static int drainGrid(StreamResampler & resampler, struct batch_workspace * ws, int which, int n, long long * first) {
+	long long index;
+	float v[3];
+	bool valid;
+	while (resampler.next(&index, v, &valid)) {
+		if (!growGrid(ws, which, n + 1)) return -1;
+		if (n == 0) *first = index;
+		for (int c = 0; c < 3; c++) ws->grid[which][c][n] = v[c];
+		ws->valid[which][n++] = valid;
+	}
+	return n;
+}
+
+struct kinect_reader {
+	StreamResampler * resampler;
+	struct batch_workspace * ws;
+	long long * first;
+	int n; // grid samples, -1 out of memory
+	int rows; // frames with the body
+};
+
+static bool addKinectArm(const struct kindata_arm & arm, void * user) {
+	struct kinect_reader & r = *(struct kinect_reader *)user;
+	// rows without the body are gaps on the grid
+	r.resampler->push((long long)floor(arm.t * 1e6 + 0.5), arm.d, arm.body);
+	if (arm.body) r.rows++;
+	r.n = drainGrid(*r.resampler, r.ws, 0, r.n, r.first);
+	return r.n >= 0;
+}
+
+/* Wrist - elbow of the first body in kindata.txt (kindataLog) on the grid. Returns the samples */
+static int kinectArm(const char * path, const struct batch_params & params, struct batch_workspace * ws,
+	long long * first, int * rows) {
+	struct resample_params rp;
+	defaultResampleParams(&rp);
+	rp.rate = params.rate;
+	rp.time_unit = 1e-6; // the time of day in s, to us
+	rp.max_gap = params.max_gap;
+	StreamResampler resampler(3, rp);
+	struct kinect_reader r;
+	r.resampler = &resampler;
+	r.ws = ws;
+	r.first = first;
+	r.n = 0;
+	r.rows = 0;
+	*rows = 0;
+	if (readKindataArm(path, addKinectArm, &r) < 0) return 0;
+	*rows = r.rows;
+	resampler.finish();
+	if (r.n >= 0) r.n = drainGrid(resampler, ws, 0, r.n, first);
+	return r.n < 0 ? 0 : r.n;
+}
+
+/* Watch x axis in the watch's world frame (sync_kindata.m: wR * [1 0 0]') on the grid */
+static int watchArm(const struct imu_log & rv, const struct batch_params & params, struct batch_workspace * ws, long long * first) {
+	struct resample_params rp;
+	defaultResampleParams(&rp);
+	rp.rate = params.rate;
+	rp.time_unit = params.orient.time_unit;
+	rp.max_gap = params.max_gap;
+	StreamResampler resampler(3, rp);
+	int n = 0;
+	for (int i = params.skip; i < rv.rows && n >= 0; i++) {
+		double q[4];
+		rotVectorQuat(rv, i, q);
+		double w = q[0], x = q[1], y = q[2], z = q[3];
+		float d[3] = { (float)(1 - 2 * (y * y + z * z)), (float)(2 * (x * y + w * z)), (float)(2 * (x * z - w * y)) };
+		resampler.push(rv.t[i], d);
+		n = drainGrid(resampler, ws, 1, n, first);
+	}
+	resampler.finish();
+	if (n >= 0) n = drainGrid(resampler, ws, 1, n, first);
+	return n < 0 ? 0 : n;
+}
+
+/* Gaps interpolated linearly (held at the ends) in copy (2 + which), low passed, and its motion power.
+   Holding the last direction over a gap would delay the signal by half the gap and bias the offset.
+   false if there is no valid sample */
+static bool syncSignal(struct batch_workspace * ws, int which, int n, double cutoff) {
+	int firstValid = 0;
+	while (firstValid < n && !ws->valid[which][firstValid]) firstValid++;
+	if (firstValid == n) return false;
+	for (int c = 0; c < 3; c++) {
+		const float * v = ws->grid[which][c];
+		float * out = ws->grid[2 + which][c];
+		int last = firstValid;
+		for (int i = 0; i <= firstValid; i++) out[i] = v[firstValid];
+		for (int i = firstValid + 1; i < n; i++) {
+			if (!ws->valid[which][i]) continue;
+			for (int j = last + 1; j < i; j++) out[j] = v[last] + (v[i] - v[last]) * (float)(j - last) / (float)(i - last);
+			out[i] = v[i];
+			last = i;
+		}
+		for (int i = last + 1; i < n; i++) out[i] = v[last];
+		lowPass(out, n, cutoff);
+	}
+	motionPower(ws->grid[2 + which][0], ws->grid[2 + which][1], ws->grid[2 + which][2], n, ws->power[which]);
+	return true;
+}
+
+static void syncSession(const struct batch_session & session, const struct batch_params & params,
+	struct batch_workspace * ws, struct batch_result * result) {
+	long long kFirst = 0, wFirst = 0;
+	int kn = kinectArm(session.kindata, params, ws, &kFirst, &result->kinect_rows);
+	int wn = watchArm(ws->rot_vector, params, ws, &wFirst);
+	result->status = BATCH_NO_SYNC;
+	if (kn < 2 || wn < 2 || !syncSignal(ws, 0, kn, params.cutoff) || !syncSignal(ws, 1, wn, params.cutoff)) return;
+
+	// the shorter recording is searched for in the longer one, by motion power as timeSyncTool
+	const float * kp = ws->power[0];
+	const float * wp = ws->power[1];
+	struct sync_result sync;
+	bool watchInside = wn <= kn;
+	bool ok = watchInside ? syncSignals(&kp, kn - 1, &wp, wn - 1, 1, &ws->sync, &sync)
+		: syncSignals(&wp, wn - 1, &kp, kn - 1, 1, &ws->sync, &sync);
+	if (!ok) return;
+	double offset = watchInside ? sync.offset : -sync.offset;
+	int lag = watchInside ? sync.lag : -sync.lag;
+	result->offset = (kFirst + offset - wFirst) / params.rate;
+	result->score = sync.score;
+
+	// valid pairs of the overlap, packed into the low passed copies (no longer needed)
+	float * u[3];
+	float * k[3];
+	for (int c = 0; c < 3; c++) {
+		k[c] = ws->grid[2][c];
+		u[c] = ws->grid[3][c];
+	}
+	int pairs = 0;
+	for (int i = lag < 0 ? -lag : 0; i < wn && i + lag < kn; i++) {
+		if (!ws->valid[1][i] || !ws->valid[0][i + lag]) continue;
+		for (int c = 0; c < 3; c++) {
+			u[c][pairs] = ws->grid[1][c][i];
+			k[c][pairs] = ws->grid[0][c][i + lag];
+		}
+		pairs++;
+	}
+	result->pairs = pairs;
+	struct rotation_fit fit;
+	const float * cu[3] = { u[0], u[1], u[2] };
+	const float * ck[3] = { k[0], k[1], k[2] };
+	if (pairs == 0 || !fitRotation(cu, ck, pairs, params.fit, &ws->fit, &fit)) return;
+	result->rms = fit.rms;
+	result->inliers = fit.inliers;
+	for (int c = 0; c < 4; c++) result->K[c] = fit.q[c];
+	double error = 0;
+	for (int i = 0; i < pairs; i++) {
+		double ku[3], dot = 0, nu = 0, nk = 0;
+		for (int r = 0; r < 3; r++) {
+			ku[r] = fit.R[r][0] * u[0][i] + fit.R[r][1] * u[1][i] + fit.R[r][2] * u[2][i];
+			dot += ku[r] * k[r][i];
+			nu += ku[r] * ku[r];
+			nk += (double)k[r][i] * k[r][i];
+		}
+		double cosine = nu > 0 && nk > 0 ? dot / sqrt(nu * nk) : 1;
+		error += acos(cosine > 1 ? 1 : cosine < -1 ? -1 : cosine);
+	}
+	result->arm_error = error / pairs * 180 / pi;
+	result->status = BATCH_OK;
+}
+
+
+/* --------------------------------------------------
+	Sessions
+-------------------------------------------------- */
+
+void analyzeSession(const struct batch_session & session, const struct batch_params & params,
+	struct batch_workspace * ws, struct batch_result * result) {
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	memset(result, 0, sizeof(*result));
+	result->status = BATCH_FAILED;
+	result->drift = -1;
+	result->K[0] = 1;
+	if (!session.gyro[0] || !loadImuLog(session.gyro, &ws->gyro) || !ws->gyro.timed || ws->gyro.columns < 3 || ws->gyro.rows == 0) return;
+	const struct imu_log & gyro = ws->gyro;
+	result->gyro_rows = gyro.rows;
+	result->seconds = (gyro.t[gyro.rows - 1] - gyro.t[0]) * params.orient.time_unit;
+	bool accel = session.accel[0] && loadImuLog(session.accel, &ws->accel) && ws->accel.timed && ws->accel.columns >= 3;
+	gyroBias(gyro, params.orient, result->bias);
+	if (!orientLog(gyro, accel ? &ws->accel : NULL, params.orient, &ws->q)) return;
+	bool rotVector = session.rot_vector[0] && loadImuLog(session.rot_vector, &ws->rot_vector)
+		&& ws->rot_vector.timed && ws->rot_vector.columns >= 4 && ws->rot_vector.rows > 0;
+	if (rotVector) result->drift = orientationDrift(gyro, ws->q, ws->rot_vector, params.orient);
+	result->status = BATCH_NO_KINECT;
+	if (rotVector && session.kindata[0]) syncSession(session, params, ws, result);
+	result->ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+}
+
+void freeBatchWorkspace(struct batch_workspace * ws) {
+	freeImuLog(&ws->gyro);
+	freeImuLog(&ws->accel);
+	freeImuLog(&ws->rot_vector);
+	freeQuatArray(&ws->q);
+	freeSyncWorkspace(&ws->sync);
+	freeFitWorkspace(&ws->fit);
+	for (int copy = 0; copy < 4; copy++) {
+		for (int c = 0; c < 3; c++) free(ws->grid[copy][c]);
+	}
+	for (int which = 0; which < 2; which++) {
+		free(ws->power[which]);
+		free(ws->valid[which]);
+	}
+	memset(ws, 0, sizeof(*ws));
+}
+
+
+/* --------------------------------------------------
+	Cache
+-------------------------------------------------- */
+
+struct cache_entry {
+	char magic[8];
+	unsigned long long key;
+	struct batch_result result;
+};
+
+static void hashBytes(unsigned long long * h, const void * data, size_t n) {
+	const unsigned char * p = (const unsigned char *)data;
+	unsigned long long x = *h;
+	for (size_t i = 0; i < n; i++) x = (x ^ p[i]) * fnv_prime;
+	*h = x;
+}
+
+/* The contents and length of a file, or a marker for a missing one */
+static void hashFile(unsigned long long * h, const char * path, unsigned char * block, size_t blockSize) {
+	FILE * f = path[0] ? fopen(path, "rb") : NULL;
+	long long length = -1;
+	if (f) {
+		length = 0;
+		size_t n;
+		while ((n = fread(block, 1, blockSize, f)) > 0) {
+			hashBytes(h, block, n);
+			length += n;
+		}
+		fclose(f);
+	}
+	hashBytes(h, &length, sizeof(length));
+}
+
+/* Key of a session's files and the parameters (field by field, not the padding) */
+static unsigned long long sessionKey(const struct batch_session & session, const struct batch_params & params) {
+	unsigned long long h = fnv_offset;
+	hashBytes(&h, cache_magic, sizeof(cache_magic));
+	const struct orient_params & o = params.orient;
+	int filter = o.filter;
+	hashBytes(&h, &filter, sizeof(filter));
+	hashBytes(&h, &o.gain, sizeof(o.gain));
+	hashBytes(&h, &o.bias_first, sizeof(o.bias_first));
+	hashBytes(&h, &o.bias_count, sizeof(o.bias_count));
+	hashBytes(&h, &o.time_unit, sizeof(o.time_unit));
+	hashBytes(&h, &o.rate, sizeof(o.rate));
+	hashBytes(&h, &o.max_dt, sizeof(o.max_dt));
+	hashBytes(&h, &params.fit.iterations, sizeof(params.fit.iterations));
+	hashBytes(&h, &params.fit.scale, sizeof(params.fit.scale));
+	hashBytes(&h, &params.rate, sizeof(params.rate));
+	hashBytes(&h, &params.cutoff, sizeof(params.cutoff));
+	hashBytes(&h, &params.max_gap, sizeof(params.max_gap));
+	hashBytes(&h, &params.skip, sizeof(params.skip));
+	static const size_t block_size = 1 << 16;
+	unsigned char * block = (unsigned char *)malloc(block_size);
+	if (!block) return 0;
+	hashFile(&h, session.gyro, block, block_size);
+	hashFile(&h, session.accel, block, block_size);
+	hashFile(&h, session.rot_vector, block, block_size);
+	hashFile(&h, session.kindata, block, block_size);
+	free(block);
+	return h;
+}
+
+static void cachePath(const char * cacheDir, unsigned long long key, char * path) {
+	snprintf(path, BATCH_PATH_SIZE, "%s/%016llx.kbat", cacheDir, key);
+}
+
+static bool readCache(const char * cacheDir, unsigned long long key, struct batch_result * result) {
+	char path[BATCH_PATH_SIZE];
+	cachePath(cacheDir, key, path);
+	FILE * f = fopen(path, "rb");
+	if (!f) return false;
+	struct cache_entry e;
+	bool ok = fread(&e, sizeof(e), 1, f) == 1 && memcmp(e.magic, cache_magic, sizeof(cache_magic)) == 0 && e.key == key;
+	fclose(f);
+	if (ok) {
+		*result = e.result;
+		result->ms = 0;
+	}
+	return ok;
+}
+
+/* Written aside and renamed, so a reader never sees half an entry */
+static void writeCache(const char * cacheDir, unsigned long long key, const struct batch_result & result, int session) {
+	char path[BATCH_PATH_SIZE], temp[BATCH_PATH_SIZE + 16];
+	cachePath(cacheDir, key, path);
+	snprintf(temp, sizeof(temp), "%s.%d.tmp", path, session);
+	struct cache_entry e;
+	memset(&e, 0, sizeof(e));
+	memcpy(e.magic, cache_magic, sizeof(cache_magic));
+	e.key = key;
+	e.result = result;
+	FILE * f = fopen(temp, "wb");
+	if (!f) return;
+	bool ok = fwrite(&e, sizeof(e), 1, f) == 1;
+	ok = fclose(f) == 0 && ok;
+#ifdef _WIN32
+	ok = ok && MoveFileExA(temp, path, MOVEFILE_REPLACE_EXISTING);
+#else
+	ok = ok && rename(temp, path) == 0;
+#endif
+	if (!ok) remove(temp);
+}
+
+
+/* --------------------------------------------------
+	Batch
+-------------------------------------------------- */
+
+int runBatch(const struct batch_session * sessions, int n, const struct batch_params & params, const char * cacheDir,
+	struct batch_result * results, batch_done done, void * user, int threads) {
+	if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+	if (threads <= 0) threads = 1;
+	if (threads > n) threads = n;
+	std::vector<int> order(n);
+	for (int i = 0; i < n; i++) order[i] = i;
+	std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return sessions[a].bytes > sessions[b].bytes; });
+	std::atomic<int> next(0);
+	std::atomic<int> analyzed(0);
+	std::mutex report;
+	auto work = [&]() {
+		struct batch_workspace ws;
+		memset(&ws, 0, sizeof(ws));
+		for (int k = next++; k < n; k = next++) {
+			int i = order[k];
+			unsigned long long key = cacheDir ? sessionKey(sessions[i], params) : 0;
+			bool cached = cacheDir && key && readCache(cacheDir, key, &results[i]);
+			if (!cached) {
+				analyzeSession(sessions[i], params, &ws, &results[i]);
+				analyzed++;
+				if (cacheDir && key) writeCache(cacheDir, key, results[i], i);
+			}
+			if (done) {
+				std::lock_guard<std::mutex> lock(report);
+				done(sessions[i], results[i], cached, user);
+			}
+		}
+		freeBatchWorkspace(&ws);
+	};
+	std::vector<std::thread> pool;
+	for (int t = 1; t < threads; t++) pool.push_back(std::thread(work));
+	if (n > 0) work();
+	for (size_t t = 0; t < pool.size(); t++) pool[t].join();
+	return analyzed;
+}
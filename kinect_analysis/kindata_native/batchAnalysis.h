@@ -0,0 +1,105 @@
+/* *******************************************************************************
+ *	                              batchAnalysis.h
+ *
+ * The Kinect / watch comparison of sync_kindata.m over a whole archive
+ * instead of one session at a time in MATLAB. A session is a directory
+ * holding a watch recording <prefix>_gyro.txt (with <prefix>_accel.txt and
+ * <prefix>_rotVector.txt beside it) and optionally a kindata*.txt capture,
+ * e.g. data/gyro/right/2018-08-08T16:10:00/. Per session:
+ *	load      the logs (imuLog)
+ *	bias      gyro bias over the bias window, orientation by gyro
+ *	          integration (orientation), and its drift against the
+ *	          rotation vector
+ *	sync      arm directions of both (wrist - elbow, watch x axis) on the
+ *	          common rate grid (StreamResampler), time offset (syncSignals)
+ *	fit       rotation K from the watch's world frame to camera space
+ *	          over the aligned directions (fitRotation)
+ *	metrics   fit rms, inliers, mean arm direction error after K
+ * Results are cached per session in a directory, under a hash of the
+ * contents of its files and of the parameters, so a re-run only analyzes
+ * sessions that are new or changed.
+ *********************************************************************************/
+
+#pragma once
+
+#include "orientation.h"
+#include "rotationFit.h"
+#include "timeSync.h"
+
+const int BATCH_PATH_SIZE = 512;
+
+struct batch_params {
+	struct orient_params orient; // bias window and filter of the watch orientation
+	struct fit_params fit;
+	double rate; // Hz of the common grid (sync_kindata.m: common_rate = 100)
+	double cutoff; // low pass before the sync, relative to half the rate (timeSync.m: 0.01)
+	double max_gap; // s, longer gaps in either recording are not interpolated over
+	int skip; // watch samples dropped at the start (sync_kindata.m: w_stidx = 50)
+};
+
+/* sync_kindata.m's choices, main.m's orientation */
+void defaultBatchParams(struct batch_params * params);
+
+// The files of one session, "" where missing
+struct batch_session {
+	char name[BATCH_PATH_SIZE]; // <directory>/<prefix>
+	char gyro[BATCH_PATH_SIZE];
+	char accel[BATCH_PATH_SIZE];
+	char rot_vector[BATCH_PATH_SIZE];
+	char kindata[BATCH_PATH_SIZE];
+	long long bytes; // all files, the work to expect
+};
+
+/* Every session under root (recursively, skipping directories starting with '.'), sorted by name.
+   sessions is malloc'ed; returns the count */
+int findSessions(const char * root, struct batch_session ** sessions);
+
+enum batch_status {
+	BATCH_OK, // all steps done
+	BATCH_NO_KINECT, // watch only: load and bias steps
+	BATCH_NO_SYNC, // no motion to sync on, or no overlap to fit
+	BATCH_FAILED // the gyro log is missing or unreadable
+};
+
+struct batch_result {
+	int status; // batch_status
+	int gyro_rows;
+	double seconds; // length of the watch recording
+	float bias[3]; // rad/s
+	double drift; // degrees between the gyro orientation and the rotation vector at the end, -1 without one
+	int kinect_rows; // kindata rows with a body
+	double offset; // s: kinect_s = watch_ns * 1e-9 + offset
+	double score; // sync correlation
+	int pairs; // aligned direction pairs in the fit
+	int inliers;
+	double rms; // of the fit
+	double arm_error; // degrees, mean angle between the Kinect arm and K times the watch arm
+	float K[4]; // w x y z
+	double ms; // analysis time, 0 if cached
+};
+
+// Buffers of analyzeSession, reused between sessions. Must start zeroed
+struct batch_workspace {
+	struct imu_log gyro, accel, rot_vector;
+	struct quat_array q;
+	struct sync_workspace sync;
+	struct fit_workspace fit;
+	float * grid[4][3]; // arm directions on the grid: kinect, watch, both low passed
+	float * power[2];
+	int capacity[2]; // grid samples allocated for kinect, watch
+	unsigned char * valid[2];
+};
+
+/* Analyze one session */
+void analyzeSession(const struct batch_session & session, const struct batch_params & params,
+	struct batch_workspace * ws, struct batch_result * result);
+
+void freeBatchWorkspace(struct batch_workspace * ws);
+
+/* Called as each session is done (cached: taken from the cache), one call at a time */
+typedef void (*batch_done)(const struct batch_session & session, const struct batch_result & result, bool cached, void * user);
+
+/* Analyze sessions on threads threads (0: one per core), largest first, results[i] for sessions[i].
+   cacheDir (may be NULL) must exist. Returns the sessions analyzed, i.e. not taken from the cache */
+int runBatch(const struct batch_session * sessions, int n, const struct batch_params & params, const char * cacheDir,
+	struct batch_result * results, batch_done done = NULL, void * user = NULL, int threads = 0);
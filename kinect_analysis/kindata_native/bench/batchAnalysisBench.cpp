@@ -0,0 +1,221 @@
+/* *******************************************************************************
+ *	                              batchAnalysisBench
+ *
+ * One synthetic session through analyzeSession: the bias, sync and fit
+ * steps of batchAnalysis against a known answer. The watch is still for
+ * the first seconds (the bias window), then turns on a smooth, non
+ * periodic path; its logs hold the true rotation vector, the gyro with a
+ * constant bias and the gravity. The Kinect capture holds the watch x axis
+ * rotated by a known K as the first body's wrist - elbow, at 30 fps with
+ * frame time jitter, joint noise and lost bodies, on a clock offset from
+ * the watch's by a known offset. It is written as exportKindata writes a
+ * non default schema (two markers, two bodies with tracking ids, the arm
+ * joints out of order), so the columns are found from its schema line.
+ * Reports the errors of the bias, offset and K, and ms per session.
+ *
+ * Usage: batchAnalysisBench [seconds] [iterations]
+ * Build: ../batchAnalysis.cpp ../kindataLog.cpp ../resampler.cpp ../orientation.cpp ../timeSync.cpp ../rotationFit.cpp ../imuLog.cpp
+ *********************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+
+#include "../batchAnalysis.h"
+
+static const double pi = 3.14159265358979323846;
+static const char * gyro_path = "batchAnalysisBench_gyro.txt";
+static const char * accel_path = "batchAnalysisBench_accel.txt";
+static const char * rot_vector_path = "batchAnalysisBench_rotVector.txt";
+static const char * kindata_path = "batchAnalysisBench_kindata.txt";
+static const double watch_rate = 50; // Hz
+static const double kinect_rate = 30;
+static const double still = 3; // s at rest at the start
+static const long long watch_start_ns = 512345678901234LL;
+static const double true_offset = -454145.541700; // s: kinect_s = watch_ns * 1e-9 + offset
+static const float true_bias[3] = { 0.012f, -0.021f, 0.006f };
+static const double gravity = 9.81;
+static const double lost_share = 0.02; // frames starting a run of 1 to 5 frames without the body
+static const double joint_sd = 0.003; // m
+static const double offset_tolerance = 0.002; // s, a fifth of a grid sample
+static const double K_tolerance = 1; // degrees
+static const double bias_tolerance = 1e-4; // rad/s
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double uniform() {
+	return rand() / (double)RAND_MAX;
+}
+
+static double gaussian() {
+	double u = (rand() + 1.0) / ((double)RAND_MAX + 2);
+	return sqrt(-2 * log(u)) * cos(2 * pi * uniform());
+}
+
+/* a * b, quaternions w x y z */
+static void quatProd(const double a[4], const double b[4], double q[4]) {
+	q[0] = a[0] * b[0] - a[1] * b[1] - a[2] * b[2] - a[3] * b[3];
+	q[1] = a[0] * b[1] + a[1] * b[0] + a[2] * b[3] - a[3] * b[2];
+	q[2] = a[0] * b[2] - a[1] * b[3] + a[2] * b[0] + a[3] * b[1];
+	q[3] = a[0] * b[3] + a[1] * b[2] - a[2] * b[1] + a[3] * b[0];
+}
+
+static void axisQuat(int axis, double angle, double q[4]) {
+	q[0] = cos(angle / 2);
+	q[1] = q[2] = q[3] = 0;
+	q[1 + axis] = sin(angle / 2);
+}
+
+/* Watch orientation at t s into the recording: still, then yaw, pitch and roll on incommensurate sines */
+static void watchQuat(double t, double q[4]) {
+	double s = t < still ? 0 : t < still + 2 ? 0.5 - 0.5 * cos(pi * (t - still) / 2) : 1; // smooth start
+	double yaw = s * (0.9 * sin(2 * pi * 0.37 * t) + 0.5 * sin(2 * pi * 0.13 * t + 1));
+	double pitch = s * (0.6 * sin(2 * pi * 0.23 * t + 0.5) + 0.3 * sin(2 * pi * 0.71 * t));
+	double roll = s * 0.8 * sin(2 * pi * 0.53 * t + 2);
+	double qz[4], qy[4], qx[4], zy[4];
+	axisQuat(2, yaw, qz);
+	axisQuat(1, pitch, qy);
+	axisQuat(0, roll, qx);
+	quatProd(qz, qy, zy);
+	quatProd(zy, qx, q);
+}
+
+/* R(q) v */
+static void rotate(const double q[4], const double v[3], double out[3]) {
+	double w = q[0], x = q[1], y = q[2], z = q[3];
+	double R[3][3] = {
+		{ 1 - 2 * (y * y + z * z), 2 * (x * y - w * z), 2 * (x * z + w * y) },
+		{ 2 * (x * y + w * z), 1 - 2 * (x * x + z * z), 2 * (y * z - w * x) },
+		{ 2 * (x * z - w * y), 2 * (y * z + w * x), 1 - 2 * (x * x + y * y) } };
+	for (int r = 0; r < 3; r++) out[r] = R[r][0] * v[0] + R[r][1] * v[1] + R[r][2] * v[2];
+}
+
+/* The watch logs and the Kinect capture of a session of the given length. K is w x y z */
+static bool writeSession(double seconds, const double K[4]) {
+	FILE * gyro = fopen(gyro_path, "w");
+	FILE * accel = fopen(accel_path, "w");
+	FILE * rv = fopen(rot_vector_path, "w");
+	FILE * kin = fopen(kindata_path, "w");
+	bool ok = gyro && accel && rv && kin;
+	for (int i = 0; ok && i < (int)(seconds * watch_rate); i++) {
+		double t = i / watch_rate;
+		long long ns = watch_start_ns + (long long)floor(t * 1e9 + 0.5);
+		double q[4], q0[4], q1[4], conj[4], dq[4], w[4];
+		const double h = 1e-4;
+		watchQuat(t, q);
+		watchQuat(t - h, q0);
+		watchQuat(t + h, q1);
+		// body rate: 2 conj(q) dq/dt
+		conj[0] = q[0];
+		for (int c = 1; c < 4; c++) conj[c] = -q[c];
+		for (int c = 0; c < 4; c++) dq[c] = (q1[c] - q0[c]) / (2 * h);
+		quatProd(conj, dq, w);
+		double up[3] = { 0, 0, gravity }, g[3];
+		rotate(conj, up, g);
+		fprintf(gyro, "%lld %f %f %f\n", ns, 2 * w[1] + true_bias[0], 2 * w[2] + true_bias[1], 2 * w[3] + true_bias[2]);
+		fprintf(accel, "%lld %f %f %f\n", ns, g[0], g[1], g[2]);
+		fprintf(rv, "%lld %f %f %f %f\n", ns, q[1], q[2], q[3], q[0]);
+	}
+	// the capture starts before and ends after the watch recording
+	double elbow[3] = { 0.1, 0.2, 2.0 };
+	int lost = 0;
+	if (ok) fprintf(kin, "%% kindata markers 2 bodies 2 ids 1 sync 0 joints 4 6 5 20\n");
+	for (double t = -2; ok && t < seconds + 2; t += 1 / kinect_rate + 0.005 * (2 * uniform() - 1)) {
+		double q[4], x[3] = { 1, 0, 0 }, u[3], a[3];
+		watchQuat(t, q);
+		rotate(q, x, u);
+		rotate(K, u, a);
+		int body = 1;
+		if (lost > 0) {
+			lost--;
+			body = -1;
+		}
+		else if (uniform() < lost_share) {
+			lost = rand() % 5;
+			body = -1;
+		}
+		double wrist[3];
+		for (int c = 0; c < 3; c++) wrist[c] = elbow[c] + 0.25 * a[c] + joint_sd * gaussian();
+		double kt = (watch_start_ns + t * 1e9) * 1e-9 + true_offset;
+		// shoulder, wrist, elbow, spine shoulder; the second body is the wrist's mirror
+		fprintf(kin, "%f\t1\t0.0\t0.0\t0.0\t-1\t0.0\t0.0\t0.0\t%d\t72057594037928\t0.0\t0.0\t0.0\t%f\t%f\t%f\t%f\t%f\t%f\t0.0\t0.0\t0.0"
+			"\t1\t72057594037931\t0.0\t0.0\t0.0\t%f\t%f\t%f\t%f\t%f\t%f\t0.0\t0.0\t0.0\n", kt, body,
+			wrist[0], wrist[1], wrist[2], elbow[0], elbow[1], elbow[2],
+			-wrist[0], -wrist[1], -wrist[2], elbow[0], elbow[1], elbow[2]);
+	}
+	if (gyro) fclose(gyro);
+	if (accel) fclose(accel);
+	if (rv) fclose(rv);
+	if (kin) fclose(kin);
+	return ok;
+}
+
+/* Degrees between two rotations, quaternions w x y z */
+static double quatAngle(const double a[4], const float b[4]) {
+	double dot = 0, nb = 0;
+	for (int c = 0; c < 4; c++) {
+		dot += a[c] * b[c];
+		nb += (double)b[c] * b[c];
+	}
+	double cosine = fabs(dot) / sqrt(nb);
+	return 2 * acos(cosine > 1 ? 1 : cosine) * 180 / pi;
+}
+
+int main(int argc, char ** argv) {
+	double seconds = argc > 1 ? atof(argv[1]) : 60;
+	int iterations = argc > 2 ? atoi(argv[2]) : 20;
+	srand(1);
+	// K: 30 degrees about z, then 20 about x
+	double qx[4], qz[4], K[4];
+	axisQuat(0, 20 * pi / 180, qx);
+	axisQuat(2, 30 * pi / 180, qz);
+	quatProd(qx, qz, K);
+	if (!writeSession(seconds, K)) {
+		printf("cannot write the session\n");
+		return 1;
+	}
+
+	struct batch_session session;
+	memset(&session, 0, sizeof(session));
+	snprintf(session.name, sizeof(session.name), "batchAnalysisBench");
+	snprintf(session.gyro, sizeof(session.gyro), "%s", gyro_path);
+	snprintf(session.accel, sizeof(session.accel), "%s", accel_path);
+	snprintf(session.rot_vector, sizeof(session.rot_vector), "%s", rot_vector_path);
+	snprintf(session.kindata, sizeof(session.kindata), "%s", kindata_path);
+	struct batch_params params;
+	defaultBatchParams(&params);
+	struct batch_workspace ws;
+	memset(&ws, 0, sizeof(ws));
+	struct batch_result result;
+	analyzeSession(session, params, &ws, &result);
+	bench_clock::time_point start = bench_clock::now();
+	for (int it = 0; it < iterations; it++) analyzeSession(session, params, &ws, &result);
+	double ms = std::chrono::duration<double, std::milli>(bench_clock::now() - start).count() / iterations;
+	freeBatchWorkspace(&ws);
+	remove(gyro_path);
+	remove(accel_path);
+	remove(rot_vector_path);
+	remove(kindata_path);
+
+	double biasError = 0;
+	for (int c = 0; c < 3; c++) biasError = fmax(biasError, fabs(result.bias[c] - true_bias[c]));
+	double offsetError = fabs(result.offset - true_offset);
+	double KError = quatAngle(K, result.K);
+	printf("%.0f s session: %d gyro rows, %d kinect rows with a body, %d pairs, %d inliers\n",
+		seconds, result.gyro_rows, result.kinect_rows, result.pairs, result.inliers);
+	printf("%-14s %16s %16s %10s\n", "", "true", "found", "error");
+	for (int c = 0; c < 3; c++) {
+		printf("bias %c (rad/s) %16.6f %16.6f %10.6f\n", 'x' + c, true_bias[c], result.bias[c], fabs(result.bias[c] - true_bias[c]));
+	}
+	printf("%-14s %16.6f %16.6f %10.6f\n", "offset (s)", true_offset, result.offset, offsetError);
+	printf("%-14s %7.4f %.4f %.4f %.4f  %7.4f %.4f %.4f %.4f %10.3f deg\n", "K (w x y z)",
+		K[0], K[1], K[2], K[3], result.K[0], result.K[1], result.K[2], result.K[3], KError);
+	printf("sync score %.3f, arm error after K %.2f deg\n", result.score, result.arm_error);
+	printf("analyzeSession %.2f ms\n", ms);
+	bool ok = result.status == BATCH_OK && biasError < bias_tolerance && offsetError < offset_tolerance && KError < K_tolerance;
+	if (!ok) printf("FAILED (tolerances: bias %g rad/s, offset %g s, K %g deg)\n", bias_tolerance, offset_tolerance, K_tolerance);
+	return ok ? 0 : 1;
+}
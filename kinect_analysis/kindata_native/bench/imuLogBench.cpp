@@ -0,0 +1,179 @@
+/* *******************************************************************************
+ *	                              imuLogBench
+ *
+ * Load time of the IMU logs: loadImuLog against reading the same files
+ * with iostreams (getline + stringstream, the way a quick tool would).
+ * Walks a directory tree (default ../../../data) and takes every .txt file
+ * that parses as a log. Every value is checked against strtoll / strtof.
+ *
+ * Usage: imuLogBench [data directory] [iterations]
+ * Build: ../imuLog.cpp
+ *********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "../imuLog.h"
+
+using namespace std;
+
+/* All .txt files below dir */
+static void findLogs(const string & dir, vector<string> & files) {
+#ifdef _WIN32
+	WIN32_FIND_DATAA fd;
+	HANDLE h = FindFirstFileA((dir + "\\*").c_str(), &fd);
+	if (h == INVALID_HANDLE_VALUE) return;
+	do {
+		string name = fd.cFileName;
+		if (name == "." || name == "..") continue;
+		string path = dir + "\\" + name;
+		if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) findLogs(path, files);
+		else if (name.size() > 4 && name.compare(name.size() - 4, 4, ".txt") == 0) files.push_back(path);
+	} while (FindNextFileA(h, &fd));
+	FindClose(h);
+#else
+	DIR * d = opendir(dir.c_str());
+	if (!d) return;
+	while (struct dirent * e = readdir(d)) {
+		string name = e->d_name;
+		if (name == "." || name == "..") continue;
+		string path = dir + "/" + name;
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0) continue;
+		if (S_ISDIR(st.st_mode)) findLogs(path, files);
+		else if (name.size() > 4 && name.compare(name.size() - 4, 4, ".txt") == 0) files.push_back(path);
+	}
+	closedir(d);
+#endif
+}
+
+static long long fileSize(const string & path) {
+	FILE * f = fopen(path.c_str(), "rb");
+	if (!f) return 0;
+	fseek(f, 0, SEEK_END);
+	long long n = ftell(f);
+	fclose(f);
+	return n;
+}
+
+/* Baseline: line by line through iostreams */
+static int streamLoad(const string & path, int columns, bool timed, vector<long long> & t, vector<float> & v) {
+	ifstream in(path.c_str());
+	string line;
+	int rows = 0;
+	t.clear();
+	v.clear();
+	while (getline(in, line)) {
+		for (size_t i = 0; i < line.size(); i++) {
+			if (line[i] == ',') line[i] = ' ';
+		}
+		istringstream s(line);
+		long long ts = 0;
+		if (timed && !(s >> ts)) continue;
+		float x[IMU_MAX_COLUMNS];
+		int c = 0;
+		while (c < columns && s >> x[c]) c++;
+		float extra;
+		if (c < columns || s >> extra) continue;
+		t.push_back(ts);
+		v.insert(v.end(), x, x + columns);
+		rows++;
+	}
+	return rows;
+}
+
+/* Reference: every line split into tokens, converted with strtoll / strtof. Returns mismatches */
+static int verify(const string & path, const struct imu_log & log) {
+	FILE * f = fopen(path.c_str(), "rb");
+	if (!f) return 1;
+	char line[1024];
+	int row = 0, bad = 0;
+	while (fgets(line, sizeof(line), f)) {
+		char * tok[IMU_MAX_COLUMNS + 2];
+		int n = 0;
+		for (char * s = strtok(line, " \t,\r\n"); s && n < IMU_MAX_COLUMNS + 2; s = strtok(NULL, " \t,\r\n")) tok[n++] = s;
+		if (n != log.columns + (log.timed ? 1 : 0)) continue;
+		if (row >= log.rows) return bad + 1;
+		int first = 0;
+		if (log.timed) {
+			if (strtoll(tok[0], NULL, 10) != log.t[row]) bad++;
+			first = 1;
+		}
+		for (int c = 0; c < log.columns; c++) {
+			float ref = strtof(tok[first + c], NULL);
+			if (memcmp(&ref, &log.v[c][row], sizeof(float)) != 0) bad++;
+		}
+		row++;
+	}
+	fclose(f);
+	return bad + (row != log.rows ? 1 : 0);
+}
+
+typedef std::chrono::steady_clock bench_clock;
+
+int main(int argc, char ** argv) {
+	string dir = argc > 1 ? argv[1] : "../../../data";
+	int iterations = argc > 2 ? atoi(argv[2]) : 20;
+	vector<string> files;
+	findLogs(dir, files);
+
+	struct imu_log log;
+	memset(&log, 0, sizeof(log));
+	vector<string> logs;
+	vector<int> columns;
+	vector<bool> timed;
+	long long bytes = 0, rows = 0;
+	int mismatches = 0;
+	for (size_t i = 0; i < files.size(); i++) {
+		if (!loadImuLog(files[i].c_str(), &log) || log.rows == 0) continue;
+		logs.push_back(files[i]);
+		columns.push_back(log.columns);
+		timed.push_back(log.timed);
+		bytes += fileSize(files[i]);
+		rows += log.rows;
+		int bad = verify(files[i], log);
+		if (bad) printf("mismatch %s: %d\n", files[i].c_str(), bad);
+		mismatches += bad;
+	}
+	printf("%d logs of %d files, %.2f MB, %lld rows, %d mismatches against strtof\n",
+		(int)logs.size(), (int)files.size(), bytes / 1e6, rows, mismatches);
+	if (logs.empty()) return 1;
+
+	bench_clock::time_point start = bench_clock::now();
+	for (int it = 0; it < iterations; it++) {
+		for (size_t i = 0; i < logs.size(); i++) loadImuLog(logs[i].c_str(), &log);
+	}
+	double fast = std::chrono::duration<double>(bench_clock::now() - start).count() / iterations;
+
+	vector<long long> t;
+	vector<float> v;
+	int streamIterations = iterations / 10 > 0 ? iterations / 10 : 1;
+	long long streamRows = 0;
+	start = bench_clock::now();
+	for (int it = 0; it < streamIterations; it++) {
+		for (size_t i = 0; i < logs.size(); i++) streamRows += streamLoad(logs[i], columns[i], timed[i], t, v);
+	}
+	double slow = std::chrono::duration<double>(bench_clock::now() - start).count() / streamIterations;
+	if (streamRows != rows * streamIterations) printf("iostream rows differ: %lld\n", streamRows / streamIterations);
+
+	printf("%-12s %10s %10s %12s\n", "loader", "ms", "MB/s", "Mrows/s");
+	printf("%-12s %10.2f %10.1f %12.2f\n", "loadImuLog", fast * 1e3, bytes / fast / 1e6, rows / fast / 1e6);
+	printf("%-12s %10.2f %10.1f %12.2f\n", "iostream", slow * 1e3, bytes / slow / 1e6, rows / slow / 1e6);
+	printf("speedup %.1fx\n", slow / fast);
+	freeImuLog(&log);
+	return mismatches ? 1 : 0;
+}
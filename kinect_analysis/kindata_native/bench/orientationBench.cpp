@@ -0,0 +1,254 @@
+/* *******************************************************************************
+ *	                              orientationBench
+ *
+ * Orientation of every watch session under a data directory (default
+ * ../../../data, the *_gyro.txt logs with their *_accel.txt): the
+ * sample by sample quaternion loop of quaternion_gyroscope/main.m
+ * (quaternProd, quatern2rotMat per sample, in double) against orientLog +
+ * rotatePoint on one core and orientSessions on all cores.
+ * Checks that the gyro only result matches the main.m loop and that the
+ * streaming filter gives the batch result.
+ *
+ * Usage: orientationBench [data directory] [iterations]
+ * Build: ../imuLog.cpp ../orientation.cpp
+ *********************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "../imuLog.h"
+#include "../orientation.h"
+
+using namespace std;
+
+/* All *_gyro.txt files below dir */
+static void findGyroLogs(const string & dir, vector<string> & files) {
+	const string suffix = "_gyro.txt";
+#ifdef _WIN32
+	WIN32_FIND_DATAA fd;
+	HANDLE h = FindFirstFileA((dir + "\\*").c_str(), &fd);
+	if (h == INVALID_HANDLE_VALUE) return;
+	do {
+		string name = fd.cFileName;
+		if (name == "." || name == "..") continue;
+		string path = dir + "\\" + name;
+		if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) findGyroLogs(path, files);
+		else if (name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) files.push_back(path);
+	} while (FindNextFileA(h, &fd));
+	FindClose(h);
+#else
+	DIR * d = opendir(dir.c_str());
+	if (!d) return;
+	while (struct dirent * e = readdir(d)) {
+		string name = e->d_name;
+		if (name == "." || name == "..") continue;
+		string path = dir + "/" + name;
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0) continue;
+		if (S_ISDIR(st.st_mode)) findGyroLogs(path, files);
+		else if (name.size() > suffix.size() && name.compare(name.size() - suffix.size(), suffix.size(), suffix) == 0) files.push_back(path);
+	}
+	closedir(d);
+#endif
+}
+
+// main.m, one sample at a time
+struct quat4 {
+	double v[4];
+};
+
+static quat4 quaternProd(const quat4 & a, const quat4 & b) {
+	quat4 ab;
+	ab.v[0] = a.v[0] * b.v[0] - a.v[1] * b.v[1] - a.v[2] * b.v[2] - a.v[3] * b.v[3];
+	ab.v[1] = a.v[0] * b.v[1] + a.v[1] * b.v[0] + a.v[2] * b.v[3] - a.v[3] * b.v[2];
+	ab.v[2] = a.v[0] * b.v[2] - a.v[1] * b.v[3] + a.v[2] * b.v[0] + a.v[3] * b.v[1];
+	ab.v[3] = a.v[0] * b.v[3] + a.v[1] * b.v[2] - a.v[2] * b.v[1] + a.v[3] * b.v[0];
+	return ab;
+}
+
+static void quatern2rotMat(const quat4 & q, double R[3][3]) {
+	double w = q.v[0], x = q.v[1], y = q.v[2], z = q.v[3];
+	R[0][0] = 1 - 2 * y * y - 2 * z * z; R[0][1] = 2 * (x * y - z * w); R[0][2] = 2 * (x * z + y * w);
+	R[1][0] = 2 * (x * y + z * w); R[1][1] = 1 - 2 * x * x - 2 * z * z; R[1][2] = 2 * (y * z - x * w);
+	R[2][0] = 2 * (x * z - y * w); R[2][1] = 2 * (y * z + x * w); R[2][2] = 1 - 2 * x * x - 2 * y * y;
+}
+
+static void mainLoop(const struct imu_log & gyro, const float bias[3], const struct orient_params & params,
+	vector<quat4> & Q, vector<double> & P) {
+	Q.resize(gyro.rows);
+	P.resize(gyro.rows * 3);
+	const double P1[3] = { 1, 0, 1 };
+	quat4 q = { { 1, 0, 0, 0 } };
+	Q[0] = q;
+	long long last = gyro.t[0];
+	for (int i = 1; i < gyro.rows; i++) {
+		quat4 rate = { { 0, gyro.v[0][i] - bias[0], gyro.v[1][i] - bias[1], gyro.v[2][i] - bias[2] } };
+		quat4 half = { { 0.5 * q.v[0], 0.5 * q.v[1], 0.5 * q.v[2], 0.5 * q.v[3] } };
+		quat4 qdot = quaternProd(half, rate);
+		// out of order stamps as OrientationFilter takes them (main.m would step back in time)
+		double dt = (gyro.t[i] - last) * params.time_unit;
+		if (dt < 0) dt = 0;
+		else last = gyro.t[i];
+		if (dt > params.max_dt) dt = params.max_dt;
+		double n = 0;
+		for (int k = 0; k < 4; k++) {
+			q.v[k] += qdot.v[k] * dt;
+			n += q.v[k] * q.v[k];
+		}
+		for (int k = 0; k < 4; k++) q.v[k] /= sqrt(n);
+		Q[i] = q;
+		double R[3][3];
+		quatern2rotMat(q, R);
+		for (int r = 0; r < 3; r++) P[i * 3 + r] = R[r][0] * P1[0] + R[r][1] * P1[1] + R[r][2] * P1[2];
+	}
+}
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double seconds(bench_clock::time_point start, int iterations) {
+	return std::chrono::duration<double>(bench_clock::now() - start).count() / iterations;
+}
+
+int main(int argc, char ** argv) {
+	string dir = argc > 1 ? argv[1] : "../../../data";
+	int iterations = argc > 2 ? atoi(argv[2]) : 20;
+	vector<string> files;
+	findGyroLogs(dir, files);
+
+	vector<struct imu_log> gyro, accel;
+	long long samples = 0;
+	for (size_t i = 0; i < files.size(); i++) {
+		struct imu_log g, a;
+		memset(&g, 0, sizeof(g));
+		memset(&a, 0, sizeof(a));
+		string accelPath = files[i].substr(0, files[i].size() - strlen("_gyro.txt")) + "_accel.txt";
+		if (!loadImuLog(files[i].c_str(), &g) || !g.timed || g.columns != 3 || g.rows < 2) {
+			freeImuLog(&g);
+			continue;
+		}
+		loadImuLog(accelPath.c_str(), &a);
+		gyro.push_back(g);
+		accel.push_back(a);
+		samples += g.rows;
+	}
+	int n = (int)gyro.size();
+	printf("%d sessions, %lld gyro samples\n", n, samples);
+	if (n == 0) return 1;
+
+	struct orient_params params;
+	defaultOrientParams(&params);
+	const float P1[3] = { 1, 0, 1 };
+
+	// correctness: gyro only against main.m, streaming against batch
+	double maxDiff = 0;
+	int streamMismatch = 0;
+	vector<quat4> Q;
+	vector<double> P;
+	struct quat_array q;
+	memset(&q, 0, sizeof(q));
+	for (int s = 0; s < n; s++) {
+		float bias[3];
+		gyroBias(gyro[s], params, bias);
+		mainLoop(gyro[s], bias, params, Q, P);
+		orientLog(gyro[s], NULL, params, &q);
+		for (int i = 0; i < q.count; i++) {
+			double d = fabs(q.w[i] - Q[i].v[0]) + fabs(q.x[i] - Q[i].v[1]) + fabs(q.y[i] - Q[i].v[2]) + fabs(q.z[i] - Q[i].v[3]);
+			if (d > maxDiff) maxDiff = d;
+		}
+		struct orient_params madgwick = params;
+		madgwick.filter = ORIENT_MADGWICK;
+		madgwick.gain = 0.1f;
+		madgwick.bias_first = 0;
+		orientLog(gyro[s], &accel[s], madgwick, &q);
+		OrientationFilter live(madgwick);
+		live.setBias(bias);
+		int j = 0;
+		for (int i = 0; i < gyro[s].rows; i++) {
+			for (; j < accel[s].rows && accel[s].t[j] <= gyro[s].t[i]; j++) {
+				float a[3] = { accel[s].v[0][j], accel[s].v[1][j], accel[s].v[2][j] };
+				live.accel(a);
+			}
+			float w[3] = { gyro[s].v[0][i], gyro[s].v[1][i], gyro[s].v[2][i] };
+			live.gyro(gyro[s].t[i], w);
+			const float * lq = live.quaternion();
+			if (lq[0] != q.w[i] || lq[1] != q.x[i] || lq[2] != q.y[i] || lq[3] != q.z[i]) streamMismatch++;
+		}
+	}
+	printf("gyro only vs main.m loop: max |dq| %.2e, streaming vs batch mismatches: %d\n", maxDiff, streamMismatch);
+
+	// speed
+	bench_clock::time_point start = bench_clock::now();
+	for (int it = 0; it < iterations; it++) {
+		for (int s = 0; s < n; s++) {
+			float bias[3];
+			gyroBias(gyro[s], params, bias);
+			mainLoop(gyro[s], bias, params, Q, P);
+		}
+	}
+	double reference = seconds(start, iterations);
+
+	vector<float> px, py, pz;
+	const char * names[] = { "gyro", "complementary", "madgwick" };
+	const orient_filter filters[] = { ORIENT_GYRO, ORIENT_COMPLEMENTARY, ORIENT_MADGWICK };
+	printf("%-28s %10s %12s\n", "", "ms", "Msamples/s");
+	printf("%-28s %10.2f %12.2f\n", "main.m loop (double)", reference * 1e3, samples / reference / 1e6);
+	for (int f = 0; f < 3; f++) {
+		struct orient_params p = params;
+		p.filter = filters[f];
+		p.gain = f == 1 ? 1.0f : 0.1f;
+		start = bench_clock::now();
+		for (int it = 0; it < iterations; it++) {
+			for (int s = 0; s < n; s++) {
+				orientLog(gyro[s], &accel[s], p, &q);
+				px.resize(q.count);
+				py.resize(q.count);
+				pz.resize(q.count);
+				rotatePoint(q, P1, &px[0], &py[0], &pz[0]);
+			}
+		}
+		double single = seconds(start, iterations);
+		char name[64];
+		sprintf(name, "%s, 1 core", names[f]);
+		printf("%-28s %10.2f %12.2f\n", name, single * 1e3, samples / single / 1e6);
+	}
+
+	vector<struct orient_session> sessions(n);
+	memset(&sessions[0], 0, n * sizeof(sessions[0]));
+	for (int s = 0; s < n; s++) {
+		sessions[s].gyro = &gyro[s];
+		sessions[s].accel = &accel[s];
+	}
+	struct orient_params p = params;
+	p.filter = ORIENT_MADGWICK;
+	p.gain = 0.1f;
+	int threads = (int)std::thread::hardware_concurrency();
+	start = bench_clock::now();
+	int done = 0;
+	for (int it = 0; it < iterations; it++) done = orientSessions(&sessions[0], n, p);
+	double parallel = seconds(start, iterations);
+	char name[64];
+	sprintf(name, "madgwick, %d threads", threads);
+	printf("%-28s %10.2f %12.2f (%d sessions)\n", name, parallel * 1e3, samples / parallel / 1e6, done);
+
+	for (int s = 0; s < n; s++) {
+		freeQuatArray(&sessions[s].q);
+		freeImuLog(&gyro[s]);
+		freeImuLog(&accel[s]);
+	}
+	freeQuatArray(&q);
+	return maxDiff < 1e-3 && streamMismatch == 0 ? 0 : 1;
+}
@@ -0,0 +1,256 @@
+/* *******************************************************************************
+ *	                              resamplerBench
+ *
+ * StreamResampler on synthetic streams with jittered time stamps: a 30 Hz
+ * Kinect marker track with dropouts and a 200 Hz watch signal, against
+ * the analytic signal on the 100 Hz grid (error of linear and cubic), a
+ * rotating quaternion (SLERP error and norm), and both joined by a
+ * GridAligner into one table. With a session (the logs' common prefix),
+ * resamples its _accel, _gyro and _rotVector logs and times them.
+ *
+ * Usage: resamplerBench [session]
+ * Build: ../resampler.cpp ../imuLog.cpp
+ *********************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "../resampler.h"
+
+using namespace std;
+
+static const double pi = 3.14159265358979323846;
+static const double seconds = 600;
+static const double kinect_rate = 30;
+static const double watch_rate = 200;
+static const double jitter = 0.3; // of the nominal sample period
+static const double dropout = 0.02; // chance of a lost marker per Kinect frame
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double signal(double t) {
+	return sin(2 * pi * 0.7 * t) + 0.3 * sin(2 * pi * 2.3 * t);
+}
+
+/* Rotation about a slowly turning axis, w x y z */
+static void rotation(double t, double * q) {
+	double angle = 2 * pi * 0.4 * t;
+	double ax = cos(0.1 * t), ay = sin(0.1 * t), az = 0.5;
+	double n = sqrt(ax * ax + ay * ay + az * az);
+	q[0] = cos(angle / 2);
+	q[1] = sin(angle / 2) * ax / n;
+	q[2] = sin(angle / 2) * ay / n;
+	q[3] = sin(angle / 2) * az / n;
+}
+
+static double uniform() {
+	return rand() / (double)RAND_MAX;
+}
+
+/* Jittered time stamps (ns) at about rate */
+static vector<long long> stamps(double rate) {
+	vector<long long> t;
+	for (long long i = 0; i < seconds * rate; i++) t.push_back((long long)((i + (uniform() - 0.5) * jitter) / rate * 1e9));
+	return t;
+}
+
+struct accuracy {
+	long long outputs, valid;
+	double max_error, rms, max_norm_error, ns;
+};
+
+static struct accuracy scalarStream(const vector<long long> & t, resample_method method) {
+	struct resample_params params;
+	defaultResampleParams(&params);
+	params.method = method;
+	StreamResampler resampler(1, params);
+	struct accuracy a;
+	memset(&a, 0, sizeof(a));
+	double e2 = 0;
+	long long index;
+	float out;
+	bool valid;
+	bench_clock::time_point start = bench_clock::now();
+	for (size_t i = 0; i <= t.size(); i++) {
+		if (i < t.size()) {
+			float v = (float)signal(t[i] * 1e-9);
+			resampler.push(t[i], &v);
+		}
+		else {
+			resampler.finish();
+		}
+		while (resampler.next(&index, &out, &valid)) {
+			a.outputs++;
+			if (!valid) continue;
+			a.valid++;
+			double e = fabs(out - signal(index / params.rate));
+			e2 += e * e;
+			if (e > a.max_error) a.max_error = e;
+		}
+	}
+	a.ns = std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / a.outputs;
+	a.rms = sqrt(e2 / a.valid);
+	return a;
+}
+
+static struct accuracy quaternionStream(const vector<long long> & t) {
+	struct resample_params params;
+	defaultResampleParams(&params);
+	params.method = RESAMPLE_SLERP;
+	StreamResampler resampler(4, params);
+	struct accuracy a;
+	memset(&a, 0, sizeof(a));
+	double e2 = 0;
+	long long index;
+	float out[4];
+	bool valid;
+	bench_clock::time_point start = bench_clock::now();
+	for (size_t i = 0; i <= t.size(); i++) {
+		if (i < t.size()) {
+			double q[4];
+			rotation(t[i] * 1e-9, q);
+			// the sign of a logged quaternion is arbitrary
+			double s = (i / 7) % 2 ? -1 : 1;
+			float v[4] = { (float)(s * q[0]), (float)(s * q[1]), (float)(s * q[2]), (float)(s * q[3]) };
+			resampler.push(t[i], v);
+		}
+		else {
+			resampler.finish();
+		}
+		while (resampler.next(&index, out, &valid)) {
+			a.outputs++;
+			if (!valid) continue;
+			a.valid++;
+			double q[4], d = 0, n = 0;
+			rotation(index / params.rate, q);
+			for (int c = 0; c < 4; c++) {
+				d += q[c] * out[c];
+				n += (double)out[c] * out[c];
+			}
+			// angle between the rotations
+			d = fabs(d);
+			double e = 2 * acos(d > 1 ? 1 : d);
+			e2 += e * e;
+			if (e > a.max_error) a.max_error = e;
+			if (fabs(sqrt(n) - 1) > a.max_norm_error) a.max_norm_error = fabs(sqrt(n) - 1);
+		}
+	}
+	a.ns = std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / a.outputs;
+	a.rms = sqrt(e2 / a.valid);
+	return a;
+}
+
+/* Kinect marker (3 columns, with dropouts) and watch quaternion fed interleaved in time order,
+   the way they arrive live, and joined into rows */
+static void alignedTable(const vector<long long> & kt, const vector<long long> & wt) {
+	struct resample_params params;
+	defaultResampleParams(&params);
+	params.method = RESAMPLE_CUBIC;
+	StreamResampler kinect(3, params);
+	params.method = RESAMPLE_SLERP;
+	StreamResampler watch(4, params);
+	GridAligner aligner(0.2);
+	aligner.addStream(&kinect);
+	aligner.addStream(&watch);
+	vector<float> row(aligner.columns());
+	long long rows = 0, both = 0, kinectOnly = 0, watchOnly = 0, first = 0, last = 0, gaps = 0;
+	long long index;
+	unsigned valid;
+	size_t k = 0, w = 0;
+	int lost = 0;
+	bench_clock::time_point start = bench_clock::now();
+	for (;;) {
+		bool kinectNext = k < kt.size() && (w >= wt.size() || kt[k] <= wt[w]);
+		if (kinectNext) {
+			double x = kt[k] * 1e-9;
+			float v[3] = { (float)signal(x), (float)signal(x + 1), (float)signal(x + 2) };
+			if (lost > 0) lost--;
+			else if (uniform() < dropout) lost = 1 + rand() % 5;
+			kinect.push(kt[k++], v, lost == 0);
+			if (k == kt.size()) kinect.finish();
+		}
+		else if (w < wt.size()) {
+			double q[4];
+			rotation(wt[w] * 1e-9, q);
+			float v[4] = { (float)q[0], (float)q[1], (float)q[2], (float)q[3] };
+			watch.push(wt[w++], v);
+			if (w == wt.size()) watch.finish();
+		}
+		bool done = k == kt.size() && w == wt.size();
+		while (aligner.nextRow(&index, &row[0], &valid)) {
+			if (rows == 0) first = index;
+			else if (index != last + 1) gaps++;
+			last = index;
+			rows++;
+			if (valid == 3) both++;
+			else if (valid == 1) kinectOnly++;
+			else if (valid == 2) watchOnly++;
+		}
+		if (done) break;
+	}
+	double ns = std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / rows;
+	printf("aligned table: %lld rows (grid %lld..%lld, %lld gaps), %lld both valid, %lld kinect only, %lld watch only, %.0f ns/row\n",
+		rows, first, last, gaps, both, kinectOnly, watchOnly, ns);
+}
+
+static void printAccuracy(const char * name, const struct accuracy & a, const char * unit) {
+	printf("%-30s %9lld %9lld %12.2e %12.2e %10.1f", name, a.outputs, a.valid, a.max_error, a.rms, a.ns);
+	if (a.max_norm_error > 0) printf("  |q|-1 %.1e", a.max_norm_error);
+	printf(" %s\n", unit);
+}
+
+static void resampleSession(const char * session) {
+	const char * logs[] = { "_accel", "_gyro", "_rotVector" };
+	for (int i = 0; i < 3; i++) {
+		char path[1024];
+		snprintf(path, sizeof(path), "%s%s.txt", session, logs[i]);
+		struct imu_log log;
+		memset(&log, 0, sizeof(log));
+		if (!loadImuLog(path, &log)) {
+			printf("%s: not loaded\n", path);
+			continue;
+		}
+		struct resample_params params;
+		defaultResampleParams(&params);
+		if (log.kind == IMU_ROTVECTOR && log.columns >= 4) {
+			params.method = RESAMPLE_SLERP;
+			log.columns = 4; // the accuracy column is not part of the quaternion
+		}
+		struct resampled_table table;
+		bench_clock::time_point start = bench_clock::now();
+		bool ok = resampleLog(log, params, &table);
+		double ms = std::chrono::duration<double, std::milli>(bench_clock::now() - start).count();
+		if (ok) {
+			int valid = 0;
+			for (int r = 0; r < table.rows; r++) valid += table.valid[r];
+			printf("%-12s %8d rows -> %8d at %.0f Hz (%d valid) %8.2f ms\n", logs[i], log.rows, table.rows, params.rate, valid, ms);
+		}
+		else {
+			printf("%-12s untimed\n", logs[i]);
+		}
+		freeResampledTable(&table);
+		freeImuLog(&log);
+	}
+}
+
+int main(int argc, char ** argv) {
+	srand(1);
+	vector<long long> kt = stamps(kinect_rate), wt = stamps(watch_rate);
+	printf("%.0f s, %zu kinect (%.0f Hz), %zu watch (%.0f Hz) samples, jitter %.0f%% of a period, on a 100 Hz grid\n",
+		seconds, kt.size(), kinect_rate, wt.size(), watch_rate, jitter * 100);
+	printf("%-30s %9s %9s %12s %12s %10s\n", "", "outputs", "valid", "max error", "rms", "ns/out");
+	printAccuracy("kinect 30 Hz linear", scalarStream(kt, RESAMPLE_LINEAR), "");
+	printAccuracy("kinect 30 Hz cubic", scalarStream(kt, RESAMPLE_CUBIC), "");
+	printAccuracy("watch 200 Hz linear", scalarStream(wt, RESAMPLE_LINEAR), "");
+	printAccuracy("watch 200 Hz cubic", scalarStream(wt, RESAMPLE_CUBIC), "");
+	printAccuracy("watch quaternion slerp", quaternionStream(wt), "rad");
+	printAccuracy("kinect quaternion slerp", quaternionStream(kt), "rad");
+	alignedTable(kt, wt);
+	if (argc > 1) resampleSession(argv[1]);
+	return 0;
+}
@@ -0,0 +1,200 @@
+/* *******************************************************************************
+ *	                              rotationFitBench
+ *
+ * Kinect <-> watch rotation from synthetic arm directions: a known
+ * rotation, noisy directions and a share of outlier frames (random
+ * directions, as from a lost joint). Compares fitRotationMatrix.m (50
+ * random pairs through find_rotation_matrix, loss over all frames) with
+ * the least squares and the reweighted fit: angle to the true rotation
+ * and time per fit.
+ *
+ * Usage: rotationFitBench [frames] [outlier share]
+ * Build: ../rotationFit.cpp
+ *********************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "../rotationFit.h"
+
+using namespace std;
+
+static double uniform() {
+	return rand() / (double)RAND_MAX;
+}
+
+static void normalize(double v[3]) {
+	double n = sqrt(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	for (int i = 0; i < 3; i++) v[i] /= n;
+}
+
+static void cross(const double a[3], const double b[3], double c[3]) {
+	c[0] = a[1] * b[2] - a[2] * b[1];
+	c[1] = a[2] * b[0] - a[0] * b[2];
+	c[2] = a[0] * b[1] - a[1] * b[0];
+}
+
+/* find_rotation_matrix.m: p such that up = p u and vp = p v (as far as possible) */
+static void findRotationMatrix(const double u0[3], const double v0[3], const double up0[3], const double vp0[3], double p[3][3]) {
+	double u[3], v[3], up[3], vp[3], w[3], x[3], wp[3], xp[3];
+	memcpy(u, u0, sizeof(u)); memcpy(v, v0, sizeof(v)); memcpy(up, up0, sizeof(up)); memcpy(vp, vp0, sizeof(vp));
+	normalize(u); normalize(v); normalize(up); normalize(vp);
+	cross(u, v, w); normalize(w);
+	cross(u, w, x); normalize(x);
+	cross(up, vp, wp); normalize(wp);
+	cross(up, wp, xp); normalize(xp);
+	const double * A[3] = { up, wp, xp };
+	const double * B[3] = { u, w, x };
+	for (int r = 0; r < 3; r++) {
+		for (int c = 0; c < 3; c++) {
+			p[r][c] = 0;
+			for (int k = 0; k < 3; k++) p[r][c] += A[k][r] * B[k][c];
+		}
+	}
+}
+
+/* fitRotationMatrix.m */
+static void fitRotationMatrix(const vector<double> & k, const vector<double> & w, int n, double bestK[3][3]) {
+	double best = 0;
+	for (int i = 0; i < n; i++) {
+		for (int c = 0; c < 3; c++) best += (k[i * 3 + c] - w[i * 3 + c]) * (k[i * 3 + c] - w[i * 3 + c]);
+	}
+	for (int r = 0; r < 3; r++) {
+		for (int c = 0; c < 3; c++) bestK[r][c] = r == c ? 1 : 0;
+	}
+	for (int t = 0; t < 50; t++) {
+		int a = (int)(uniform() * (n - 10)) + 9;
+		int b = (int)(uniform() * (n - 10)) + 9;
+		double K[3][3];
+		findRotationMatrix(&w[a * 3], &w[b * 3], &k[a * 3], &k[b * 3], K);
+		double loss = 0;
+		for (int j = 9; j < n - 10; j++) {
+			for (int r = 0; r < 3; r++) {
+				double d = k[j * 3 + r] - (K[r][0] * w[j * 3] + K[r][1] * w[j * 3 + 1] + K[r][2] * w[j * 3 + 2]);
+				loss += d * d;
+			}
+		}
+		if (loss < best) {
+			best = loss;
+			memcpy(bestK, K, sizeof(K));
+		}
+	}
+}
+
+/* Angle of A^T B in degrees */
+static double angleBetween(const double A[3][3], const float B[3][3]) {
+	double trace = 0;
+	for (int r = 0; r < 3; r++) {
+		for (int c = 0; c < 3; c++) trace += A[r][c] * B[r][c];
+	}
+	double cosine = (trace - 1) / 2;
+	if (cosine > 1) cosine = 1;
+	if (cosine < -1) cosine = -1;
+	return acos(cosine) * 180 / 3.14159265358979;
+}
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double elapsedUs(bench_clock::time_point start, int iterations) {
+	return std::chrono::duration<double, std::micro>(bench_clock::now() - start).count() / iterations;
+}
+
+int main(int argc, char ** argv) {
+	int n = argc > 1 ? atoi(argv[1]) : 1000;
+	double outliers = argc > 2 ? atof(argv[2]) : 0.2;
+	srand(1);
+
+	// true rotation: 100 degrees about (1, 2, 3)
+	double axis[3] = { 1, 2, 3 };
+	normalize(axis);
+	double angle = 100 * 3.14159265358979 / 180, c = cos(angle), s = sin(angle);
+	double K[3][3];
+	for (int r = 0; r < 3; r++) {
+		for (int q = 0; q < 3; q++) {
+			K[r][q] = (r == q ? c : 0) + (1 - c) * axis[r] * axis[q];
+		}
+	}
+	K[0][1] -= s * axis[2]; K[0][2] += s * axis[1];
+	K[1][0] += s * axis[2]; K[1][2] -= s * axis[0];
+	K[2][0] -= s * axis[1]; K[2][1] += s * axis[0];
+
+	// a swinging arm direction, seen by both with noise, some Kinect frames wrong
+	vector<double> w(n * 3), k(n * 3);
+	vector<float> cols(n * 6);
+	for (int i = 0; i < n; i++) {
+		double t = i * 0.01;
+		double d[3] = { cos(t * 2.1) * cos(t * 0.7), sin(t * 2.1) * cos(t * 0.7), sin(t * 0.7) };
+		double kd[3];
+		for (int r = 0; r < 3; r++) kd[r] = K[r][0] * d[0] + K[r][1] * d[1] + K[r][2] * d[2];
+		for (int r = 0; r < 3; r++) {
+			d[r] += (uniform() - 0.5) * 0.04;
+			kd[r] += (uniform() - 0.5) * 0.04;
+		}
+		if (uniform() < outliers) {
+			for (int r = 0; r < 3; r++) kd[r] = uniform() - 0.5;
+		}
+		normalize(d);
+		normalize(kd);
+		for (int r = 0; r < 3; r++) {
+			w[i * 3 + r] = d[r];
+			k[i * 3 + r] = kd[r];
+			cols[r * n + i] = (float)d[r];
+			cols[(3 + r) * n + i] = (float)kd[r];
+		}
+	}
+	const float * u[3] = { &cols[0], &cols[n], &cols[2 * n] };
+	const float * kc[3] = { &cols[3 * n], &cols[4 * n], &cols[5 * n] };
+
+	double matlabK[3][3];
+	const int matlabRuns = 20;
+	bench_clock::time_point start = bench_clock::now();
+	for (int it = 0; it < matlabRuns; it++) fitRotationMatrix(k, w, n, matlabK);
+	double matlabUs = elapsedUs(start, matlabRuns);
+	float matlabF[3][3];
+	for (int r = 0; r < 3; r++) {
+		for (int q = 0; q < 3; q++) matlabF[r][q] = (float)matlabK[r][q];
+	}
+
+	struct fit_workspace ws;
+	memset(&ws, 0, sizeof(ws));
+	struct fit_params plain, robust;
+	defaultFitParams(&robust);
+	plain = robust;
+	plain.iterations = 0;
+	struct rotation_fit fitPlain, fitRobust;
+	const int runs = 2000;
+	start = bench_clock::now();
+	for (int it = 0; it < runs; it++) fitRotation(u, kc, n, plain, &ws, &fitPlain);
+	double plainUs = elapsedUs(start, runs);
+	start = bench_clock::now();
+	for (int it = 0; it < runs; it++) fitRotation(u, kc, n, robust, &ws, &fitRobust);
+	double robustUs = elapsedUs(start, runs);
+
+	// per frame update of running sums, solved every frame
+	struct rotation_sums sums;
+	resetRotationSums(&sums);
+	struct rotation_fit live;
+	start = bench_clock::now();
+	for (int i = 0; i < n; i++) {
+		float ui[3] = { u[0][i], u[1][i], u[2][i] };
+		float ki[3] = { kc[0][i], kc[1][i], kc[2][i] };
+		decayRotationSums(&sums, 0.999);
+		addRotationPair(&sums, ui, ki);
+		solveRotation(sums, &live);
+	}
+	double liveUs = elapsedUs(start, n);
+
+	printf("%d frames, %.0f%% outliers\n", n, outliers * 100);
+	printf("%-28s %10s %12s %8s\n", "", "us/fit", "error (deg)", "inliers");
+	printf("%-28s %10.1f %12.3f %8s\n", "fitRotationMatrix.m", matlabUs, angleBetween(K, matlabF), "-");
+	printf("%-28s %10.1f %12.3f %8d\n", "least squares", plainUs, angleBetween(K, fitPlain.R), fitPlain.inliers);
+	printf("%-28s %10.1f %12.3f %8d\n", "reweighted", robustUs, angleBetween(K, fitRobust.R), fitRobust.inliers);
+	printf("%-28s %10.2f %12.3f %8s\n", "running sums, per frame", liveUs, angleBetween(K, live.R), "-");
+	freeFitWorkspace(&ws);
+	return 0;
+}
@@ -0,0 +1,295 @@
+/* *******************************************************************************
+ *	                              sessionFileBench
+ *
+ * Session files against the text logs: every session directory below the
+ * data directory (default ../../../data) is packed into one session file,
+ * exactly and with -quantum q (default 1e-5), and read back.
+ * Reports the sizes (the sessions of data/gyro/right also against
+ * prof_swing_right.zip, the same logs zipped by hand), checks every
+ * time stamp and value of the exact files bit for bit, and times loading
+ * whole sessions (loadImuLog on the text, readSessionStream on the file)
+ * and reading random one second windows.
+ *
+ * Usage: sessionFileBench [data directory] [quantum] [windows]
+ * Build: ../sessionFile.cpp ../imuLog.cpp
+ *********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "../imuLog.h"
+#include "../sessionFile.h"
+
+using namespace std;
+
+static const char * quantized_path = "sessionFileBench_quantized.kses";
+static const long long window_ns = 1000000000LL;
+
+struct bench_session {
+	string dir;
+	vector<string> logs; // timed logs
+	long long text_bytes;
+	long long exact_bytes;
+	long long quantized_bytes;
+};
+
+/* Directories below dir with timed logs directly in them */
+static void findSessions(const string & dir, vector<struct bench_session> & sessions, struct imu_log * log) {
+	vector<string> subdirs;
+	struct bench_session session;
+	session.dir = dir;
+	session.text_bytes = session.exact_bytes = session.quantized_bytes = 0;
+	vector<string> names;
+#ifdef _WIN32
+	WIN32_FIND_DATAA fd;
+	HANDLE h = FindFirstFileA((dir + "\\*").c_str(), &fd);
+	if (h == INVALID_HANDLE_VALUE) return;
+	do {
+		string name = fd.cFileName;
+		if (name == "." || name == "..") continue;
+		if (fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) subdirs.push_back(dir + "\\" + name);
+		else if (name.size() > 4 && name.compare(name.size() - 4, 4, ".txt") == 0) names.push_back(dir + "\\" + name);
+	} while (FindNextFileA(h, &fd));
+	FindClose(h);
+#else
+	DIR * d = opendir(dir.c_str());
+	if (!d) return;
+	while (struct dirent * e = readdir(d)) {
+		string name = e->d_name;
+		if (name == "." || name == "..") continue;
+		string path = dir + "/" + name;
+		struct stat st;
+		if (stat(path.c_str(), &st) != 0) continue;
+		if (S_ISDIR(st.st_mode)) subdirs.push_back(path);
+		else if (name.size() > 4 && name.compare(name.size() - 4, 4, ".txt") == 0) names.push_back(path);
+	}
+	closedir(d);
+#endif
+	for (size_t i = 0; i < names.size(); i++) {
+		if (!loadImuLog(names[i].c_str(), log) || !log->timed || log->rows == 0) continue;
+		session.logs.push_back(names[i]);
+	}
+	if (!session.logs.empty()) sessions.push_back(session);
+	for (size_t i = 0; i < subdirs.size(); i++) findSessions(subdirs[i], sessions, log);
+}
+
+static long long fileSize(const string & path) {
+	FILE * f = fopen(path.c_str(), "rb");
+	if (!f) return 0;
+	fseek(f, 0, SEEK_END);
+	long long n = ftell(f);
+	fclose(f);
+	return n;
+}
+
+/* Stream name: the file name, unique within a directory (data/gyro holds several gyro logs) */
+static string streamName(const string & path) {
+	size_t slash = path.find_last_of("/\\");
+	string name = path.substr(slash == string::npos ? 0 : slash + 1);
+	return name.substr(0, name.size() - 4).substr(0, SESSION_NAME_SIZE - 1);
+}
+
+static bool pack(const struct bench_session & session, const char * path, double quantum, struct imu_log * log) {
+	SessionWriter writer;
+	if (!writer.open(path)) return false;
+	for (size_t i = 0; i < session.logs.size(); i++) {
+		if (!loadImuLog(session.logs[i].c_str(), log)) return false;
+		int s = writer.addStream(streamName(session.logs[i]).c_str(), log->columns, 1e-9,
+			quantum > 0 ? SESSION_QUANTIZED : SESSION_EXACT, quantum);
+		if (s < 0 || !writer.appendColumns(s, log->t, log->v, log->rows)) return false;
+	}
+	return writer.close();
+}
+
+/* Values differing from the text logs, bit for bit */
+static int verify(const struct bench_session & session, const char * path, struct imu_log * log, struct session_table * table) {
+	struct session_file file;
+	memset(&file, 0, sizeof(file));
+	if (!openSession(path, &file)) return 1;
+	int bad = 0;
+	for (size_t i = 0; i < session.logs.size(); i++) {
+		loadImuLog(session.logs[i].c_str(), log);
+		int s = findSessionStream(file, streamName(session.logs[i]).c_str());
+		if (s < 0 || !readSessionStream(file, s, table) || table->rows != log->rows || table->columns != log->columns) {
+			bad++;
+			continue;
+		}
+		for (int r = 0; r < log->rows; r++) {
+			if (table->t[r] != log->t[r]) bad++;
+			for (int c = 0; c < log->columns; c++) {
+				if (memcmp(&table->v[c][r], &log->v[c][r], sizeof(float)) != 0) bad++;
+			}
+		}
+	}
+	closeSession(&file);
+	return bad;
+}
+
+/* Values of a small exact stream with negative zeros (a gyro axis at rest
+   logs as -0.000000) differing after a round trip, bit for bit */
+static int verifySignedZeros(const char * path, struct session_table * table) {
+	const int rows = 64;
+	long long t[rows];
+	float a[rows], b[rows];
+	for (int r = 0; r < rows; r++) {
+		t[r] = 1000000LL * r;
+		a[r] = (r % 3 == 0) ? -0.0f : 0.25f * (r % 5);
+		b[r] = (r % 2) ? -0.0f : 0.0f;
+	}
+	const float * v[2] = { a, b };
+	SessionWriter writer;
+	int s = writer.open(path) ? writer.addStream("signed_zeros", 2, 1e-9) : -1;
+	if (s < 0 || !writer.appendColumns(s, t, v, rows) || !writer.close()) return 1;
+	struct session_file file;
+	memset(&file, 0, sizeof(file));
+	if (!openSession(path, &file)) return 1;
+	int bad = 0;
+	if (!readSessionStream(file, 0, table) || table->rows != rows || table->columns != 2) bad++;
+	else {
+		for (int r = 0; r < rows; r++) {
+			if (table->t[r] != t[r]) bad++;
+			for (int c = 0; c < 2; c++) {
+				if (memcmp(&table->v[c][r], &v[c][r], sizeof(float)) != 0) bad++;
+			}
+		}
+	}
+	closeSession(&file);
+	remove(path);
+	return bad;
+}
+
+typedef std::chrono::steady_clock bench_clock;
+
+int main(int argc, char ** argv) {
+	string dir = argc > 1 ? argv[1] : "../../../data";
+	double quantum = argc > 2 ? atof(argv[2]) : 1e-5;
+	int windows = argc > 3 ? atoi(argv[3]) : 100000;
+	struct imu_log log;
+	memset(&log, 0, sizeof(log));
+	struct session_table table;
+	memset(&table, 0, sizeof(table));
+	vector<struct bench_session> sessions;
+	findSessions(dir, sessions, &log);
+	if (sessions.empty()) {
+		printf("no sessions in %s\n", dir.c_str());
+		return 1;
+	}
+
+	// sizes and exactness
+	long long text = 0, exact = 0, quantized = 0, rightText = 0, rightExact = 0, rightQuantized = 0;
+	int mismatches = 0, logs = 0;
+	vector<string> packed;
+	for (size_t i = 0; i < sessions.size(); i++) {
+		struct bench_session & s = sessions[i];
+		for (size_t j = 0; j < s.logs.size(); j++) s.text_bytes += fileSize(s.logs[j]);
+		char path[64];
+		snprintf(path, sizeof(path), "sessionFileBench_%d.kses", (int)i);
+		if (!pack(s, quantized_path, quantum, &log) || !pack(s, path, 0, &log)) {
+			printf("cannot pack %s\n", s.dir.c_str());
+			return 1;
+		}
+		packed.push_back(path);
+		s.exact_bytes = fileSize(path);
+		s.quantized_bytes = fileSize(quantized_path);
+		mismatches += verify(s, path, &log, &table);
+		text += s.text_bytes;
+		exact += s.exact_bytes;
+		quantized += s.quantized_bytes;
+		logs += (int)s.logs.size();
+		// the session directories zipped into prof_swing_right.zip
+		if (s.dir.find("gyro/right/") != string::npos || s.dir.find("gyro\\right\\") != string::npos) {
+			rightText += s.text_bytes;
+			rightExact += s.exact_bytes;
+			rightQuantized += s.quantized_bytes;
+		}
+	}
+	mismatches += verifySignedZeros(quantized_path, &table);
+	remove(quantized_path);
+	printf("%d sessions, %d logs, %d mismatches in the exact files\n", (int)sessions.size(), logs, mismatches);
+	printf("%-22s %12s %12s %12s\n", "", "text", "exact", "quantized");
+	printf("%-22s %12lld %11lld (%4.1f%%) %11lld (%4.1f%%)\n", "all sessions", text,
+		exact, 100.0 * exact / text, quantized, 100.0 * quantized / text);
+	long long zip = fileSize(dir + "/gyro/right/prof_swing_right.zip");
+	if (rightText > 0) {
+		printf("%-22s %12lld %11lld (%4.1f%%) %11lld (%4.1f%%)", "data/gyro/right/*", rightText,
+			rightExact, 100.0 * rightExact / rightText, rightQuantized, 100.0 * rightQuantized / rightText);
+		if (zip > 0) printf("   prof_swing_right.zip %lld (%4.1f%%)", zip, 100.0 * zip / rightText);
+		printf("\n");
+	}
+
+	// whole sessions
+	const int iterations = 20;
+	long long rows = 0;
+	bench_clock::time_point start = bench_clock::now();
+	for (int it = 0; it < iterations; it++) {
+		for (size_t i = 0; i < sessions.size(); i++) {
+			for (size_t j = 0; j < sessions[i].logs.size(); j++) {
+				loadImuLog(sessions[i].logs[j].c_str(), &log);
+				rows += log.rows;
+			}
+		}
+	}
+	double textTime = std::chrono::duration<double>(bench_clock::now() - start).count() / iterations;
+	long long fileRows = 0;
+	start = bench_clock::now();
+	for (int it = 0; it < iterations; it++) {
+		for (size_t i = 0; i < packed.size(); i++) {
+			struct session_file file;
+			memset(&file, 0, sizeof(file));
+			if (!openSession(packed[i].c_str(), &file)) continue;
+			for (int s = 0; s < file.header->streams; s++) {
+				readSessionStream(file, s, &table);
+				fileRows += table.rows;
+			}
+			closeSession(&file);
+		}
+	}
+	double fileTime = std::chrono::duration<double>(bench_clock::now() - start).count() / iterations;
+	if (fileRows != rows) printf("rows differ: %lld text, %lld file\n", rows / iterations, fileRows / iterations);
+	printf("%-22s %10s %12s\n", "load all sessions", "ms", "Mrows/s");
+	printf("%-22s %10.2f %12.2f\n", "loadImuLog (text)", textTime * 1e3, rows / iterations / textTime / 1e6);
+	printf("%-22s %10.2f %12.2f\n", "readSessionStream", fileTime * 1e3, fileRows / iterations / fileTime / 1e6);
+
+	// random one second windows, files kept open
+	vector<struct session_file> files(packed.size());
+	for (size_t i = 0; i < packed.size(); i++) {
+		memset(&files[i], 0, sizeof(files[i]));
+		openSession(packed[i].c_str(), &files[i]);
+	}
+	srand(1);
+	long long windowRows = 0;
+	start = bench_clock::now();
+	for (int w = 0; w < windows; w++) {
+		const struct session_file & file = files[rand() % files.size()];
+		if (!file.header) continue;
+		int s = rand() % file.header->streams;
+		const struct session_stream & st = file.header->stream[s];
+		const struct session_chunk & first = file.index[st.first_chunk], & last = file.index[st.first_chunk + st.chunks - 1];
+		long long span = last.t_last - first.t_first;
+		long long t0 = first.t_first + (long long)((double)rand() / RAND_MAX * span);
+		readSessionWindow(file, s, t0, t0 + window_ns, &table);
+		windowRows += table.rows;
+	}
+	double windowTime = std::chrono::duration<double>(bench_clock::now() - start).count();
+	printf("%d random 1 s windows: %.2f us per window, %.1f rows per window\n",
+		windows, windowTime / windows * 1e6, (double)windowRows / windows);
+	for (size_t i = 0; i < files.size(); i++) {
+		closeSession(&files[i]);
+		remove(packed[i].c_str());
+	}
+	freeSessionTable(&table);
+	freeImuLog(&log);
+	return mismatches ? 1 : 0;
+}
@@ -0,0 +1,129 @@
+/* *******************************************************************************
+ *	                              timeSyncBench
+ *
+ * Offset search on a synthetic 10 minute session at 100 Hz: the watch
+ * motion power (8 minutes) is a noisy copy of a window of the Kinect's,
+ * shifted by a fractional number of samples. Times syncSignals against
+ * the coarse / fine search of scalarTimeSync.m and a direct normalized
+ * correlation over every offset, and reports the error of each.
+ *
+ * Usage: timeSyncBench [iterations]
+ * Build: ../timeSync.cpp
+ *********************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "../timeSync.h"
+
+using namespace std;
+
+static const int rate = 100;
+static const int kinect_samples = 10 * 60 * rate;
+static const int watch_samples = 8 * 60 * rate;
+static const double true_offset = 4321.37; // kinect[i + offset] = watch[i]
+
+/* Swing like motion power: bursts of varying height on a noise floor */
+static double motion(double t) {
+	double swing = fmod(t, 7.3) < 1.2 ? sin(fmod(t, 7.3) / 1.2 * 3.14159) * (1 + 0.5 * sin(t * 0.37)) : 0;
+	return swing + 0.2 * sin(t * 1.7) * sin(t * 0.23);
+}
+
+static float noise() {
+	return (rand() / (float)RAND_MAX - 0.5f) * 0.1f;
+}
+
+/* scalarTimeSync.m: squared error every intv samples over every intv offsets, then every 2nd sample around the best */
+static int scalarTimeSync(const float * k, int n, const float * w, int m) {
+	const int intv = 10;
+	double bestError = 1e300;
+	int bestOfs = 0;
+	for (int ofs = 2 * intv; ofs <= n - m - intv; ofs += intv) {
+		double e = 0;
+		for (int i = 0; i < m - intv; i += intv) e += (w[i] - k[ofs + i]) * (w[i] - k[ofs + i]);
+		if (e < bestError) {
+			bestError = e;
+			bestOfs = ofs;
+		}
+	}
+	int coarse = bestOfs;
+	bestError = 1e300;
+	for (int ofs = coarse - intv; ofs <= coarse + intv; ofs++) {
+		if (ofs < 0 || ofs > n - m) continue;
+		double e = 0;
+		for (int i = 0; i < m - intv; i += 2) e += (w[i] - k[ofs + i]) * (w[i] - k[ofs + i]);
+		if (e < bestError) {
+			bestError = e;
+			bestOfs = ofs;
+		}
+	}
+	return bestOfs;
+}
+
+/* Normalized correlation at every offset, directly */
+static int directSync(const float * k, int n, const float * w, int m) {
+	double mw = 0, ew = 0;
+	for (int i = 0; i < m; i++) mw += w[i];
+	mw /= m;
+	for (int i = 0; i < m; i++) ew += (w[i] - mw) * (w[i] - mw);
+	double best = -2;
+	int bestLag = 0;
+	for (int lag = 0; lag <= n - m; lag++) {
+		double num = 0, s1 = 0, s2 = 0;
+		for (int i = 0; i < m; i++) {
+			num += (w[i] - mw) * k[lag + i];
+			s1 += k[lag + i];
+			s2 += (double)k[lag + i] * k[lag + i];
+		}
+		double score = num / sqrt(ew * (s2 - s1 * s1 / m));
+		if (score > best) {
+			best = score;
+			bestLag = lag;
+		}
+	}
+	return bestLag;
+}
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double elapsedMs(bench_clock::time_point start, int iterations) {
+	return std::chrono::duration<double, std::milli>(bench_clock::now() - start).count() / iterations;
+}
+
+int main(int argc, char ** argv) {
+	int iterations = argc > 1 ? atoi(argv[1]) : 20;
+	vector<float> kinect(kinect_samples), watch(watch_samples);
+	for (int i = 0; i < kinect_samples; i++) kinect[i] = (float)motion((double)i / rate) + noise();
+	for (int i = 0; i < watch_samples; i++) watch[i] = (float)motion((i + true_offset) / rate) * 1.3f + 0.05f + noise();
+
+	const float * k = &kinect[0];
+	const float * w = &watch[0];
+	struct sync_workspace ws;
+	memset(&ws, 0, sizeof(ws));
+	struct sync_result result;
+	syncSignals(&k, kinect_samples, &w, watch_samples, 1, &ws, &result);
+	bench_clock::time_point start = bench_clock::now();
+	for (int it = 0; it < iterations; it++) syncSignals(&k, kinect_samples, &w, watch_samples, 1, &ws, &result);
+	double fft = elapsedMs(start, iterations);
+
+	start = bench_clock::now();
+	int coarseFine = scalarTimeSync(k, kinect_samples, w, watch_samples);
+	double scalar = elapsedMs(start, 1);
+
+	start = bench_clock::now();
+	int direct = directSync(k, kinect_samples, w, watch_samples);
+	double full = elapsedMs(start, 1);
+
+	printf("%d kinect, %d watch samples, true offset %.2f\n", kinect_samples, watch_samples, true_offset);
+	printf("%-24s %10s %10s\n", "", "ms", "offset");
+	printf("%-24s %10.2f %10.2f (score %.3f)\n", "syncSignals (FFT)", fft, result.offset, result.score);
+	printf("%-24s %10.2f %10d\n", "scalarTimeSync.m", scalar, coarseFine);
+	printf("%-24s %10.2f %10d\n", "direct correlation", full, direct);
+	freeSyncWorkspace(&ws);
+	return result.lag == direct ? 0 : 1;
+}
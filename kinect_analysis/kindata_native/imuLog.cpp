@@ -0,0 +1,335 @@
+/* *******************************************************************************
+ *	                              imuLog.cpp
+ *
+ * Parsing works on the mapped bytes directly. Lines are found with memchr
+ * (vectorized in the C library), the rows are counted first so the columns
+ * are allocated once. Digits are converted eight at a time: eight ASCII
+ * digits loaded as one 64-bit word are checked and combined with three
+ * multiplies (SWAR). A number is mantissa * 10^exponent, evaluated in
+ * double with one correctly rounded division or multiplication, which gives
+ * the same float as strtof for the logs' up to 9 significant digits.
+ * Anything unusual (nan, inf, very long exponents) goes through strtod.
+ *********************************************************************************/
+
+#include "imuLog.h"
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static const int max_mantissa_digits = 19; // fits uint64_t
+static const int column_align = 64; // bytes, column starts
+
+static const double pow10_table[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+static const int max_exact_pow10 = 22;
+
+imu_kind imuKindFromName(const char * path) {
+	// the file name only, the sessions live under data/gyro
+	const char * name = path;
+	for (const char * c = path; *c; c++) {
+		if (*c == '/' || *c == '\\') name = c + 1;
+	}
+	if (strstr(name, "gyro")) return IMU_GYRO;
+	if (strstr(name, "accel")) return IMU_ACCEL;
+	if (strstr(name, "rot")) return IMU_ROTVECTOR;
+	return IMU_OTHER;
+}
+
+
+/* --------------------------------------------------
+	Number parsing
+-------------------------------------------------- */
+
+static inline bool isDigit(char c) {
+	return (unsigned char)(c - '0') < 10;
+}
+
+static inline bool isSeparator(char c) {
+	return c == ' ' || c == '\t' || c == ',' || c == '\r';
+}
+
+/* Eight ASCII digits at p as a number. false if any of them is not a digit (little endian) */
+static inline bool eightDigits(const char * p, uint64_t & value) {
+	uint64_t v;
+	memcpy(&v, p, 8);
+	if ((((v & 0xF0F0F0F0F0F0F0F0ULL) | (((v + 0x0606060606060606ULL) & 0xF0F0F0F0F0F0F0F0ULL) >> 4))) != 0x3333333333333333ULL) {
+		return false;
+	}
+	v -= 0x3030303030303030ULL;
+	v = (v * 10) + (v >> 8); // pairs
+	v = (((v & 0x000000FF000000FFULL) * (100 + (1000000ULL << 32)))
+		+ (((v >> 16) & 0x000000FF000000FFULL) * (1 + (10000ULL << 32)))) >> 32;
+	value = v;
+	return true;
+}
+
+/* Append the digits at p to mantissa. Digits past max_mantissa_digits are dropped and counted */
+static inline const char * readDigits(const char * p, const char * end, uint64_t & mantissa, int & digits, int & dropped) {
+	uint64_t chunk;
+	while (p + 8 <= end && digits + 8 <= max_mantissa_digits && eightDigits(p, chunk)) {
+		mantissa = mantissa * 100000000ULL + chunk;
+		digits += 8;
+		p += 8;
+	}
+	while (p < end && isDigit(*p)) {
+		if (digits < max_mantissa_digits) {
+			mantissa = mantissa * 10 + (uint64_t)(*p - '0');
+			digits++;
+		}
+		else {
+			dropped++;
+		}
+		p++;
+	}
+	return p;
+}
+
+/* Slow path for what the fast parser does not take */
+static const char * parseFloatSlow(const char * p, const char * end, float & value) {
+	char buf[64];
+	size_t n = 0;
+	while (p + n < end && n < sizeof(buf) - 1 && !isSeparator(p[n]) && p[n] != '\n') {
+		buf[n] = p[n];
+		n++;
+	}
+	buf[n] = '\0';
+	char * stop;
+	value = (float)strtod(buf, &stop);
+	if (stop == buf) return NULL;
+	return p + (stop - buf);
+}
+
+/* Parse a decimal float at p. Returns the end of the number, NULL if there is none */
+static inline const char * parseFloat(const char * p, const char * end, float & value) {
+	const char * start = p;
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p++;
+	}
+	uint64_t mantissa = 0;
+	int digits = 0, dropped = 0;
+	const char * q = readDigits(p, end, mantissa, digits, dropped);
+	int exponent = dropped;
+	bool any = q != p;
+	p = q;
+	if (p < end && *p == '.') {
+		p++;
+		int before = digits;
+		dropped = 0;
+		q = readDigits(p, end, mantissa, digits, dropped);
+		exponent -= digits - before;
+		any = any || q != p;
+		p = q;
+	}
+	if (!any) return parseFloatSlow(start, end, value);
+	if (p < end && (*p == 'e' || *p == 'E')) {
+		p++;
+		bool negExp = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negExp = *p == '-';
+			p++;
+		}
+		int e = 0;
+		const char * digitsStart = p;
+		while (p < end && isDigit(*p) && e < 10000) {
+			e = e * 10 + (*p - '0');
+			p++;
+		}
+		if (p == digitsStart) return parseFloatSlow(start, end, value);
+		exponent += negExp ? -e : e;
+	}
+	double d = (double)mantissa;
+	if (exponent < 0 && exponent >= -max_exact_pow10) d /= pow10_table[-exponent];
+	else if (exponent > 0 && exponent <= max_exact_pow10) d *= pow10_table[exponent];
+	else if (exponent != 0) return parseFloatSlow(start, end, value);
+	value = (float)(negative ? -d : d);
+	return p;
+}
+
+/* Parse a decimal integer at p. NULL if there is none */
+static inline const char * parseInt(const char * p, const char * end, long long & value) {
+	bool negative = false;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = *p == '-';
+		p++;
+	}
+	uint64_t mantissa = 0;
+	int digits = 0, dropped = 0;
+	const char * q = readDigits(p, end, mantissa, digits, dropped);
+	if (q == p || dropped > 0) return NULL;
+	value = negative ? -(long long)mantissa : (long long)mantissa;
+	return q;
+}
+
+static inline const char * skipSeparators(const char * p, const char * end) {
+	while (p < end && isSeparator(*p)) p++;
+	return p;
+}
+
+
+/* --------------------------------------------------
+	Table parsing
+-------------------------------------------------- */
+
+/* Column layout of the first line: number of fields and whether the first is a time stamp */
+static bool readLayout(const char * p, const char * end, int & fields, bool & timed) {
+	fields = 0;
+	timed = false;
+	p = skipSeparators(p, end);
+	while (p < end && *p != '\n') {
+		const char * token = p;
+		while (p < end && !isSeparator(*p) && *p != '\n') p++;
+		if (fields == 0) {
+			// an integer of more than 9 digits is a time stamp, not a measurement
+			bool integer = true;
+			for (const char * c = token; c < p; c++) {
+				if (!isDigit(*c)) integer = false;
+			}
+			timed = integer && p - token > 9;
+		}
+		fields++;
+		p = skipSeparators(p, end);
+	}
+	return fields > (timed ? 1 : 0) && fields - (timed ? 1 : 0) <= IMU_MAX_COLUMNS;
+}
+
+static size_t countLines(const char * p, const char * end) {
+	size_t n = 0;
+	while (p < end) {
+		const char * nl = (const char *)memchr(p, '\n', end - p);
+		n++;
+		if (!nl) break;
+		p = nl + 1;
+	}
+	return n;
+}
+
+static size_t alignColumn(size_t bytes) {
+	return (bytes + column_align - 1) / column_align * column_align;
+}
+
+/* Room for rows samples of the log's columns */
+static bool reserve(struct imu_log * log, size_t rows) {
+	if (log->storage && rows <= log->capacity) return true;
+	free(log->storage);
+	size_t bytes = alignColumn(rows * sizeof(long long)) + IMU_MAX_COLUMNS * alignColumn(rows * sizeof(float)) + column_align;
+	log->storage = malloc(bytes);
+	log->capacity = log->storage ? rows : 0;
+	return log->storage != NULL;
+}
+
+/* Point the column arrays into the storage */
+static void placeColumns(struct imu_log * log) {
+	uintptr_t at = ((uintptr_t)log->storage + column_align - 1) / column_align * column_align;
+	log->t = (long long *)at;
+	at += alignColumn(log->capacity * sizeof(long long));
+	for (int c = 0; c < IMU_MAX_COLUMNS; c++) {
+		log->v[c] = (float *)at;
+		at += alignColumn(log->capacity * sizeof(float));
+	}
+}
+
+bool parseImuLog(const char * text, size_t size, struct imu_log * log) {
+	const char * p = text;
+	const char * end = text + size;
+	int fields;
+	bool timed;
+	log->rows = 0;
+	if (!readLayout(p, end, fields, timed)) return false;
+	if (!reserve(log, countLines(p, end))) return false;
+	placeColumns(log);
+	log->timed = timed;
+	log->columns = fields - (timed ? 1 : 0);
+
+	int rows = 0;
+	const int columns = log->columns;
+	while (p < end) {
+		const char * lineEnd = (const char *)memchr(p, '\n', end - p);
+		if (!lineEnd) lineEnd = end;
+		p = skipSeparators(p, lineEnd);
+		bool ok = p < lineEnd;
+		if (ok && timed) {
+			long long t;
+			const char * q = parseInt(p, lineEnd, t);
+			ok = q != NULL;
+			if (ok) {
+				log->t[rows] = t;
+				p = skipSeparators(q, lineEnd);
+			}
+		}
+		for (int c = 0; ok && c < columns; c++) {
+			float v;
+			const char * q = parseFloat(p, lineEnd, v);
+			ok = q != NULL && (q == lineEnd || isSeparator(*q));
+			if (ok) {
+				log->v[c][rows] = v;
+				p = skipSeparators(q, lineEnd);
+			}
+		}
+		// a short, long or broken line (e.g. cut off at the end of a capture) is skipped
+		if (ok && p == lineEnd) rows++;
+		p = lineEnd + 1;
+	}
+	log->rows = rows;
+	if (!timed) log->t = NULL;
+	return true;
+}
+
+
+/* --------------------------------------------------
+	Files
+-------------------------------------------------- */
+
+bool loadImuLog(const char * path, struct imu_log * log) {
+	log->kind = imuKindFromName(path);
+	bool ok = false;
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER size;
+	if (GetFileSizeEx(file, &size) && size.QuadPart > 0) {
+		HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (mapping) {
+			const char * data = (const char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+			if (data) {
+				ok = parseImuLog(data, (size_t)size.QuadPart, log);
+				UnmapViewOfFile(data);
+			}
+			CloseHandle(mapping);
+		}
+	}
+	CloseHandle(file);
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		void * data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data != MAP_FAILED) {
+			madvise(data, st.st_size, MADV_SEQUENTIAL);
+			ok = parseImuLog((const char *)data, st.st_size, log);
+			munmap(data, st.st_size);
+		}
+	}
+	close(fd);
+#endif
+	return ok;
+}
+
+void freeImuLog(struct imu_log * log) {
+	free(log->storage);
+	memset(log, 0, sizeof(*log));
+}
@@ -0,0 +1,51 @@
+/* *******************************************************************************
+ *	                              imuLog.h
+ *
+ * Loader for the watch and phone sensor logs (data/gyro, data/amateur,
+ * data/armtrek, data/phone). A log is a text table, one sample per line,
+ * tab, space or comma separated:
+ *	*_gyro.txt, *_accel.txt : time_ns x y z
+ *	*_rotVector.txt         : time_ns x y z w
+ * Logs without a time column (phone accel/gyro) are read as well.
+ * The file is memory mapped and parsed in place into one array per column
+ * (the time as int64, values as float), so a session loads without
+ * per-line allocations or stream formatting.
+ *********************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+
+const int IMU_MAX_COLUMNS = 8; // value columns, excluding the time
+
+enum imu_kind {
+	IMU_GYRO, // rad/s
+	IMU_ACCEL, // m/s^2
+	IMU_ROTVECTOR, // rotation vector quaternion x y z w
+	IMU_OTHER
+};
+
+// Column-wise log: t[i] and v[c][i] for sample i
+struct imu_log {
+	imu_kind kind;
+	int rows;
+	int columns; // value columns
+	bool timed; // the first column of the file is a time stamp (t is NULL otherwise)
+	long long * t; // time stamps as written (ns for watch logs, ms for phone logs)
+	float * v[IMU_MAX_COLUMNS];
+	void * storage; // one allocation holding all columns
+	size_t capacity; // rows the storage holds
+};
+
+/* Kind of log by file name (_gyro, _accel, _rotVector, as written by the watch app) */
+imu_kind imuKindFromName(const char * path);
+
+/* Load a log. The column layout is taken from the first line: a leading integer of
+ more than 9 digits is a time stamp. Reuses log's storage if large enough; log must
+ start zeroed. Lines with a different column count are skipped. false if unreadable */
+bool loadImuLog(const char * path, struct imu_log * log);
+
+/* Parse a log already in memory (same rules as loadImuLog) */
+bool parseImuLog(const char * text, size_t size, struct imu_log * log);
+
+void freeImuLog(struct imu_log * log);
@@ -0,0 +1,103 @@
+/* *******************************************************************************
+ *	                              kindataLog.cpp
+ *
+ * Lines are read into a fixed buffer; the columns up to the first body's
+ * wrist fit in it many times over, so the rest of a longer line (a capture
+ * with all joints of several bodies) is skipped unparsed.
+ *********************************************************************************/
+
+#include "kindataLog.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const int line_size = 4096;
+
+void defaultKindataLayout(struct kindata_layout * layout) {
+	// one marker, then the first body's flag, left shoulder, elbow, wrist
+	layout->arm = true;
+	layout->body = 5;
+	layout->elbow = 9;
+	layout->wrist = 12;
+	layout->columns = 15;
+}
+
+bool parseKindataSchema(const char * line, struct kindata_layout * layout) {
+	int markers, bodies, ids, sync, n = -1;
+	if (sscanf(line, "%% kindata markers %d bodies %d ids %d sync %d joints%n", &markers, &bodies, &ids, &sync, &n) != 4
+		|| n < 0 || markers < 0 || bodies < 0) return false;
+	// index of the elbow and wrist among the recorded joints
+	int elbow = -1, wrist = -1;
+	const char * p = line + n;
+	for (int j = 0;; j++) {
+		char * end;
+		long joint = strtol(p, &end, 10);
+		if (end == p) break;
+		p = end;
+		if (joint == KINDATA_ELBOW_LEFT && elbow < 0) elbow = j;
+		if (joint == KINDATA_WRIST_LEFT && wrist < 0) wrist = j;
+	}
+	memset(layout, 0, sizeof(*layout));
+	layout->arm = bodies > 0 && elbow >= 0 && wrist >= 0;
+	if (!layout->arm) return true;
+	layout->body = 1 + 4 * markers;
+	int joints = layout->body + 1 + (ids ? 1 : 0);
+	layout->elbow = joints + 3 * elbow;
+	layout->wrist = joints + 3 * wrist;
+	layout->columns = (layout->elbow > layout->wrist ? layout->elbow : layout->wrist) + 3;
+	return true;
+}
+
+bool parseKindataArm(const char * line, const struct kindata_layout & layout, struct kindata_arm * arm) {
+	double t = 0, flag = 0, elbow[3] = { 0, 0, 0 }, wrist[3] = { 0, 0, 0 };
+	const char * p = line;
+	for (int m = 0; m < layout.columns; m++) {
+		char * end;
+		double v = strtod(p, &end);
+		if (end == p) return false;
+		p = end;
+		if (m == 0) t = v;
+		else if (m == layout.body) flag = v;
+		else if (m >= layout.elbow && m < layout.elbow + 3) elbow[m - layout.elbow] = v;
+		else if (m >= layout.wrist && m < layout.wrist + 3) wrist[m - layout.wrist] = v;
+	}
+	arm->t = t;
+	float d[3];
+	for (int c = 0; c < 3; c++) d[c] = (float)(wrist[c] - elbow[c]);
+	float len = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+	arm->body = flag > 0 && len > 0;
+	for (int c = 0; c < 3; c++) arm->d[c] = arm->body ? d[c] / len : 0;
+	return true;
+}
+
+int readKindataArm(const char * path, kindata_row row, void * user) {
+	FILE * in = fopen(path, "r");
+	if (!in) return -1;
+	struct kindata_layout layout;
+	defaultKindataLayout(&layout);
+	char line[line_size];
+	int frames = 0;
+	bool more = true;
+	while (more && fgets(line, sizeof(line), in)) {
+		size_t n = strlen(line);
+		if (n > 0 && line[n - 1] != '\n') {
+			int ch;
+			while ((ch = fgetc(in)) != EOF && ch != '\n') {}
+		}
+		if (line[0] == '%') {
+			if (parseKindataSchema(line, &layout) && !layout.arm) {
+				fclose(in);
+				return -1;
+			}
+			continue;
+		}
+		struct kindata_arm arm;
+		if (!parseKindataArm(line, layout, &arm)) continue;
+		frames++;
+		more = row(arm, user);
+	}
+	fclose(in);
+	return frames;
+}
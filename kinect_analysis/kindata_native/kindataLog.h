@@ -0,0 +1,51 @@
+/* *******************************************************************************
+ *	                              kindataLog.h
+ *
+ * Reader for the Kinect captures (kindata.txt, written by kinectTracker3's
+ * exportKindata). One frame per line, tab separated:
+ *	time (s, time of day), per marker: flag and x y z,
+ *	per body: flag, [tracking id,] x y z of each recorded joint, [device time]
+ * The first line describes what is recorded (MATLAB's load skips it):
+ *	% kindata markers <m> bodies <b> ids <0 / 1> sync <0 / 1> joints <JointType>...
+ * Captures without that line have the default layout read by parse_kindata.m:
+ * one marker, then the first body's flag, left shoulder, elbow and wrist.
+ * Only what the sync needs is read: the arm direction (wrist - elbow) of
+ * the first body. Captures that do not record its left elbow and wrist are
+ * refused; columns after the wrist are skipped.
+ *********************************************************************************/
+
+#pragma once
+
+const int KINDATA_ELBOW_LEFT = 5; // JointType_ElbowLeft
+const int KINDATA_WRIST_LEFT = 6; // JointType_WristLeft
+
+// Where the first body's arm is in a line
+struct kindata_layout {
+	bool arm; // the capture records the first body's left elbow and wrist
+	int columns; // numbers read per line, up to the last one used
+	int body; // column of the first body's flag
+	int elbow, wrist; // columns of their x
+};
+
+/* The layout of captures without a schema line */
+void defaultKindataLayout(struct kindata_layout * layout);
+
+/* Layout from a "% kindata" schema line. false if the line is not one */
+bool parseKindataSchema(const char * line, struct kindata_layout * layout);
+
+// The arm of one frame
+struct kindata_arm {
+	double t; // s
+	float d[3]; // unit wrist - elbow in camera space, 0 without a body
+	bool body; // first body tracked, with distinct elbow and wrist
+};
+
+/* Arm of one line. false if the line has fewer than layout.columns numbers */
+bool parseKindataArm(const char * line, const struct kindata_layout & layout, struct kindata_arm * arm);
+
+/* Called per frame in file order; false stops the reading */
+typedef bool (*kindata_row)(const struct kindata_arm & arm, void * user);
+
+/* Every frame of a kindata.txt to row, lines of any length. Returns the frames read,
+   -1 if the file cannot be opened or does not record the first body's left arm */
+int readKindataArm(const char * path, kindata_row row, void * user);
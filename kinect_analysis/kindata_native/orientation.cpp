@@ -0,0 +1,302 @@
+/* *******************************************************************************
+ *	                              orientation.cpp
+ *
+ * The filters share one step (orientStep) so a log run through orientLog()
+ * gives exactly what OrientationFilter gives live. A step is a recurrence
+ * on the previous quaternion, so a single log is integrated serially in
+ * registers; the throughput comes from running logs on separate cores, and
+ * the column-wise loops over the results (rotatePoint) are left to the
+ * compiler to vectorize.
+ *********************************************************************************/
+
+#include "orientation.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <thread>
+#include <vector>
+
+static const int column_align = 64; // bytes, column starts
+static const float min_accel = 1e-3f; // m/s^2, shorter accel vectors carry no direction
+
+void defaultOrientParams(struct orient_params * params) {
+	params->filter = ORIENT_GYRO;
+	params->gain = 0;
+	params->bias_first = 0;
+	params->bias_count = 20;
+	params->time_unit = 1e-9;
+	params->rate = 100;
+	params->max_dt = 0.1;
+}
+
+static size_t alignColumn(size_t bytes) {
+	return (bytes + column_align - 1) / column_align * column_align;
+}
+
+bool resizeQuatArray(struct quat_array * a, int count) {
+	if (!a->storage || count > a->capacity) {
+		free(a->storage);
+		a->storage = malloc(4 * alignColumn(count * sizeof(float)) + column_align);
+		if (!a->storage) {
+			memset(a, 0, sizeof(*a));
+			return false;
+		}
+		a->capacity = count;
+		size_t column = alignColumn(count * sizeof(float));
+		uintptr_t at = ((uintptr_t)a->storage + column_align - 1) / column_align * column_align;
+		a->w = (float *)at;
+		a->x = (float *)(at + column);
+		a->y = (float *)(at + 2 * column);
+		a->z = (float *)(at + 3 * column);
+	}
+	a->count = count;
+	return true;
+}
+
+void freeQuatArray(struct quat_array * a) {
+	free(a->storage);
+	memset(a, 0, sizeof(*a));
+}
+
+
+/* --------------------------------------------------
+	Filter step
+-------------------------------------------------- */
+
+static inline void normalize4(float q[4]) {
+	float n = sqrtf(q[0] * q[0] + q[1] * q[1] + q[2] * q[2] + q[3] * q[3]);
+	if (n > 0) {
+		float s = 1 / n;
+		q[0] *= s; q[1] *= s; q[2] *= s; q[3] *= s;
+	}
+	else {
+		q[0] = 1; q[1] = q[2] = q[3] = 0;
+	}
+}
+
+/* Advance q by the rate w (rad/s, bias removed) over dt. a is the unit accel or NULL */
+static inline void orientStep(float q[4], float gx, float gy, float gz, const float * a,
+	float dt, orient_filter filter, float gain) {
+	float qw = q[0], qx = q[1], qy = q[2], qz = q[3];
+	if (a && filter == ORIENT_COMPLEMENTARY) {
+		// gravity (up) in the sensor frame as q has it, the error to the accel turns the rate
+		float vx = 2 * (qx * qz - qw * qy);
+		float vy = 2 * (qw * qx + qy * qz);
+		float vz = qw * qw - qx * qx - qy * qy + qz * qz;
+		gx += gain * (a[1] * vz - a[2] * vy);
+		gy += gain * (a[2] * vx - a[0] * vz);
+		gz += gain * (a[0] * vy - a[1] * vx);
+	}
+	// qdot = 0.5 q * (0, w)
+	float dw = 0.5f * (-qx * gx - qy * gy - qz * gz);
+	float dx = 0.5f * (qw * gx + qy * gz - qz * gy);
+	float dy = 0.5f * (qw * gy - qx * gz + qz * gx);
+	float dz = 0.5f * (qw * gz + qx * gy - qy * gx);
+	if (a && filter == ORIENT_MADGWICK) {
+		// gradient of |gravity(q) - a|^2
+		float ax = a[0], ay = a[1], az = a[2];
+		float q0q0 = qw * qw, q1q1 = qx * qx, q2q2 = qy * qy, q3q3 = qz * qz;
+		float s0 = 4 * qw * q2q2 + 2 * qy * ax + 4 * qw * q1q1 - 2 * qx * ay;
+		float s1 = 4 * qx * q3q3 - 2 * qz * ax + 4 * q0q0 * qx - 2 * qw * ay - 4 * qx + 8 * qx * q1q1 + 8 * qx * q2q2 + 4 * qx * az;
+		float s2 = 4 * q0q0 * qy + 2 * qw * ax + 4 * qy * q3q3 - 2 * qz * ay - 4 * qy + 8 * qy * q1q1 + 8 * qy * q2q2 + 4 * qy * az;
+		float s3 = 4 * q1q1 * qz - 2 * qx * ax + 4 * q2q2 * qz - 2 * qy * ay;
+		float n = sqrtf(s0 * s0 + s1 * s1 + s2 * s2 + s3 * s3);
+		if (n > 0) {
+			float s = gain / n;
+			dw -= s * s0;
+			dx -= s * s1;
+			dy -= s * s2;
+			dz -= s * s3;
+		}
+	}
+	q[0] = qw + dw * dt;
+	q[1] = qx + dx * dt;
+	q[2] = qy + dy * dt;
+	q[3] = qz + dz * dt;
+	normalize4(q);
+}
+
+/* The orientation that is level with the unit accel a, no heading */
+static void levelQuaternion(const float a[3], float q[4]) {
+	// shortest rotation taking a to up
+	q[0] = 1 + a[2];
+	q[1] = a[1];
+	q[2] = -a[0];
+	q[3] = 0;
+	if (q[0] < 1e-6f) {
+		// upside down
+		q[0] = 0; q[1] = 1; q[2] = 0;
+	}
+	normalize4(q);
+}
+
+
+/* --------------------------------------------------
+	OrientationFilter
+-------------------------------------------------- */
+
+OrientationFilter::OrientationFilter(const struct orient_params & params) {
+	this->params = params;
+	b[0] = b[1] = b[2] = 0;
+	bias_samples = 0;
+	reset();
+}
+
+void OrientationFilter::reset() {
+	q[0] = 1;
+	q[1] = q[2] = q[3] = 0;
+	if (bias_samples < params.bias_count || params.bias_count == 0) {
+		bias_sum[0] = bias_sum[1] = bias_sum[2] = 0;
+		bias_samples = 0;
+	}
+	have_accel = false;
+	started = false;
+	t_last = 0;
+}
+
+void OrientationFilter::setBias(const float bias[3]) {
+	b[0] = bias[0];
+	b[1] = bias[1];
+	b[2] = bias[2];
+	bias_samples = params.bias_count;
+}
+
+void OrientationFilter::accel(const float v[3]) {
+	float n = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+	if (n < min_accel || params.filter == ORIENT_GYRO) return;
+	float s = 1 / n;
+	bool first = !have_accel;
+	a[0] = v[0] * s;
+	a[1] = v[1] * s;
+	a[2] = v[2] * s;
+	have_accel = true;
+	// the accel filters start level instead of at [1 0 0 0]
+	if (first && !started) levelQuaternion(a, q);
+}
+
+void OrientationFilter::gyro(long long t, const float w[3]) {
+	if (!started) {
+		started = true;
+		t_last = t;
+		gyroStep(0, w);
+		return;
+	}
+	double dt = (t - t_last) * params.time_unit;
+	if (dt < 0) dt = 0; // out of order stamp, no time passed
+	else t_last = t;
+	gyroStep(dt, w);
+}
+
+void OrientationFilter::gyroStep(double dt, const float w[3]) {
+	started = true;
+	if (bias_samples < params.bias_count) {
+		bias_sum[0] += w[0];
+		bias_sum[1] += w[1];
+		bias_sum[2] += w[2];
+		bias_samples++;
+		if (bias_samples == params.bias_count) {
+			b[0] = (float)(bias_sum[0] / bias_samples);
+			b[1] = (float)(bias_sum[1] / bias_samples);
+			b[2] = (float)(bias_sum[2] / bias_samples);
+		}
+		return;
+	}
+	if (dt > params.max_dt) dt = params.max_dt;
+	if (dt <= 0) return;
+	orientStep(q, w[0] - b[0], w[1] - b[1], w[2] - b[2], have_accel ? a : NULL,
+		(float)dt, params.filter, params.gain);
+}
+
+
+/* --------------------------------------------------
+	Logs
+-------------------------------------------------- */
+
+static float meanColumn(const float * v, int first, int count) {
+	float sum = 0;
+	for (int i = first; i < first + count; i++) sum += v[i];
+	return sum / count;
+}
+
+void gyroBias(const struct imu_log & gyro, const struct orient_params & params, float bias[3]) {
+	bias[0] = bias[1] = bias[2] = 0;
+	if (params.bias_count <= 0 || params.bias_first < 0 || gyro.columns < 3) return;
+	if (params.bias_first + params.bias_count > gyro.rows) return;
+	for (int c = 0; c < 3; c++) bias[c] = meanColumn(gyro.v[c], params.bias_first, params.bias_count);
+}
+
+bool orientLog(const struct imu_log & gyro, const struct imu_log * accel,
+	const struct orient_params & params, struct quat_array * out) {
+	if (gyro.columns != 3) return false;
+	if (!resizeQuatArray(out, gyro.rows)) return false;
+	OrientationFilter filter(params);
+	float bias[3];
+	gyroBias(gyro, params, bias);
+	filter.setBias(bias);
+	if (accel && accel->columns != 3) accel = NULL;
+	// accel merged by time stamp when both logs have them, row by row otherwise
+	bool byTime = accel && gyro.timed && accel->timed;
+	int j = 0;
+	const double dt = 1 / params.rate;
+	for (int i = 0; i < gyro.rows; i++) {
+		if (byTime) {
+			for (; j < accel->rows && accel->t[j] <= gyro.t[i]; j++) {
+				float v[3] = { accel->v[0][j], accel->v[1][j], accel->v[2][j] };
+				filter.accel(v);
+			}
+		}
+		else if (accel && i < accel->rows) {
+			float v[3] = { accel->v[0][i], accel->v[1][i], accel->v[2][i] };
+			filter.accel(v);
+		}
+		float w[3] = { gyro.v[0][i], gyro.v[1][i], gyro.v[2][i] };
+		if (gyro.timed) filter.gyro(gyro.t[i], w);
+		else filter.gyroStep(i > 0 ? dt : 0, w);
+		const float * q = filter.quaternion();
+		out->w[i] = q[0];
+		out->x[i] = q[1];
+		out->y[i] = q[2];
+		out->z[i] = q[3];
+	}
+	return true;
+}
+
+int orientSessions(struct orient_session * sessions, int n, const struct orient_params & params, int threads) {
+	if (threads <= 0) threads = (int)std::thread::hardware_concurrency();
+	if (threads <= 0) threads = 1;
+	if (threads > n) threads = n;
+	std::atomic<int> next(0);
+	std::atomic<int> done(0);
+	// sessions differ a lot in length, so each thread takes the next one when it is free
+	auto work = [&]() {
+		for (int i = next++; i < n; i = next++) {
+			struct orient_session & s = sessions[i];
+			s.ok = s.gyro && orientLog(*s.gyro, s.accel, params, &s.q);
+			if (s.ok) done++;
+		}
+	};
+	std::vector<std::thread> pool;
+	for (int t = 1; t < threads; t++) pool.push_back(std::thread(work));
+	work();
+	for (size_t t = 0; t < pool.size(); t++) pool[t].join();
+	return done;
+}
+
+void rotatePoint(const struct quat_array & q, const float p[3], float * __restrict x, float * __restrict y, float * __restrict z) {
+	const float * __restrict qw = q.w;
+	const float * __restrict qx = q.x;
+	const float * __restrict qy = q.y;
+	const float * __restrict qz = q.z;
+	const float px = p[0], py = p[1], pz = p[2];
+	for (int i = 0; i < q.count; i++) {
+		float w = qw[i], a = qx[i], b = qy[i], c = qz[i];
+		// rows of quatern2rotMat
+		x[i] = (1 - 2 * (b * b + c * c)) * px + 2 * (a * b - c * w) * py + 2 * (a * c + b * w) * pz;
+		y[i] = 2 * (a * b + c * w) * px + (1 - 2 * (a * a + c * c)) * py + 2 * (b * c - a * w) * pz;
+		z[i] = 2 * (a * c - b * w) * px + 2 * (b * c + a * w) * py + (1 - 2 * (a * a + b * b)) * pz;
+	}
+}
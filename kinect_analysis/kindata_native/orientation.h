@@ -0,0 +1,103 @@
+/* *******************************************************************************
+ *	                              orientation.h
+ *
+ * Watch orientation from gyro (and accel) samples, as in
+ * matlab/quaternion_gyroscope/main.m: q(i) = q(i-1) + 0.5 q(i-1) * (0, w) dt,
+ * normalized, starting at [1 0 0 0]. Quaternions are [w x y z] like
+ * quaternProd. The gyro bias is the mean over a window of still samples
+ * (BIAS_RANGE). Optionally the accel pulls the estimate towards gravity:
+ *	ORIENT_GYRO          : gyro integration only (main.m)
+ *	ORIENT_COMPLEMENTARY : gravity error fed back into the rate (Mahony, proportional)
+ *	ORIENT_MADGWICK      : gradient descent step towards gravity (Madgwick)
+ * OrientationFilter takes one sample at a time (live, sensor rate);
+ * orientLog() runs the same filter over a loaded log, orientSessions()
+ * runs many logs on all cores. Results are column-wise (quat_array).
+ *********************************************************************************/
+
+#pragma once
+
+#include "imuLog.h"
+
+enum orient_filter {
+	ORIENT_GYRO,
+	ORIENT_COMPLEMENTARY,
+	ORIENT_MADGWICK
+};
+
+struct orient_params {
+	orient_filter filter;
+	float gain; // complementary: rad/s per unit gravity error, Madgwick: beta (rad/s)
+	int bias_first; // first sample of the bias window (BIAS_RANGE = 1:20 is 0, 20)
+	int bias_count; // samples in the bias window, 0 for no bias removal
+	double time_unit; // seconds per log time stamp unit (1e-9 for the watch logs)
+	double rate; // samples per second of logs without time stamps
+	double max_dt; // longest step integrated (s), longer gaps (dropped samples) count as this
+};
+
+/* main.m: gyro only, BIAS_RANGE = 1:20, ns time stamps */
+void defaultOrientParams(struct orient_params * params);
+
+// Quaternions column-wise: sample i is w[i] x[i] y[i] z[i]
+struct quat_array {
+	int count;
+	int capacity;
+	float * w;
+	float * x;
+	float * y;
+	float * z;
+	void * storage;
+};
+
+/* Room for count quaternions, count is set. a must start zeroed */
+bool resizeQuatArray(struct quat_array * a, int count);
+void freeQuatArray(struct quat_array * a);
+
+class OrientationFilter {
+public:
+	OrientationFilter(const struct orient_params & params);
+	/* Back to [1 0 0 0], bias estimation starts over unless the bias was set */
+	void reset();
+	/* Use this bias instead of estimating it from the first bias_count samples */
+	void setBias(const float bias[3]);
+	/* Newest accel sample (m/s^2), used by the following gyro samples */
+	void accel(const float a[3]);
+	/* One gyro sample (rad/s) at time stamp t. While the bias is being estimated
+	   (the first bias_count samples) the orientation stays put */
+	void gyro(long long t, const float w[3]);
+	/* Same for a sample dt seconds after the previous one */
+	void gyroStep(double dt, const float w[3]);
+	bool calibrated() const { return bias_samples >= params.bias_count; }
+	const float * quaternion() const { return q; } // w x y z
+	const float * bias() const { return b; }
+private:
+	struct orient_params params;
+	float q[4];
+	float b[3];
+	double bias_sum[3];
+	int bias_samples;
+	float a[3]; // unit accel, valid if have_accel
+	bool have_accel;
+	bool started; // t_last is set
+	long long t_last;
+};
+
+/* Mean gyro over the bias window of a log (zero if the log is shorter) */
+void gyroBias(const struct imu_log & gyro, const struct orient_params & params, float bias[3]);
+
+/* Orientation at every gyro sample. accel (may be NULL) is merged in by time stamp.
+   false if gyro is not a 3 column log */
+bool orientLog(const struct imu_log & gyro, const struct imu_log * accel,
+	const struct orient_params & params, struct quat_array * out);
+
+struct orient_session {
+	const struct imu_log * gyro;
+	const struct imu_log * accel; // may be NULL
+	struct quat_array q; // result, must start zeroed
+	bool ok;
+};
+
+/* orientLog for each session on threads threads (0: one per core). Returns the sessions done */
+int orientSessions(struct orient_session * sessions, int n, const struct orient_params & params, int threads = 0);
+
+/* A body fixed point p at every orientation (quatern2rotMat(q) * p in main.m) */
+void rotatePoint(const struct quat_array & q, const float p[3], float * x, float * y, float * z);
@@ -0,0 +1,361 @@
+/* *******************************************************************************
+ *	                              resampler.cpp
+ *
+ * Inputs wait in a ring until the grid has passed them; the grid walks the
+ * intervals in order, so each grid sample costs one interval test and one
+ * interpolation. Only the interval under the grid and one input on either
+ * side of it (the cubic tangents) are ever looked at.
+ *********************************************************************************/
+
+#include "resampler.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const int ring_start = 16; // elements allocated first
+static const double grid_tolerance = 1e-6; // grid samples, time stamp rounding at the ends
+static const double slerp_linear = 0.9995; // cosine above which SLERP is plain interpolation
+
+struct resample_input {
+	double t; // s
+	bool valid;
+	float v[RESAMPLE_MAX_COLUMNS];
+};
+
+struct aligned_sample {
+	long long index;
+	bool valid;
+	float v[RESAMPLE_MAX_COLUMNS];
+};
+
+void defaultResampleParams(struct resample_params * params) {
+	params->method = RESAMPLE_LINEAR;
+	params->rate = 100;
+	params->time_unit = 1e-9;
+	params->max_gap = 0.1;
+}
+
+
+/* --------------------------------------------------
+	Ring
+-------------------------------------------------- */
+
+static void initRing(struct resample_ring * r, int element) {
+	memset(r, 0, sizeof(*r));
+	r->element = element;
+}
+
+static void freeRing(struct resample_ring * r) {
+	free(r->data);
+	initRing(r, r->element);
+}
+
+static inline void * ringAt(const struct resample_ring & r, int i) {
+	return r.data + (size_t)((r.head + i) & (r.capacity - 1)) * r.element;
+}
+
+/* Room for one more element at the end, NULL if out of memory */
+static void * ringPush(struct resample_ring * r) {
+	if (r->count == r->capacity) {
+		int capacity = r->capacity ? 2 * r->capacity : ring_start;
+		unsigned char * data = (unsigned char *)malloc((size_t)capacity * r->element);
+		if (!data) return NULL;
+		for (int i = 0; i < r->count; i++) memcpy(data + (size_t)i * r->element, ringAt(*r, i), r->element);
+		free(r->data);
+		r->data = data;
+		r->capacity = capacity;
+		r->head = 0;
+	}
+	return ringAt(*r, r->count++);
+}
+
+static void ringPop(struct resample_ring * r, int n) {
+	r->head = (r->head + n) & (r->capacity - 1);
+	r->count -= n;
+}
+
+
+/* --------------------------------------------------
+	StreamResampler
+-------------------------------------------------- */
+
+StreamResampler::StreamResampler(int columns, const struct resample_params & p) : params(p) {
+	n_columns = columns < 0 ? 0 : columns > RESAMPLE_MAX_COLUMNS ? RESAMPLE_MAX_COLUMNS : columns;
+	if (params.method == RESAMPLE_SLERP && n_columns != 4) params.method = RESAMPLE_LINEAR;
+	initRing(&inputs, sizeof(struct resample_input));
+	reset();
+}
+
+StreamResampler::~StreamResampler() {
+	freeRing(&inputs);
+}
+
+void StreamResampler::reset() {
+	inputs.head = 0;
+	inputs.count = 0;
+	left = 0;
+	next_index = 0;
+	started = false;
+	finished = false;
+}
+
+void StreamResampler::push(long long t, const float * v, bool valid) {
+	double ts = t * params.time_unit;
+	const struct resample_input * last = inputs.count ? (const struct resample_input *)ringAt(inputs, inputs.count - 1) : NULL;
+	if (finished || (last && ts <= last->t)) return;
+	struct resample_input * in = (struct resample_input *)ringPush(&inputs);
+	if (!in) return;
+	// ringPush may have moved the ring
+	last = inputs.count > 1 ? (const struct resample_input *)ringAt(inputs, inputs.count - 2) : NULL;
+	in->t = ts;
+	in->valid = valid;
+	for (int c = 0; c < n_columns; c++) in->v[c] = v[c];
+	if (params.method == RESAMPLE_SLERP && valid) {
+		double n = 0, d = 0;
+		for (int c = 0; c < 4; c++) {
+			n += (double)in->v[c] * in->v[c];
+			if (last && last->valid) d += (double)in->v[c] * last->v[c];
+		}
+		// unit length, and the same hemisphere as the previous input: q and -q are the same rotation
+		double s = n > 0 ? 1 / sqrt(n) : 0;
+		if (d < 0) s = -s;
+		for (int c = 0; c < 4; c++) in->v[c] = (float)(in->v[c] * s);
+		in->valid = n > 0;
+	}
+	if (!started) {
+		started = true;
+		next_index = (long long)ceil(ts * params.rate - grid_tolerance);
+		left = 0;
+	}
+}
+
+void StreamResampler::finish() {
+	finished = true;
+}
+
+bool StreamResampler::exhausted() const {
+	if (!finished) return false;
+	if (inputs.count - left < 2) return true;
+	const struct resample_input * last = (const struct resample_input *)ringAt(inputs, inputs.count - 1);
+	return next_index > last->t * params.rate + grid_tolerance;
+}
+
+bool StreamResampler::next(long long * index, float * v, bool * valid) {
+	for (;;) {
+		if (inputs.count - left < 2) return false;
+		const struct resample_input * b = (const struct resample_input *)ringAt(inputs, left + 1);
+		double t = next_index / params.rate;
+		if (t >= b->t) {
+			if (left + 2 >= inputs.count) {
+				// past the last input. Once the stream is finished, a grid sample on it still counts
+				if (!finished || next_index > b->t * params.rate + grid_tolerance) return false;
+				interpolate(left, t, v, valid);
+				*index = next_index++;
+				return true;
+			}
+			left++;
+			// keep one input before the interval for the cubic tangent
+			if (left > 1) {
+				ringPop(&inputs, left - 1);
+				left = 1;
+			}
+			continue;
+		}
+		if (params.method == RESAMPLE_CUBIC && left + 2 >= inputs.count && !finished) return false;
+		interpolate(left, t, v, valid);
+		*index = next_index++;
+		return true;
+	}
+}
+
+void StreamResampler::interpolate(int i, double t, float * v, bool * valid) const {
+	const struct resample_input * a = (const struct resample_input *)ringAt(inputs, i);
+	const struct resample_input * b = (const struct resample_input *)ringAt(inputs, i + 1);
+	double h = b->t - a->t;
+	*valid = a->valid && b->valid && h <= params.max_gap;
+	if (!*valid) {
+		for (int c = 0; c < n_columns; c++) v[c] = NAN;
+		return;
+	}
+	double u = (t - a->t) / h;
+	u = u < 0 ? 0 : u > 1 ? 1 : u;
+	if (params.method == RESAMPLE_LINEAR) {
+		for (int c = 0; c < n_columns; c++) v[c] = (float)(a->v[c] + u * (b->v[c] - a->v[c]));
+	}
+	else if (params.method == RESAMPLE_CUBIC) {
+		// neighbours for the tangents, if they are valid and close enough; one sided differences otherwise
+		const struct resample_input * p0 = i > 0 ? (const struct resample_input *)ringAt(inputs, i - 1) : NULL;
+		const struct resample_input * p3 = i + 2 < inputs.count ? (const struct resample_input *)ringAt(inputs, i + 2) : NULL;
+		if (p0 && (!p0->valid || a->t - p0->t > params.max_gap)) p0 = NULL;
+		if (p3 && (!p3->valid || p3->t - b->t > params.max_gap)) p3 = NULL;
+		double u2 = u * u, u3 = u2 * u;
+		double h00 = 2 * u3 - 3 * u2 + 1, h10 = u3 - 2 * u2 + u, h01 = 3 * u2 - 2 * u3, h11 = u3 - u2;
+		for (int c = 0; c < n_columns; c++) {
+			double slope = (b->v[c] - a->v[c]) / h;
+			double ma = p0 ? (b->v[c] - p0->v[c]) / (b->t - p0->t) : slope;
+			double mb = p3 ? (p3->v[c] - a->v[c]) / (p3->t - a->t) : slope;
+			v[c] = (float)(h00 * a->v[c] + h10 * h * ma + h01 * b->v[c] + h11 * h * mb);
+		}
+	}
+	else {
+		double d = 0;
+		for (int c = 0; c < 4; c++) d += (double)a->v[c] * b->v[c];
+		// an input after an invalid one may still be in the other hemisphere
+		double sb = d < 0 ? -1 : 1;
+		d *= sb;
+		double wa = 1 - u, wb = u;
+		if (d < slerp_linear) {
+			double angle = acos(d);
+			double s = sin(angle);
+			wa = sin((1 - u) * angle) / s;
+			wb = sin(u * angle) / s;
+		}
+		wb *= sb;
+		double q[4], n = 0;
+		for (int c = 0; c < 4; c++) {
+			q[c] = wa * a->v[c] + wb * b->v[c];
+			n += q[c] * q[c];
+		}
+		n = 1 / sqrt(n);
+		for (int c = 0; c < 4; c++) v[c] = (float)(q[c] * n);
+	}
+}
+
+
+/* --------------------------------------------------
+	Whole logs
+-------------------------------------------------- */
+
+bool resampleLog(const struct imu_log & log, const struct resample_params & params, struct resampled_table * out) {
+	memset(out, 0, sizeof(*out));
+	if (!log.timed || log.columns > RESAMPLE_MAX_COLUMNS) return false;
+	out->columns = log.columns;
+	if (log.rows == 0) return true;
+	double span = (log.t[log.rows - 1] - log.t[0]) * params.time_unit;
+	long long capacity = span > 0 ? (long long)(span * params.rate) + 2 : 2;
+	for (int c = 0; c < out->columns; c++) {
+		out->v[c] = (float *)malloc(capacity * sizeof(float));
+		if (!out->v[c]) {
+			freeResampledTable(out);
+			return false;
+		}
+	}
+	out->valid = (unsigned char *)malloc(capacity);
+	if (!out->valid) {
+		freeResampledTable(out);
+		return false;
+	}
+	StreamResampler resampler(log.columns, params);
+	float row[RESAMPLE_MAX_COLUMNS];
+	long long index;
+	bool valid;
+	for (int i = 0; i <= log.rows; i++) {
+		if (i < log.rows) {
+			for (int c = 0; c < log.columns; c++) row[c] = log.v[c][i];
+			resampler.push(log.t[i], row);
+		}
+		else {
+			resampler.finish();
+		}
+		while (out->rows < capacity && resampler.next(&index, row, &valid)) {
+			if (out->rows == 0) out->first_index = index;
+			for (int c = 0; c < out->columns; c++) out->v[c][out->rows] = row[c];
+			out->valid[out->rows++] = valid;
+		}
+	}
+	return true;
+}
+
+void freeResampledTable(struct resampled_table * table) {
+	for (int c = 0; c < RESAMPLE_MAX_COLUMNS; c++) free(table->v[c]);
+	free(table->valid);
+	memset(table, 0, sizeof(*table));
+}
+
+
+/* --------------------------------------------------
+	GridAligner
+-------------------------------------------------- */
+
+GridAligner::GridAligner(double maxLag) : n_streams(0), n_columns(0), max_lag(maxLag), next_index(0), started(false) {
+	for (int s = 0; s < ALIGN_MAX_STREAMS; s++) {
+		streams[s] = NULL;
+		offset[s] = 0;
+		newest[s] = 0;
+		initRing(&pending[s], sizeof(struct aligned_sample));
+	}
+}
+
+GridAligner::~GridAligner() {
+	for (int s = 0; s < ALIGN_MAX_STREAMS; s++) freeRing(&pending[s]);
+}
+
+int GridAligner::addStream(StreamResampler * stream) {
+	if (n_streams == ALIGN_MAX_STREAMS) return -1;
+	streams[n_streams] = stream;
+	offset[n_streams] = n_columns;
+	n_columns += stream->columns();
+	return n_streams++;
+}
+
+bool GridAligner::nextRow(long long * index, float * row, unsigned * valid) {
+	if (n_streams == 0) return false;
+	// take what the streams have
+	bool any = false;
+	long long top = 0;
+	for (int s = 0; s < n_streams; s++) {
+		for (;;) {
+			struct aligned_sample * p = (struct aligned_sample *)ringPush(&pending[s]);
+			if (!p) break;
+			if (!streams[s]->next(&p->index, p->v, &p->valid)) {
+				pending[s].count--;
+				break;
+			}
+			newest[s] = p->index;
+		}
+		if (pending[s].count > 0) {
+			top = any && top > newest[s] ? top : newest[s];
+			any = true;
+		}
+	}
+	if (!any) return false;
+	long long lag = (long long)(max_lag * streams[0]->rate());
+	if (!started) {
+		// the table starts at the first grid sample of any stream, once all have one (or are given up on)
+		long long first = top;
+		for (int s = 0; s < n_streams; s++) {
+			if (pending[s].count > 0) {
+				long long i = ((const struct aligned_sample *)ringAt(pending[s], 0))->index;
+				if (i < first) first = i;
+			}
+		}
+		for (int s = 0; s < n_streams; s++) {
+			if (pending[s].count == 0 && !streams[s]->exhausted() && top - first < lag) return false;
+		}
+		next_index = first;
+		started = true;
+	}
+	// every stream must have reached next_index, be done, or lag too far behind
+	for (int s = 0; s < n_streams; s++) {
+		while (pending[s].count > 0 && ((const struct aligned_sample *)ringAt(pending[s], 0))->index < next_index) {
+			ringPop(&pending[s], 1); // came after its rows were given up
+		}
+		if (pending[s].count == 0 && !streams[s]->exhausted() && top - next_index < lag) return false;
+	}
+	*valid = 0;
+	for (int s = 0; s < n_streams; s++) {
+		const struct aligned_sample * p = pending[s].count > 0 ? (const struct aligned_sample *)ringAt(pending[s], 0) : NULL;
+		int columns = streams[s]->columns();
+		if (p && p->index == next_index) {
+			memcpy(row + offset[s], p->v, columns * sizeof(float));
+			if (p->valid) *valid |= 1u << s;
+			ringPop(&pending[s], 1);
+		}
+		else {
+			for (int c = 0; c < columns; c++) row[offset[s] + c] = NAN;
+		}
+	}
+	*index = next_index++;
+	return true;
+}
@@ -0,0 +1,123 @@
+/* *******************************************************************************
+ *	                              resampler.h
+ *
+ * Streaming resampling of irregularly time stamped samples onto a common
+ * rate grid, replacing resample() and the per sample re-normalization of
+ * sync_kindata.m and refineRotData. The grid is absolute (grid sample k is
+ * at k / rate seconds of the stream's clock), so streams resampled at the
+ * same rate line up sample for sample. Per grid sample, in constant time:
+ *	RESAMPLE_LINEAR  straight line between the two neighbouring inputs
+ *	RESAMPLE_CUBIC   cubic Hermite with tangents from the neighbours of the
+ *	                 two inputs (Catmull-Rom for uneven spacing); one input
+ *	                 more of delay
+ *	RESAMPLE_SLERP   4 column unit quaternions (any column order: w x y z
+ *	                 or the x y z w of rotVector logs), spherical
+ *	                 interpolation, inputs flipped into one hemisphere so
+ *	                 the output is continuous and unit length. Streams
+ *	                 with other than 4 columns are resampled linearly
+ * Grid samples between inputs further apart than max_gap, or next to an
+ * input marked invalid (a lost marker), are output invalid (values NaN),
+ * so the grid stays regular and the validity is a mask next to it.
+ * GridAligner joins several resampled streams into rows of one table as
+ * soon as every stream got that far (or lags too far behind).
+ *********************************************************************************/
+
+#pragma once
+
+#include "imuLog.h"
+
+const int RESAMPLE_MAX_COLUMNS = IMU_MAX_COLUMNS;
+
+enum resample_method {
+	RESAMPLE_LINEAR,
+	RESAMPLE_CUBIC,
+	RESAMPLE_SLERP
+};
+
+struct resample_params {
+	resample_method method;
+	double rate; // grid samples per second (sync_kindata.m: common_rate = 100)
+	double time_unit; // seconds per input time stamp unit (1e-9 for the watch logs)
+	double max_gap; // s, inputs further apart than this are not interpolated between
+};
+
+/* Linear at 100 Hz, ns time stamps, gaps over 0.1 s invalid */
+void defaultResampleParams(struct resample_params * params);
+
+// Growable ring of fixed size elements
+struct resample_ring {
+	unsigned char * data;
+	int element; // bytes per element
+	int capacity; // elements, power of two
+	int head; // oldest
+	int count;
+};
+
+class StreamResampler {
+public:
+	StreamResampler(int columns, const struct resample_params & params);
+	~StreamResampler();
+	/* Forget all input, the next input starts the grid again */
+	void reset();
+	/* One input at time stamp t. valid false marks a missing sample: the grid samples next to it
+	   come out invalid. Inputs not after the previous one are ignored */
+	void push(long long t, const float * v, bool valid = true);
+	/* No more input: the grid up to the last input becomes available */
+	void finish();
+	/* The next grid sample: its index k (time k / rate s), columns values and validity.
+	   false until enough input arrived */
+	bool next(long long * index, float * v, bool * valid);
+	/* finish() was called and every grid sample was taken */
+	bool exhausted() const;
+	int columns() const { return n_columns; }
+	double rate() const { return params.rate; }
+private:
+	void interpolate(int left, double t, float * v, bool * valid) const;
+
+	struct resample_params params;
+	int n_columns;
+	struct resample_ring inputs; // not yet passed by the grid, plus one before the current interval
+	int left; // ring position of the interval's first input
+	long long next_index; // next grid sample
+	bool started;
+	bool finished;
+};
+
+/* A whole log on the grid: indexes, values (column-wise) and validity. Arrays are malloc'ed */
+struct resampled_table {
+	int rows;
+	int columns;
+	long long first_index; // grid index of row 0, rows are consecutive
+	float * v[RESAMPLE_MAX_COLUMNS];
+	unsigned char * valid;
+};
+
+/* Resample a timed log (rows with time stamps in params.time_unit). false if it is untimed */
+bool resampleLog(const struct imu_log & log, const struct resample_params & params, struct resampled_table * out);
+void freeResampledTable(struct resampled_table * table);
+
+const int ALIGN_MAX_STREAMS = 8;
+
+/* Rows of several resamplers of the same rate: row k holds every stream's grid sample k */
+class GridAligner {
+public:
+	/* max_lag: s a stream may fall behind the most advanced one before rows go on without it */
+	GridAligner(double max_lag);
+	~GridAligner();
+	/* Add a stream (not owned), its values follow those of the streams added before. -1 if full */
+	int addStream(StreamResampler * stream);
+	int columns() const { return n_columns; }
+	/* The next row: grid index, columns() values and a bit per stream, set where that stream
+	   has a valid sample. false until every stream got that far, lags max_lag behind or is exhausted */
+	bool nextRow(long long * index, float * row, unsigned * valid);
+private:
+	int n_streams;
+	int n_columns;
+	double max_lag;
+	StreamResampler * streams[ALIGN_MAX_STREAMS];
+	int offset[ALIGN_MAX_STREAMS]; // first column of each stream in a row
+	struct resample_ring pending[ALIGN_MAX_STREAMS]; // grid samples taken from each stream, not yet in a row
+	long long newest[ALIGN_MAX_STREAMS]; // last grid index taken from each stream
+	long long next_index;
+	bool started;
+};
@@ -0,0 +1,231 @@
+/* *******************************************************************************
+ *	                              rotationFit.cpp
+ *
+ * Horn's method: for S[a][b] = sum w u_a k_b the rotation maximizing
+ * sum w k . R u is the unit quaternion maximizing q' N q, N the symmetric
+ * 4x4 matrix below, i.e. the eigenvector of N's largest eigenvalue. The
+ * eigenvectors come from cyclic Jacobi rotations, which take a fixed
+ * handful of sweeps on a 4x4 and are exact to rounding.
+ * The sums over the pairs are taken in float over blocks of rows, in
+ * independent lanes the compiler turns into vector registers, and added up
+ * in double per block. Reweighting passes compute all residuals and
+ * weights in one branch free loop over the columns, then the sums again.
+ *********************************************************************************/
+
+#include "rotationFit.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const int max_sweeps = 50;
+
+void resetRotationSums(struct rotation_sums * sums) {
+	memset(sums, 0, sizeof(*sums));
+}
+
+void addRotationPair(struct rotation_sums * sums, const float u[3], const float k[3], float w) {
+	for (int a = 0; a < 3; a++) {
+		for (int b = 0; b < 3; b++) sums->S[a][b] += w * u[a] * k[b];
+	}
+	sums->w += w;
+	sums->uu += w * (u[0] * u[0] + u[1] * u[1] + u[2] * u[2]);
+	sums->kk += w * (k[0] * k[0] + k[1] * k[1] + k[2] * k[2]);
+}
+
+void decayRotationSums(struct rotation_sums * sums, double factor) {
+	for (int a = 0; a < 3; a++) {
+		for (int b = 0; b < 3; b++) sums->S[a][b] *= factor;
+	}
+	sums->w *= factor;
+	sums->uu *= factor;
+	sums->kk *= factor;
+}
+
+/* Eigenvectors of the symmetric 4x4 A (destroyed) as columns of V, eigenvalues on A's diagonal */
+static void jacobi4(double A[4][4], double V[4][4]) {
+	for (int i = 0; i < 4; i++) {
+		for (int j = 0; j < 4; j++) V[i][j] = i == j ? 1 : 0;
+	}
+	for (int sweep = 0; sweep < max_sweeps; sweep++) {
+		double off = 0, diag = 0;
+		for (int i = 0; i < 4; i++) {
+			diag += A[i][i] * A[i][i];
+			for (int j = i + 1; j < 4; j++) off += A[i][j] * A[i][j];
+		}
+		if (off <= 1e-30 * diag || off == 0) break;
+		for (int p = 0; p < 3; p++) {
+			for (int r = p + 1; r < 4; r++) {
+				if (A[p][r] == 0) continue;
+				// rotation zeroing A[p][r]
+				double theta = (A[r][r] - A[p][p]) / (2 * A[p][r]);
+				double t = (theta >= 0 ? 1 : -1) / (fabs(theta) + sqrt(theta * theta + 1));
+				double c = 1 / sqrt(t * t + 1), s = t * c;
+				for (int k = 0; k < 4; k++) {
+					double akp = A[k][p], akr = A[k][r];
+					A[k][p] = c * akp - s * akr;
+					A[k][r] = s * akp + c * akr;
+				}
+				for (int k = 0; k < 4; k++) {
+					double apk = A[p][k], ark = A[r][k];
+					A[p][k] = c * apk - s * ark;
+					A[r][k] = s * apk + c * ark;
+				}
+				for (int k = 0; k < 4; k++) {
+					double vkp = V[k][p], vkr = V[k][r];
+					V[k][p] = c * vkp - s * vkr;
+					V[k][r] = s * vkp + c * vkr;
+				}
+			}
+		}
+	}
+}
+
+bool solveRotation(const struct rotation_sums & sums, struct rotation_fit * fit) {
+	if (sums.w <= 0) return false;
+	const double (*S)[3] = sums.S;
+	double N[4][4] = {
+		{ S[0][0] + S[1][1] + S[2][2], S[1][2] - S[2][1], S[2][0] - S[0][2], S[0][1] - S[1][0] },
+		{ S[1][2] - S[2][1], S[0][0] - S[1][1] - S[2][2], S[0][1] + S[1][0], S[2][0] + S[0][2] },
+		{ S[2][0] - S[0][2], S[0][1] + S[1][0], -S[0][0] + S[1][1] - S[2][2], S[1][2] + S[2][1] },
+		{ S[0][1] - S[1][0], S[2][0] + S[0][2], S[1][2] + S[2][1], -S[0][0] - S[1][1] + S[2][2] }
+	};
+	double V[4][4];
+	jacobi4(N, V);
+	int best = 0;
+	for (int i = 1; i < 4; i++) {
+		if (N[i][i] > N[best][best]) best = i;
+	}
+	double w = V[0][best], x = V[1][best], y = V[2][best], z = V[3][best];
+	double n = sqrt(w * w + x * x + y * y + z * z);
+	if (w < 0) n = -n; // w >= 0, one sign for the same rotation
+	w /= n; x /= n; y /= n; z /= n;
+	fit->q[0] = (float)w;
+	fit->q[1] = (float)x;
+	fit->q[2] = (float)y;
+	fit->q[3] = (float)z;
+	double R[3][3] = {
+		{ 1 - 2 * (y * y + z * z), 2 * (x * y - w * z), 2 * (x * z + w * y) },
+		{ 2 * (x * y + w * z), 1 - 2 * (x * x + z * z), 2 * (y * z - w * x) },
+		{ 2 * (x * z - w * y), 2 * (y * z + w * x), 1 - 2 * (x * x + y * y) }
+	};
+	// sum w |k - R u|^2 = kk + uu - 2 sum_ab R[a][b] S[b][a]
+	double cross = 0;
+	for (int a = 0; a < 3; a++) {
+		for (int b = 0; b < 3; b++) {
+			fit->R[a][b] = (float)R[a][b];
+			cross += R[a][b] * S[b][a];
+		}
+	}
+	double e = sums.kk + sums.uu - 2 * cross;
+	fit->rms = e > 0 ? sqrt(e / sums.w) : 0;
+	return true;
+}
+
+void defaultFitParams(struct fit_params * params) {
+	params->iterations = 5;
+	params->scale = 0.1f;
+}
+
+/* Cauchy weights of the residuals of R, returns the pairs within 2 scale */
+static int reweight(const float * const u[3], const float * const k[3], int n, const float R[3][3],
+	float scale, float * __restrict weight) {
+	const float * __restrict ux = u[0];
+	const float * __restrict uy = u[1];
+	const float * __restrict uz = u[2];
+	const float * __restrict kx = k[0];
+	const float * __restrict ky = k[1];
+	const float * __restrict kz = k[2];
+	const float inv = 1 / (scale * scale);
+	int inliers = 0;
+	for (int i = 0; i < n; i++) {
+		float dx = kx[i] - (R[0][0] * ux[i] + R[0][1] * uy[i] + R[0][2] * uz[i]);
+		float dy = ky[i] - (R[1][0] * ux[i] + R[1][1] * uy[i] + R[1][2] * uz[i]);
+		float dz = kz[i] - (R[2][0] * ux[i] + R[2][1] * uy[i] + R[2][2] * uz[i]);
+		float r2 = (dx * dx + dy * dy + dz * dz) * inv;
+		weight[i] = 1 / (1 + r2);
+		inliers += r2 < 4 ? 1 : 0;
+	}
+	return inliers;
+}
+
+static const int lanes = 8; // independent float accumulators per sum, one AVX register
+static const int block_rows = 256; // rows summed in float before adding to the double totals
+
+static void weightedSums(const float * const u[3], const float * const k[3], int n, const float * weight,
+	struct rotation_sums * sums) {
+	const float * __restrict ux = u[0];
+	const float * __restrict uy = u[1];
+	const float * __restrict uz = u[2];
+	const float * __restrict kx = k[0];
+	const float * __restrict ky = k[1];
+	const float * __restrict kz = k[2];
+	// 12 sums: S row major, w, uu, kk
+	double total[12] = { 0 };
+	for (int start = 0; start < n; start += block_rows) {
+		int end = start + block_rows < n ? start + block_rows : n;
+		float acc[12][lanes] = { { 0 } };
+		int i = start;
+		for (; i + lanes <= end; i += lanes) {
+			for (int l = 0; l < lanes; l++) {
+				float w = weight ? weight[i + l] : 1;
+				float wx = w * ux[i + l], wy = w * uy[i + l], wz = w * uz[i + l];
+				float x = kx[i + l], y = ky[i + l], z = kz[i + l];
+				acc[0][l] += wx * x; acc[1][l] += wx * y; acc[2][l] += wx * z;
+				acc[3][l] += wy * x; acc[4][l] += wy * y; acc[5][l] += wy * z;
+				acc[6][l] += wz * x; acc[7][l] += wz * y; acc[8][l] += wz * z;
+				acc[9][l] += w;
+				acc[10][l] += wx * ux[i + l] + wy * uy[i + l] + wz * uz[i + l];
+				acc[11][l] += w * (x * x + y * y + z * z);
+			}
+		}
+		for (; i < end; i++) {
+			float w = weight ? weight[i] : 1;
+			float wx = w * ux[i], wy = w * uy[i], wz = w * uz[i];
+			float x = kx[i], y = ky[i], z = kz[i];
+			acc[0][0] += wx * x; acc[1][0] += wx * y; acc[2][0] += wx * z;
+			acc[3][0] += wy * x; acc[4][0] += wy * y; acc[5][0] += wy * z;
+			acc[6][0] += wz * x; acc[7][0] += wz * y; acc[8][0] += wz * z;
+			acc[9][0] += w;
+			acc[10][0] += wx * ux[i] + wy * uy[i] + wz * uz[i];
+			acc[11][0] += w * (x * x + y * y + z * z);
+		}
+		for (int s = 0; s < 12; s++) {
+			for (int l = 0; l < lanes; l++) total[s] += acc[s][l];
+		}
+	}
+	for (int a = 0; a < 3; a++) {
+		for (int b = 0; b < 3; b++) sums->S[a][b] = total[a * 3 + b];
+	}
+	sums->w = total[9];
+	sums->uu = total[10];
+	sums->kk = total[11];
+}
+
+bool fitRotation(const float * const u[3], const float * const k[3], int n,
+	const struct fit_params & params, struct fit_workspace * ws, struct rotation_fit * fit) {
+	if (n <= 0) return false;
+	struct rotation_sums sums;
+	weightedSums(u, k, n, NULL, &sums);
+	if (!solveRotation(sums, fit)) return false;
+	fit->inliers = n;
+	if (params.iterations <= 0) return true;
+	if (ws->capacity < n) {
+		free(ws->weight);
+		ws->weight = (float *)malloc(n * sizeof(float));
+		ws->capacity = ws->weight ? n : 0;
+		if (!ws->weight) return false;
+	}
+	for (int it = 0; it < params.iterations; it++) {
+		reweight(u, k, n, fit->R, params.scale, ws->weight);
+		weightedSums(u, k, n, ws->weight, &sums);
+		if (!solveRotation(sums, fit)) return false;
+	}
+	fit->inliers = reweight(u, k, n, fit->R, params.scale, ws->weight);
+	return true;
+}
+
+void freeFitWorkspace(struct fit_workspace * ws) {
+	free(ws->weight);
+	memset(ws, 0, sizeof(*ws));
+}
@@ -0,0 +1,57 @@
+/* *******************************************************************************
+ *	                              rotationFit.h
+ *
+ * Rotation K between the watch's world frame and Kinect camera space from
+ * paired directions (the arm direction seen by both), replacing
+ * fitRotationMatrix.m: minimizes sum w_i |k_i - K u_i|^2 in closed form
+ * (Horn: K is the quaternion of the largest eigenvalue of a 4x4 matrix
+ * built from the 3x3 correlation of the pairs). The fit only needs the
+ * correlation sums, so a rotation_sums can be kept up to date per frame
+ * and solved at any time. fitRotation() adds robust reweighting of the
+ * pairs (Cauchy weights), so outlier frames (a lost joint, a glitched
+ * watch sample) do not pull the fit. Everything is deterministic.
+ *********************************************************************************/
+
+#pragma once
+
+struct rotation_fit {
+	float R[3][3]; // k = R u
+	float q[4]; // R as quaternion w x y z
+	double rms; // weighted rms of |k - R u|
+	int inliers; // pairs within 2 * scale (all pairs for plain least squares)
+};
+
+// Weighted correlation of the pairs: S[a][b] = sum w u_a k_b
+struct rotation_sums {
+	double S[3][3];
+	double w; // sum of weights
+	double uu, kk; // sum w |u|^2, sum w |k|^2, for the rms
+};
+
+void resetRotationSums(struct rotation_sums * sums);
+/* Add a pair k ~ R u with weight w */
+void addRotationPair(struct rotation_sums * sums, const float u[3], const float k[3], float w = 1);
+/* Scale the sums by factor, e.g. per frame to follow a slowly changing setup */
+void decayRotationSums(struct rotation_sums * sums, double factor);
+/* The best rotation for the sums. false without pairs */
+bool solveRotation(const struct rotation_sums & sums, struct rotation_fit * fit);
+
+struct fit_params {
+	int iterations; // reweighting passes after the least squares fit, 0 for plain least squares
+	float scale; // residual at which a pair counts half (Cauchy), in the units of the vectors
+};
+
+/* 5 passes, scale 0.1 (unit directions) */
+void defaultFitParams(struct fit_params * params);
+
+// Per pair buffers of fitRotation, reused between calls. Must start zeroed
+struct fit_workspace {
+	float * weight;
+	int capacity;
+};
+
+/* Fit k[.][i] ~ R u[.][i] over n pairs given column-wise (x, y, z arrays) */
+bool fitRotation(const float * const u[3], const float * const k[3], int n,
+	const struct fit_params & params, struct fit_workspace * ws, struct rotation_fit * fit);
+
+void freeFitWorkspace(struct fit_workspace * ws);
@@ -0,0 +1,678 @@
+/* *******************************************************************************
+ *	                              sessionFile.cpp
+ *
+ * The writer keeps chunk_rows of every stream in memory and encodes a
+ * chunk when it is full, so the file is written as the session goes and
+ * the index, built in memory, follows at close. Reading maps the file and
+ * bounds checks everything against its size once at open and again while
+ * decoding, so a damaged file fails instead of reading out of the mapping.
+ * A chunk's payload starts with the end offsets of its sections (time,
+ * then each column), so one column can be decoded without the others.
+ * Every section is a sequence of integers: differences to the previous
+ * one (differences of differences for the time), zigzag coded so small
+ * negative ones are small, packed in blocks of 8 at the bit width of the
+ * block's largest. Blocks adapt to quiet and busy parts of a swing without
+ * a length per value and decode with shifts only.
+ * A SESSION_EXACT column is coded as the float bits read as integers
+ * (ordered like the floats, so nearby values have small differences), or
+ * as step counts when every value is a whole multiple of one step, as the
+ * raw readings of some of the watch's sensors are (multiples of the sensor
+ * resolution); the counts are checked to give back the exact floats.
+ *********************************************************************************/
+
+#include "sessionFile.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static const char session_magic[8] = "KSESS01";
+static const int column_align = 64; // bytes, column starts in a session_table
+static const int block_values = 8; // integers packed at one bit width
+static const int width_bits = 7; // bit width header of a block, 0 .. 64
+static const double max_steps = 1e15; // step counts beyond this are not exact in double
+static const unsigned char column_bits = 0; // SESSION_EXACT column section modes
+static const unsigned char column_steps = 1;
+
+/* --------------------------------------------------
+	Integer coding
+-------------------------------------------------- */
+
+static inline uint64_t zigzag(long long v) {
+	return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline long long unzigzag(uint64_t u) {
+	return (long long)(u >> 1) ^ -(long long)(u & 1);
+}
+
+static bool reserveBytes(struct session_bytes * b, size_t more) {
+	if (b->size + more <= b->capacity) return true;
+	size_t capacity = b->capacity ? b->capacity : 4096;
+	while (capacity < b->size + more) capacity *= 2;
+	unsigned char * data = (unsigned char *)realloc(b->data, capacity);
+	if (!data) return false;
+	b->data = data;
+	b->capacity = capacity;
+	return true;
+}
+
+/* Worst case size of n packed integers */
+static inline size_t packedBytes(int n) {
+	return (size_t)n * 8 + (n / block_values + 1) * 2 + 8;
+}
+
+// Bit stream, most significant bit first
+struct bit_writer {
+	struct session_bytes * out;
+	uint64_t acc;
+	int bits; // pending in acc, < 8 between calls
+};
+
+/* n <= 32 bits of value. Room must be reserved */
+static inline void putBits(struct bit_writer & w, uint32_t value, int n) {
+	w.acc = (w.acc << n) | value;
+	w.bits += n;
+	while (w.bits >= 8) {
+		w.bits -= 8;
+		w.out->data[w.out->size++] = (unsigned char)(w.acc >> w.bits);
+	}
+}
+
+static inline void putBits64(struct bit_writer & w, uint64_t value, int n) {
+	if (n > 32) {
+		putBits(w, (uint32_t)(value >> 32), n - 32);
+		n = 32;
+	}
+	putBits(w, (uint32_t)value, n);
+}
+
+struct bit_reader {
+	const unsigned char * p;
+	const unsigned char * end;
+	uint64_t acc;
+	int bits;
+	bool overrun;
+};
+
+static inline uint32_t getBits(struct bit_reader & r, int n) {
+	while (r.bits < n) {
+		if (r.p < r.end) r.acc = (r.acc << 8) | *r.p++;
+		else {
+			r.acc <<= 8;
+			r.overrun = true;
+		}
+		r.bits += 8;
+	}
+	r.bits -= n;
+	return (uint32_t)(r.acc >> r.bits) & (uint32_t)((1ULL << n) - 1);
+}
+
+static inline uint64_t getBits64(struct bit_reader & r, int n) {
+	uint64_t high = 0;
+	if (n > 32) {
+		high = (uint64_t)getBits(r, n - 32) << 32;
+		n = 32;
+	}
+	return high | getBits(r, n);
+}
+
+// Integers as differences (order 1) or differences of differences (order 2), zigzag,
+// in blocks of block_values at the bit width of the largest one
+struct int_writer {
+	struct bit_writer bits;
+	int order;
+	long long prev, delta;
+	uint64_t block[block_values];
+	int count;
+};
+
+static void startInts(struct int_writer & w, struct session_bytes * out, int order) {
+	memset(&w, 0, sizeof(w));
+	w.bits.out = out;
+	w.order = order;
+}
+
+static void putBlock(struct int_writer & w) {
+	uint64_t all = 0;
+	for (int i = 0; i < w.count; i++) all |= w.block[i];
+	int width = 0;
+	for (; width < 64 && (all >> width); width++) {}
+	putBits(w.bits, width, width_bits);
+	for (int i = 0; i < w.count; i++) putBits64(w.bits, w.block[i], width);
+	w.count = 0;
+}
+
+static inline void putInt(struct int_writer & w, long long v) {
+	long long delta = v - w.prev;
+	w.block[w.count++] = zigzag(w.order == 2 ? delta - w.delta : delta);
+	w.prev = v;
+	w.delta = delta;
+	if (w.count == block_values) putBlock(w);
+}
+
+static void endInts(struct int_writer & w) {
+	if (w.count) putBlock(w);
+	if (w.bits.bits > 0) w.bits.out->data[w.bits.out->size++] = (unsigned char)(w.bits.acc << (8 - w.bits.bits));
+}
+
+struct int_reader {
+	struct bit_reader bits;
+	int order;
+	long long prev, delta;
+	int width; // of the current block
+	int left; // values left in the current block
+};
+
+static void startInts(struct int_reader & r, const unsigned char * p, const unsigned char * end, int order) {
+	memset(&r, 0, sizeof(r));
+	r.bits.p = p;
+	r.bits.end = end;
+	r.order = order;
+}
+
+static inline long long getInt(struct int_reader & r) {
+	if (r.left == 0) {
+		r.width = (int)getBits(r.bits, width_bits);
+		if (r.width > 64) {
+			r.width = 64;
+			r.bits.overrun = true;
+		}
+		r.left = block_values;
+	}
+	r.left--;
+	long long d = unzigzag(getBits64(r.bits, r.width));
+	r.delta = r.order == 2 ? r.delta + d : d;
+	r.prev += r.delta;
+	return r.prev;
+}
+
+
+/* --------------------------------------------------
+	Chunk encoding
+-------------------------------------------------- */
+
+/* Float bits as an integer ordered like the floats (-0 just below +0) */
+static inline long long orderedBits(float v) {
+	uint32_t b;
+	memcpy(&b, &v, 4);
+	return b & 0x80000000u ? -(long long)(b & 0x7FFFFFFFu) - 1 : (long long)b;
+}
+
+static inline float fromOrdered(long long o) {
+	uint32_t b = o >= 0 ? (uint32_t)o : ((uint32_t)(-(o + 1)) | 0x80000000u);
+	float v;
+	memcpy(&v, &b, 4);
+	return v;
+}
+
+/* Whether all values are exact whole multiples of step */
+static bool wholeSteps(const float * v, int n, float step) {
+	if (!(step > 0) || !(step < 1e30f)) return false;
+	for (int i = 0; i < n; i++) {
+		if (v[i] == 0 && signbit(v[i])) return false; // k * step would give +0
+		double k = floor(v[i] / (double)step + 0.5);
+		if (!(fabs(k) < max_steps) || (float)(k * step) != v[i]) return false;
+	}
+	return true;
+}
+
+/* The sensor resolution if the values are whole multiples of one, else 0. Tried: the smallest
+   change between neighbours and the smallest magnitude */
+static float sensorStep(const float * v, int n) {
+	float change = 0, magnitude = 0;
+	for (int i = 0; i < n; i++) {
+		float a = fabsf(v[i]);
+		if (a > 0 && (magnitude == 0 || a < magnitude)) magnitude = a;
+		float d = i > 0 ? fabsf(v[i] - v[i - 1]) : 0;
+		if (d > 0 && (change == 0 || d < change)) change = d;
+	}
+	if (wholeSteps(v, n, change)) return change;
+	if (wholeSteps(v, n, magnitude)) return magnitude;
+	return 0;
+}
+
+static inline long long quantize(float v, double quantum) {
+	double q = v / quantum;
+	if (!(fabs(q) < 9e18)) return 0; // nan, inf
+	return (long long)floor(q + 0.5);
+}
+
+static bool encodeTimes(struct session_bytes * out, const long long * t, int n) {
+	if (!reserveBytes(out, packedBytes(n))) return false;
+	struct int_writer w;
+	startInts(w, out, 2);
+	for (int i = 0; i < n; i++) putInt(w, t[i]);
+	endInts(w);
+	return true;
+}
+
+static bool encodeColumn(struct session_bytes * out, const float * v, int n, const struct session_stream & st) {
+	if (!reserveBytes(out, packedBytes(n) + 5)) return false;
+	struct int_writer w;
+	startInts(w, out, 1);
+	if (st.codec == SESSION_QUANTIZED) {
+		for (int i = 0; i < n; i++) putInt(w, quantize(v[i], st.quantum));
+	}
+	else {
+		float step = sensorStep(v, n);
+		out->data[out->size++] = step > 0 ? column_steps : column_bits;
+		if (step > 0) {
+			memcpy(out->data + out->size, &step, 4);
+			out->size += 4;
+			for (int i = 0; i < n; i++) putInt(w, (long long)floor(v[i] / (double)step + 0.5));
+		}
+		else {
+			for (int i = 0; i < n; i++) putInt(w, orderedBits(v[i]));
+		}
+	}
+	endInts(w);
+	return true;
+}
+
+static bool decodeTimes(const unsigned char * p, const unsigned char * end, long long * t, int n) {
+	struct int_reader r;
+	startInts(r, p, end, 2);
+	for (int i = 0; i < n; i++) t[i] = getInt(r);
+	return !r.bits.overrun;
+}
+
+static bool decodeColumn(const unsigned char * p, const unsigned char * end, float * v, int n,
+	const struct session_stream & st) {
+	struct int_reader r;
+	if (st.codec == SESSION_QUANTIZED) {
+		startInts(r, p, end, 1);
+		for (int i = 0; i < n; i++) v[i] = (float)(getInt(r) * st.quantum);
+		return !r.bits.overrun;
+	}
+	if (p >= end) return false;
+	unsigned char mode = *p++;
+	if (mode == column_bits) {
+		startInts(r, p, end, 1);
+		for (int i = 0; i < n; i++) v[i] = fromOrdered(getInt(r));
+		return !r.bits.overrun;
+	}
+	if (mode != column_steps || end - p < 4) return false;
+	float step;
+	memcpy(&step, p, 4);
+	startInts(r, p + 4, end, 1);
+	for (int i = 0; i < n; i++) v[i] = (float)(getInt(r) * (double)step);
+	return !r.bits.overrun;
+}
+
+
+/* --------------------------------------------------
+	Writer
+-------------------------------------------------- */
+
+SessionWriter::SessionWriter() {
+	fp = NULL;
+	ok = false;
+	offset = 0;
+	memset(&header, 0, sizeof(header));
+	memset(t, 0, sizeof(t));
+	memset(v, 0, sizeof(v));
+	memset(pending, 0, sizeof(pending));
+	index = NULL;
+	index_capacity = 0;
+	memset(&payload, 0, sizeof(payload));
+}
+
+SessionWriter::~SessionWriter() {
+	if (fp) close();
+	free(index);
+	free(payload.data);
+}
+
+bool SessionWriter::write(const void * data, size_t bytes) {
+	if (ok && fwrite(data, 1, bytes, fp) != bytes) ok = false;
+	offset += bytes;
+	return ok;
+}
+
+bool SessionWriter::open(const char * path, int chunkRows) {
+	if (fp) close();
+	if (chunkRows < 1) return false;
+	fp = fopen(path, "wb");
+	if (!fp) return false;
+	ok = true;
+	offset = 0;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, session_magic, sizeof(session_magic));
+	header.chunk_rows = chunkRows;
+	// placeholder, the header is written again at close
+	return write(&header, sizeof(header));
+}
+
+int SessionWriter::addStream(const char * name, int columns, double timeUnit, session_codec codec, double quantum) {
+	if (!fp || header.streams >= SESSION_MAX_STREAMS || columns < 0 || columns > SESSION_MAX_COLUMNS) return -1;
+	if (strlen(name) >= SESSION_NAME_SIZE || (codec == SESSION_QUANTIZED && !(quantum > 0))) return -1;
+	for (int s = 0; s < header.streams; s++) {
+		if (strcmp(header.stream[s].name, name) == 0) return -1;
+	}
+	int s = header.streams;
+	t[s] = (long long *)malloc(header.chunk_rows * sizeof(long long));
+	v[s] = (float *)malloc(((size_t)columns * header.chunk_rows + 1) * sizeof(float));
+	if (!t[s] || !v[s]) {
+		free(t[s]);
+		free(v[s]);
+		t[s] = NULL;
+		v[s] = NULL;
+		return -1;
+	}
+	struct session_stream & st = header.stream[s];
+	memset(&st, 0, sizeof(st));
+	strcpy(st.name, name);
+	st.columns = columns;
+	st.codec = codec;
+	st.time_unit = timeUnit;
+	st.quantum = codec == SESSION_QUANTIZED ? quantum : 0;
+	pending[s] = 0;
+	header.streams++;
+	return s;
+}
+
+bool SessionWriter::append(int stream, long long time, const float * values) {
+	if (!fp || stream < 0 || stream >= header.streams) return false;
+	const int rows = header.chunk_rows;
+	int i = pending[stream]++;
+	t[stream][i] = time;
+	for (int c = 0; c < header.stream[stream].columns; c++) v[stream][(size_t)c * rows + i] = values[c];
+	return pending[stream] < rows ? ok : flush(stream);
+}
+
+bool SessionWriter::appendColumns(int stream, const long long * time, const float * const * values, int n) {
+	if (!fp || stream < 0 || stream >= header.streams) return false;
+	const int rows = header.chunk_rows;
+	for (int done = 0; done < n;) {
+		int i = pending[stream];
+		int run = n - done < rows - i ? n - done : rows - i;
+		memcpy(t[stream] + i, time + done, run * sizeof(long long));
+		for (int c = 0; c < header.stream[stream].columns; c++) {
+			memcpy(v[stream] + (size_t)c * rows + i, values[c] + done, run * sizeof(float));
+		}
+		pending[stream] += run;
+		done += run;
+		if (pending[stream] == rows && !flush(stream)) return false;
+	}
+	return ok;
+}
+
+bool SessionWriter::flush(int stream) {
+	int n = pending[stream];
+	if (n == 0) return ok;
+	pending[stream] = 0;
+	struct session_stream & st = header.stream[stream];
+	const int rows = header.chunk_rows;
+	const long long * times = t[stream];
+
+	// section ends first, then the sections
+	payload.size = 0;
+	size_t table = (st.columns + 1) * sizeof(uint32_t);
+	if (!reserveBytes(&payload, table)) return ok = false;
+	payload.size = table;
+	uint32_t ends[SESSION_MAX_COLUMNS + 1];
+	if (!encodeTimes(&payload, times, n)) return ok = false;
+	ends[0] = (uint32_t)payload.size;
+	for (int c = 0; c < st.columns; c++) {
+		const float * column = v[stream] + (size_t)c * rows;
+		if (!encodeColumn(&payload, column, n, st)) return ok = false;
+		ends[c + 1] = (uint32_t)payload.size;
+	}
+	memcpy(payload.data, ends, table);
+	if (!reserveBytes(&payload, 8)) return ok = false;
+	while (payload.size % 8) payload.data[payload.size++] = 0;
+
+	struct session_chunk chunk;
+	memset(&chunk, 0, sizeof(chunk));
+	chunk.stream = stream;
+	chunk.rows = n;
+	chunk.first_row = st.rows;
+	chunk.t_first = chunk.t_last = times[0];
+	for (int i = 1; i < n; i++) {
+		if (times[i] < chunk.t_first) chunk.t_first = times[i];
+		if (times[i] > chunk.t_last) chunk.t_last = times[i];
+	}
+	chunk.offset = offset + sizeof(chunk);
+	chunk.bytes = (int)payload.size;
+	if (header.chunks == index_capacity) {
+		int capacity = index_capacity ? index_capacity * 2 : 64;
+		struct session_chunk * grown = (struct session_chunk *)realloc(index, capacity * sizeof(*index));
+		if (!grown) return ok = false;
+		index = grown;
+		index_capacity = capacity;
+	}
+	index[header.chunks++] = chunk;
+	st.rows += n;
+	write(&chunk, sizeof(chunk));
+	return write(payload.data, payload.size);
+}
+
+bool SessionWriter::close() {
+	if (!fp) return false;
+	for (int s = 0; s < header.streams; s++) flush(s);
+
+	// index by stream, chunks of a stream stay in row order
+	struct session_chunk * sorted = (struct session_chunk *)malloc((header.chunks + 1) * sizeof(*index));
+	if (!sorted) ok = false;
+	else {
+		int at = 0;
+		for (int s = 0; s < header.streams; s++) {
+			header.stream[s].first_chunk = at;
+			for (int i = 0; i < header.chunks; i++) {
+				if (index[i].stream == s) sorted[at++] = index[i];
+			}
+			header.stream[s].chunks = at - header.stream[s].first_chunk;
+		}
+		header.index_offset = offset;
+		write(sorted, header.chunks * sizeof(*sorted));
+		free(sorted);
+	}
+	if (ok && (fseek(fp, 0, SEEK_SET) != 0 || fwrite(&header, sizeof(header), 1, fp) != 1)) ok = false;
+	if (fclose(fp) != 0) ok = false;
+	fp = NULL;
+	for (int s = 0; s < header.streams; s++) {
+		free(t[s]);
+		free(v[s]);
+		t[s] = NULL;
+		v[s] = NULL;
+	}
+	return ok;
+}
+
+
+/* --------------------------------------------------
+	Reader
+-------------------------------------------------- */
+
+static bool validSession(const struct session_file * file) {
+	if (file->size < sizeof(struct session_file_header)) return false;
+	const struct session_file_header & h = *(const struct session_file_header *)file->data;
+	if (memcmp(h.magic, session_magic, sizeof(session_magic)) != 0) return false;
+	if (h.streams < 0 || h.streams > SESSION_MAX_STREAMS || h.chunks < 0 || h.chunk_rows < 1) return false;
+	if (h.index_offset < (long long)sizeof(h) || h.index_offset % 8) return false;
+	if ((unsigned long long)h.index_offset + (unsigned long long)h.chunks * sizeof(struct session_chunk) > file->size) return false;
+	for (int s = 0; s < h.streams; s++) {
+		const struct session_stream & st = h.stream[s];
+		if (st.columns < 0 || st.columns > SESSION_MAX_COLUMNS || st.first_chunk < 0 || st.chunks < 0) return false;
+		if ((long long)st.first_chunk + st.chunks > h.chunks || memchr(st.name, 0, SESSION_NAME_SIZE) == NULL) return false;
+		if (st.codec == SESSION_QUANTIZED && !(st.quantum > 0)) return false;
+	}
+	const struct session_chunk * index = (const struct session_chunk *)(file->data + h.index_offset);
+	for (int i = 0; i < h.chunks; i++) {
+		const struct session_chunk & c = index[i];
+		if (c.stream < 0 || c.stream >= h.streams || c.rows < 1 || c.rows > h.chunk_rows) return false;
+		if (c.offset < 0 || c.bytes < 0 || c.offset + c.bytes > h.index_offset) return false;
+	}
+	// a stream's entries are its own and hold its rows in order (chunks are decoded with their stream's columns)
+	for (int s = 0; s < h.streams; s++) {
+		const struct session_stream & st = h.stream[s];
+		long long rows = 0;
+		for (int i = st.first_chunk; i < st.first_chunk + st.chunks; i++) {
+			if (index[i].stream != s || index[i].first_row != rows) return false;
+			rows += index[i].rows;
+		}
+		if (rows != st.rows) return false;
+	}
+	return true;
+}
+
+bool openSession(const char * path, struct session_file * file) {
+	closeSession(file);
+#ifdef _WIN32
+	HANDLE handle = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_RANDOM_ACCESS, NULL);
+	if (handle == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER size;
+	HANDLE mapping = NULL;
+	if (GetFileSizeEx(handle, &size) && size.QuadPart > 0) mapping = CreateFileMappingA(handle, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping) file->data = (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	file->file_handle = handle;
+	file->map_handle = mapping;
+	if (!file->data) {
+		closeSession(file);
+		return false;
+	}
+	file->size = (size_t)size.QuadPart;
+#else
+	int fd = open(path, O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		void * data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+		if (data != MAP_FAILED) {
+			file->data = (const unsigned char *)data;
+			file->size = st.st_size;
+		}
+	}
+	close(fd);
+	if (!file->data) return false;
+#endif
+	if (!validSession(file)) {
+		closeSession(file);
+		return false;
+	}
+	file->header = (const struct session_file_header *)file->data;
+	file->index = (const struct session_chunk *)(file->data + file->header->index_offset);
+	return true;
+}
+
+void closeSession(struct session_file * file) {
+#ifdef _WIN32
+	if (file->data) UnmapViewOfFile(file->data);
+	if (file->map_handle) CloseHandle(file->map_handle);
+	if (file->file_handle) CloseHandle(file->file_handle);
+#else
+	if (file->data) munmap((void *)file->data, file->size);
+#endif
+	memset(file, 0, sizeof(*file));
+}
+
+int findSessionStream(const struct session_file & file, const char * name) {
+	if (!file.header) return -1;
+	for (int s = 0; s < file.header->streams; s++) {
+		if (strcmp(file.header->stream[s].name, name) == 0) return s;
+	}
+	return -1;
+}
+
+static size_t alignColumn(size_t bytes) {
+	return (bytes + column_align - 1) / column_align * column_align;
+}
+
+/* Room for rows rows of columns columns, column pointers set */
+static bool reserveTable(struct session_table * table, long long rows, int columns) {
+	size_t bytes = alignColumn(rows * sizeof(long long)) + columns * alignColumn(rows * sizeof(float)) + column_align;
+	if (!table->storage || table->storage_bytes < bytes) {
+		free(table->storage);
+		table->storage = malloc(bytes);
+		table->storage_bytes = table->storage ? bytes : 0;
+		if (!table->storage) return false;
+	}
+	uintptr_t at = ((uintptr_t)table->storage + column_align - 1) / column_align * column_align;
+	table->t = (long long *)at;
+	at += alignColumn(rows * sizeof(long long));
+	for (int c = 0; c < SESSION_MAX_COLUMNS; c++) {
+		table->v[c] = c < columns ? (float *)at : NULL;
+		if (c < columns) at += alignColumn(rows * sizeof(float));
+	}
+	table->columns = columns;
+	table->rows = 0;
+	return true;
+}
+
+/* All rows of a chunk into the table at row at */
+static bool decodeChunk(const struct session_file & file, const struct session_chunk & chunk,
+	struct session_table * table, int at) {
+	const struct session_stream & st = file.header->stream[chunk.stream];
+	const unsigned char * payload = file.data + chunk.offset;
+	size_t table_bytes = (st.columns + 1) * sizeof(uint32_t);
+	if ((size_t)chunk.bytes < table_bytes) return false;
+	uint32_t ends[SESSION_MAX_COLUMNS + 1];
+	memcpy(ends, payload, table_bytes);
+	uint32_t begin = (uint32_t)table_bytes;
+	for (int c = 0; c <= st.columns; c++) {
+		if (ends[c] < begin || ends[c] > (uint32_t)chunk.bytes) return false;
+		begin = ends[c];
+	}
+	if (!decodeTimes(payload + table_bytes, payload + ends[0], table->t + at, chunk.rows)) return false;
+	for (int c = 0; c < st.columns; c++) {
+		const unsigned char * p = payload + ends[c], * end = payload + ends[c + 1];
+		if (!decodeColumn(p, end, table->v[c] + at, chunk.rows, st)) return false;
+	}
+	return true;
+}
+
+bool readSessionWindow(const struct session_file & file, int stream, long long t0, long long t1,
+	struct session_table * table) {
+	if (!file.header || stream < 0 || stream >= file.header->streams) return false;
+	const struct session_stream & st = file.header->stream[stream];
+	const struct session_chunk * chunks = file.index + st.first_chunk;
+	// the index is a few entries per minute of recording: a scan finds the chunks to decode
+	long long bound = 0;
+	for (int i = 0; i < st.chunks; i++) {
+		if (chunks[i].t_last >= t0 && chunks[i].t_first <= t1) bound += chunks[i].rows;
+	}
+	if (bound > 0x7FFFFFFF || !reserveTable(table, bound, st.columns)) return false;
+	int rows = 0;
+	for (int i = 0; i < st.chunks; i++) {
+		const struct session_chunk & c = chunks[i];
+		if (c.t_last < t0 || c.t_first > t1) continue;
+		if (!decodeChunk(file, c, table, rows)) return false;
+		if (c.t_first >= t0 && c.t_last <= t1) {
+			rows += c.rows;
+			continue;
+		}
+		// partly inside: keep the rows in the window
+		int kept = rows;
+		for (int r = rows; r < rows + c.rows; r++) {
+			long long t = table->t[r];
+			if (t < t0 || t > t1) continue;
+			table->t[kept] = t;
+			for (int k = 0; k < st.columns; k++) table->v[k][kept] = table->v[k][r];
+			kept++;
+		}
+		rows = kept;
+	}
+	table->rows = rows;
+	return true;
+}
+
+bool readSessionStream(const struct session_file & file, int stream, struct session_table * table) {
+	const long long all = 0x7FFFFFFFFFFFFFFFLL;
+	return readSessionWindow(file, stream, -all - 1, all, table);
+}
+
+void freeSessionTable(struct session_table * table) {
+	free(table->storage);
+	memset(table, 0, sizeof(*table));
+}
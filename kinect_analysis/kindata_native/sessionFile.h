@@ -0,0 +1,146 @@
+/* *******************************************************************************
+ *	                              sessionFile.h
+ *
+ * One file per session holding all its streams (kindata.txt, the watch's
+ * gyro, accel and rotVector logs, ...) instead of loose text files zipped
+ * by hand. A stream is a table of time stamped rows of float columns.
+ * Rows are stored in chunks of chunk_rows, each column of a chunk in its
+ * own section of bit packed differences:
+ *	time    delta of delta (exact)
+ *	values  SESSION_EXACT: the float bits as ordered integers, or sensor
+ *	        step counts (exact)
+ *	        SESSION_QUANTIZED: multiples of quantum (exact for kindata.txt's
+ *	        %f with 1e-6, nan and inf are stored as 0)
+ * The file header and the chunk index are plain structs, read in place
+ * from the mapped file; a time window only decodes the chunks it overlaps.
+ * File: session_file_header, chunks (session_chunk + payload, 8 byte
+ * aligned), index (session_chunk per chunk, by stream then row).
+ *********************************************************************************/
+
+#pragma once
+
+#include <stdio.h>
+#include <stddef.h>
+
+const int SESSION_MAX_STREAMS = 16;
+const int SESSION_MAX_COLUMNS = 64;
+const int SESSION_NAME_SIZE = 32;
+const int SESSION_CHUNK_ROWS = 1024; // default rows per chunk (10 s of watch log, 34 s of Kinect frames)
+
+enum session_codec {
+	SESSION_EXACT,
+	SESSION_QUANTIZED
+};
+
+struct session_stream {
+	char name[SESSION_NAME_SIZE]; // e.g. "kindata", "gyro"
+	int columns; // float columns besides the time
+	int codec; // session_codec
+	double time_unit; // seconds per time stamp unit
+	double quantum; // value step of SESSION_QUANTIZED
+	long long rows;
+	int first_chunk; // index entries of the stream
+	int chunks;
+};
+
+struct session_file_header {
+	char magic[8]; // "KSESS01"
+	int streams;
+	int chunk_rows;
+	int chunks; // index entries
+	int reserved;
+	long long index_offset; // 0 until the writer is closed
+	struct session_stream stream[SESSION_MAX_STREAMS];
+};
+
+// Before every chunk's payload, and again in the index
+struct session_chunk {
+	int stream;
+	int rows;
+	long long first_row; // of the stream
+	long long t_first, t_last; // smallest and largest time stamp in the chunk
+	long long offset; // payload position in the file
+	int bytes; // payload size
+	int reserved;
+};
+
+/* --------------------------------------------------
+	Writing
+-------------------------------------------------- */
+
+// Growable byte buffer
+struct session_bytes {
+	unsigned char * data;
+	size_t size;
+	size_t capacity;
+};
+
+class SessionWriter {
+public:
+	SessionWriter();
+	~SessionWriter();
+	bool open(const char * path, int chunkRows = SESSION_CHUNK_ROWS);
+	/* Declare a stream before appending to it. Returns its number, -1 if the file is full or the name taken */
+	int addStream(const char * name, int columns, double timeUnit, session_codec codec = SESSION_EXACT, double quantum = 0);
+	/* One row, columns values */
+	bool append(int stream, long long t, const float * v);
+	/* n rows given column-wise, e.g. an imu_log's t and v */
+	bool appendColumns(int stream, const long long * t, const float * const * v, int n);
+	/* Write the remaining rows, the index and the header. false on any write error */
+	bool close();
+private:
+	bool flush(int stream);
+	bool write(const void * data, size_t bytes);
+
+	FILE * fp;
+	bool ok;
+	long long offset; // bytes written
+	struct session_file_header header;
+	long long * t[SESSION_MAX_STREAMS]; // pending rows of each stream
+	float * v[SESSION_MAX_STREAMS]; // pending values, column-wise, chunk_rows per column
+	int pending[SESSION_MAX_STREAMS];
+	struct session_chunk * index;
+	int index_capacity;
+	struct session_bytes payload;
+};
+
+/* --------------------------------------------------
+	Reading
+-------------------------------------------------- */
+
+// A mapped session file. Must start zeroed
+struct session_file {
+	const struct session_file_header * header;
+	const struct session_chunk * index; // header->chunks entries
+	const unsigned char * data;
+	size_t size;
+	void * file_handle; // Windows file and mapping handles
+	void * map_handle;
+};
+
+// Decoded rows: t[i] and v[c][i] for row i, as imu_log
+struct session_table {
+	int rows;
+	int columns;
+	long long * t;
+	float * v[SESSION_MAX_COLUMNS];
+	void * storage; // one allocation holding all columns
+	size_t storage_bytes;
+};
+
+/* Map a session file and check its header and index. false if unreadable or not closed */
+bool openSession(const char * path, struct session_file * file);
+void closeSession(struct session_file * file);
+
+/* Stream number by name, -1 if missing */
+int findSessionStream(const struct session_file & file, const char * name);
+
+/* Rows of a stream with t0 <= t <= t1, in recorded order. Reuses table's storage if large enough,
+   table must start zeroed. false if the stream does not exist or a chunk is damaged */
+bool readSessionWindow(const struct session_file & file, int stream, long long t0, long long t1,
+	struct session_table * table);
+
+/* All rows of a stream */
+bool readSessionStream(const struct session_file & file, int stream, struct session_table * table);
+
+void freeSessionTable(struct session_table * table);
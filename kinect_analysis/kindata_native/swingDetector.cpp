@@ -0,0 +1,192 @@
+/* *******************************************************************************
+ *	                              swingDetector.cpp
+ *
+ * State is a handful of scalars: no sample history is kept, the swing
+ * start is remembered as the time of the last resting sample and the
+ * angle is integrated from it, so the cost per sample is fixed.
+ *********************************************************************************/
+
+#include "swingDetector.h"
+
+#include <math.h>
+#include <string.h>
+
+static const double max_dt = 0.1; // s, longer gaps (dropped samples) count as this
+static const float gravity_time = 0.5f; // s, time constant of the accel low pass
+static const float top_pause = 3; // a rest around the top may last this many rest_time before cancelling
+
+void defaultSwingParams(struct swing_params * params) {
+	params->axis = 1;
+	params->start_rate = 0.6f;
+	params->rest_rate = 0.25f;
+	params->rest_time = 0.3f;
+	params->min_top_angle = 0.1f;
+	params->min_down_rate = 0.3f;
+	params->impact_accel = 0;
+	params->max_lookback = 1.0f;
+	params->min_swing_time = 0.3f;
+	params->max_swing_time = 6.0f;
+	params->bias_time = 2.0f;
+	params->time_unit = 1e-9;
+}
+
+SwingDetector::SwingDetector(const struct swing_params & params) {
+	this->params = params;
+	reset();
+}
+
+void SwingDetector::reset() {
+	current = SWING_IDLE;
+	started = false;
+	t_last = t_quiet = t_start = t_rest = t_peak = 0;
+	resting = false;
+	b[0] = b[1] = b[2] = 0;
+	theta = 0;
+	direction = 0;
+	peak = 0;
+	gravity[0] = gravity[1] = gravity[2] = 0;
+	t_accel = 0;
+	have_gravity = false;
+	n_swings = 0;
+}
+
+int SwingDetector::emit(struct swing_event * events, int n, swing_event_type type, long long t) {
+	if (n >= SWING_MAX_EVENTS) return n;
+	events[n].type = type;
+	events[n].t = t;
+	events[n].angle = theta;
+	events[n].peak_rate = peak;
+	return n + 1;
+}
+
+void SwingDetector::toIdle(long long t) {
+	current = SWING_IDLE;
+	t_quiet = t;
+	theta = 0;
+	direction = 0;
+	peak = 0;
+}
+
+int SwingDetector::gyro(long long t, const float w[3], struct swing_event * events) {
+	if (!started) {
+		started = true;
+		t_last = t_quiet = t;
+	}
+	double dt = (t - t_last) * params.time_unit;
+	if (dt < 0) dt = 0;
+	else t_last = t;
+	if (dt > max_dt) dt = max_dt;
+
+	float g[3] = { w[0] - b[0], w[1] - b[1], w[2] - b[2] };
+	float rate = sqrtf(g[0] * g[0] + g[1] * g[1] + g[2] * g[2]);
+	float axisRate = g[params.axis];
+	bool still = rate < params.rest_rate;
+	if (still && !resting) t_rest = t;
+	resting = still;
+	double restFor = still ? (t - t_rest) * params.time_unit : 0;
+	double swingFor = (t - t_start) * params.time_unit;
+	int n = 0;
+
+	switch (current) {
+	case SWING_IDLE:
+		if (still) {
+			// the bias follows the resting wrist
+			float a = (float)(dt / params.bias_time);
+			if (a > 1) a = 1;
+			for (int c = 0; c < 3; c++) b[c] += a * g[c];
+			t_quiet = t;
+			theta = 0;
+			break;
+		}
+		theta += (float)(axisRate * dt);
+		if (rate > params.start_rate) {
+			long long lookback = (long long)(params.max_lookback / params.time_unit);
+			t_start = t - t_quiet > lookback ? t - lookback : t_quiet;
+			current = SWING_BACK;
+			direction = 0;
+			peak = fabsf(axisRate);
+			n = emit(events, n, SWING_START, t_start);
+		}
+		break;
+
+	case SWING_BACK:
+		theta += (float)(axisRate * dt);
+		if (fabsf(axisRate) > peak) peak = fabsf(axisRate);
+		if (direction == 0 && fabsf(theta) > params.min_top_angle) direction = theta > 0 ? 1.0f : -1.0f;
+		// reversed by more than the noise: a slow drift around the top is not yet the downswing
+		if (direction != 0 && axisRate * direction < -0.5f * params.rest_rate) {
+			current = SWING_DOWN;
+			n = emit(events, n, SWING_TOP, t);
+			peak = 0; // the downswing's own peak from here
+			t_peak = t;
+		}
+		else if (restFor >= (direction != 0 ? top_pause : 1) * params.rest_time || swingFor > params.max_swing_time) {
+			n = emit(events, n, SWING_CANCEL, t);
+			toIdle(t);
+		}
+		break;
+
+	case SWING_DOWN:
+		theta += (float)(axisRate * dt);
+		if (fabsf(axisRate) > peak) {
+			peak = fabsf(axisRate);
+			t_peak = t;
+		}
+		// past address, or past the fastest point and slowing down
+		if (theta * direction <= 0 || (peak >= params.min_down_rate && fabsf(axisRate) < 0.5f * peak)) {
+			if (peak < params.min_down_rate) {
+				n = emit(events, n, SWING_CANCEL, t);
+				toIdle(t);
+			}
+			else {
+				current = SWING_FOLLOW;
+				n = emit(events, n, SWING_IMPACT, theta * direction <= 0 ? t : t_peak);
+			}
+		}
+		else if (restFor >= top_pause * params.rest_time || swingFor > params.max_swing_time) {
+			n = emit(events, n, SWING_CANCEL, t);
+			toIdle(t);
+		}
+		break;
+
+	case SWING_FOLLOW:
+		theta += (float)(axisRate * dt);
+		if (restFor >= params.rest_time || swingFor > params.max_swing_time) {
+			long long end = still ? t_rest : t;
+			if ((end - t_start) * params.time_unit < params.min_swing_time) {
+				n = emit(events, n, SWING_CANCEL, t);
+			}
+			else {
+				n_swings++;
+				n = emit(events, n, SWING_END, end);
+			}
+			toIdle(t);
+		}
+		break;
+	}
+	return n;
+}
+
+int SwingDetector::accel(long long t, const float a[3], struct swing_event * events) {
+	if (!have_gravity) {
+		memcpy(gravity, a, sizeof(gravity));
+		t_accel = t;
+		have_gravity = true;
+		return 0;
+	}
+	// change against the low passed accel (gravity plus slow motion)
+	float d[3] = { a[0] - gravity[0], a[1] - gravity[1], a[2] - gravity[2] };
+	float change = sqrtf(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+	double dt = (t - t_accel) * params.time_unit;
+	if (dt < 0) dt = 0;
+	else t_accel = t;
+	if (dt > max_dt) dt = max_dt;
+	float k = (float)(dt / gravity_time);
+	for (int c = 0; c < 3; c++) gravity[c] += k * d[c];
+	int n = 0;
+	if (current == SWING_DOWN && params.impact_accel > 0 && change > params.impact_accel && peak >= params.min_down_rate) {
+		current = SWING_FOLLOW;
+		n = emit(events, n, SWING_IMPACT, t);
+	}
+	return n;
+}
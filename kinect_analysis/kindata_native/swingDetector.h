@@ -0,0 +1,97 @@
+/* *******************************************************************************
+ *	                              swingDetector.h
+ *
+ * Online swing segmentation of the watch stream, the streaming counterpart
+ * of the window search in quaternion_gyroscope/main.m (peak of the y axis
+ * angle = top of the backswing, START_POS / END_POS around it).
+ * Per gyro sample, in constant time and memory:
+ *	IDLE   the wrist is at rest or moving slowly; the gyro bias follows
+ *	       the resting samples
+ *	BACK   the rate went over start_rate: the swing started at the last
+ *	       resting sample. The swing axis angle is integrated from there
+ *	DOWN   the swing axis rate turned against the backswing (top)
+ *	FOLLOW the angle came back through the address angle, or the rate fell
+ *	       to half its downswing peak (impact at the peak: the bottom of a
+ *	       pendulum stroke), or the accel spiked; the swing ends once the
+ *	       wrist rests for rest_time
+ * Each transition is reported as a swing_event with its time stamp, so a
+ * recorder only has to keep max_lookback of samples to save the windows.
+ *********************************************************************************/
+
+#pragma once
+
+enum swing_state {
+	SWING_IDLE,
+	SWING_BACK,
+	SWING_DOWN,
+	SWING_FOLLOW
+};
+
+enum swing_event_type {
+	SWING_START, // t: last resting sample before the motion
+	SWING_TOP, // t: swing axis rate reversed
+	SWING_IMPACT, // t: back through the address angle, downswing peak or accel spike
+	SWING_END, // t: first sample of the final rest
+	SWING_CANCEL // not a swing after all (a wiggle, no downswing); t: when given up
+};
+
+struct swing_event {
+	swing_event_type type;
+	long long t; // log time stamp
+	float angle; // swing axis angle since the start (rad)
+	float peak_rate; // largest swing axis rate so far (rad/s)
+};
+
+const int SWING_MAX_EVENTS = 2; // events one sample can produce
+
+struct swing_params {
+	int axis; // swing axis of the watch (main.m: y, 1)
+	float start_rate; // rad/s, |w| that starts a swing
+	float rest_rate; // rad/s, |w| below this is at rest
+	float rest_time; // s at rest that end a swing
+	float min_top_angle; // rad of backswing before a reversal counts as the top
+	float min_down_rate; // rad/s the downswing must reach, or the swing is cancelled
+	float impact_accel; // m/s^2 of accel change that marks impact, 0 to use the angle only
+	float max_lookback; // s, the start is never further back than this from its detection
+	float min_swing_time; // s from start to end, shorter ones (sensor glitches) are cancelled
+	float max_swing_time; // s from start to end before giving up
+	float bias_time; // s, time constant of the bias while resting
+	double time_unit; // seconds per time stamp unit (1e-9 for the watch logs)
+};
+
+/* Settings for the full swings and putts in the data/amateur and data/gyro sessions */
+void defaultSwingParams(struct swing_params * params);
+
+class SwingDetector {
+public:
+	SwingDetector(const struct swing_params & params);
+	void reset();
+	/* One gyro sample (rad/s) at time stamp t. Writes up to SWING_MAX_EVENTS events, returns how many */
+	int gyro(long long t, const float w[3], struct swing_event * events);
+	/* One accel sample (m/s^2), may report the impact */
+	int accel(long long t, const float a[3], struct swing_event * events);
+	swing_state state() const { return current; }
+	int swings() const { return n_swings; } // ended swings
+	const float * bias() const { return b; }
+private:
+	int emit(struct swing_event * events, int n, swing_event_type type, long long t);
+	void toIdle(long long t);
+
+	struct swing_params params;
+	swing_state current;
+	bool started; // t_last set
+	long long t_last;
+	long long t_quiet; // last resting sample
+	long long t_start;
+	long long t_rest; // start of the current rest
+	bool resting; // at rest since t_rest
+	float b[3]; // gyro bias
+	float theta; // swing axis angle since the last rest
+	float direction; // sign of the backswing, 0 until min_top_angle
+	float peak; // largest |swing axis rate| in the current phase
+	long long t_peak; // when
+	float gravity[3]; // low passed accel
+	long long t_accel; // last accel sample
+	bool have_gravity;
+	int n_swings;
+};
@@ -0,0 +1,273 @@
+/* *******************************************************************************
+ *	                              timeSync.cpp
+ *
+ * score(lag) = sum_c sum_i r_c(lag + i) s_c(i) / sqrt(sum_c |s_c|^2 * sum_c |r_c(lag ..)|^2)
+ * with s the signal minus its mean and r the reference minus the mean of
+ * the window under the signal. The numerator of every lag comes from one
+ * inverse FFT of the cross spectra summed over channels; the window
+ * energies are running sums. The FFT is radix 2 on complex pairs of real
+ * samples (a real FFT of size n through a complex one of size n / 2), in
+ * double, padded with zeros to a power of two of at least n, which is
+ * enough as only lags with the signal fully inside the reference are read.
+ *********************************************************************************/
+
+#include "timeSync.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+static const double pi = 3.14159265358979323846;
+static const double min_energy = 1e-12; // below this a window counts as flat
+
+/* --------------------------------------------------
+	FFT
+-------------------------------------------------- */
+
+/* Tables and buffers for FFTs of size (real samples) and lags scores */
+static bool prepare(struct sync_workspace * ws, int size, int lags) {
+	if (ws->size != size) {
+		free(ws->cos_table);
+		free(ws->sin_table);
+		free(ws->spectrum);
+		free(ws->cross);
+		free(ws->work);
+		int half = size / 2;
+		int tables = half / 2 + half + 1;
+		ws->cos_table = (double *)malloc(tables * sizeof(double));
+		ws->sin_table = (double *)malloc(tables * sizeof(double));
+		ws->spectrum = (double *)malloc((half + 1) * 2 * sizeof(double));
+		ws->cross = (double *)malloc((half + 1) * 2 * sizeof(double));
+		ws->work = (double *)malloc(size * sizeof(double));
+		if (!ws->cos_table || !ws->sin_table || !ws->spectrum || !ws->cross || !ws->work) {
+			ws->size = 0;
+			return false;
+		}
+		// e^(2 pi i k / half) for the complex FFT, e^(2 pi i k / size) for the real split
+		for (int k = 0; k < half / 2; k++) {
+			ws->cos_table[k] = cos(2 * pi * k / half);
+			ws->sin_table[k] = sin(2 * pi * k / half);
+		}
+		for (int k = 0; k <= half; k++) {
+			ws->cos_table[half / 2 + k] = cos(2 * pi * k / size);
+			ws->sin_table[half / 2 + k] = sin(2 * pi * k / size);
+		}
+		ws->size = size;
+	}
+	if (ws->lags < lags || !ws->energy) {
+		free(ws->energy);
+		ws->energy = (double *)malloc(lags * sizeof(double));
+		if (!ws->energy) {
+			ws->lags = 0;
+			return false;
+		}
+		ws->lags = lags;
+	}
+	return true;
+}
+
+/* In place complex FFT of n (re, im) pairs, n a power of two. sign -1 forward, +1 inverse (unscaled) */
+static void complexFft(double * a, int n, const double * cs, const double * sn, int sign) {
+	for (int i = 1, j = 0; i < n; i++) {
+		int bit = n >> 1;
+		for (; j & bit; bit >>= 1) j ^= bit;
+		j ^= bit;
+		if (i < j) {
+			double t = a[2 * i]; a[2 * i] = a[2 * j]; a[2 * j] = t;
+			t = a[2 * i + 1]; a[2 * i + 1] = a[2 * j + 1]; a[2 * j + 1] = t;
+		}
+	}
+	for (int len = 2; len <= n; len <<= 1) {
+		int step = n / len;
+		for (int i = 0; i < n; i += len) {
+			for (int k = 0; k < len / 2; k++) {
+				double wr = cs[k * step], wi = sign * sn[k * step];
+				double * u = a + 2 * (i + k);
+				double * v = a + 2 * (i + k + len / 2);
+				double vr = v[0] * wr - v[1] * wi;
+				double vi = v[0] * wi + v[1] * wr;
+				v[0] = u[0] - vr;
+				v[1] = u[1] - vi;
+				u[0] += vr;
+				u[1] += vi;
+			}
+		}
+	}
+}
+
+/* Spectrum bin k (0 .. size / 2) of the real samples whose half size complex FFT is in z */
+static inline void realBin(const struct sync_workspace * ws, int k, double & re, double & im) {
+	int half = ws->size / 2;
+	const double * z = ws->work;
+	int a = k % half, b = (half - k) % half;
+	// even samples' spectrum e, odd samples' spectrum o
+	double er = 0.5 * (z[2 * a] + z[2 * b]);
+	double ei = 0.5 * (z[2 * a + 1] - z[2 * b + 1]);
+	double or_ = 0.5 * (z[2 * a + 1] + z[2 * b + 1]);
+	double oi = -0.5 * (z[2 * a] - z[2 * b]);
+	// x_k = e + e^(-2 pi i k / size) o
+	double wr = ws->cos_table[half / 2 + k], wi = -ws->sin_table[half / 2 + k];
+	re = er + wr * or_ - wi * oi;
+	im = ei + wr * oi + wi * or_;
+}
+
+/* FFT of n real samples v - mean, zero padded to the FFT size, left in ws->work */
+static void forward(struct sync_workspace * ws, const float * v, int n, double mean) {
+	double * z = ws->work;
+	for (int i = 0; i < n; i++) z[i] = v[i] - mean;
+	memset(z + n, 0, (ws->size - n) * sizeof(double));
+	complexFft(z, ws->size / 2, ws->cos_table, ws->sin_table, -1);
+}
+
+/* Real samples of the spectrum in ws->cross into ws->work, scaled to the circular correlation */
+static void inverse(struct sync_workspace * ws) {
+	int half = ws->size / 2;
+	const double * x = ws->cross;
+	double * z = ws->work;
+	for (int k = 0; k < half; k++) {
+		int c = half - k;
+		// e = (x_k + conj x_c) / 2, o = (x_k - conj x_c) / 2 * e^(2 pi i k / size), z = e + i o
+		double er = 0.5 * (x[2 * k] + x[2 * c]);
+		double ei = 0.5 * (x[2 * k + 1] - x[2 * c + 1]);
+		double dr = 0.5 * (x[2 * k] - x[2 * c]);
+		double di = 0.5 * (x[2 * k + 1] + x[2 * c + 1]);
+		double wr = ws->cos_table[half / 2 + k], wi = ws->sin_table[half / 2 + k];
+		double or_ = dr * wr - di * wi;
+		double oi = dr * wi + di * wr;
+		z[2 * k] = er - oi;
+		z[2 * k + 1] = ei + or_;
+	}
+	complexFft(z, half, ws->cos_table, ws->sin_table, 1);
+	double scale = 1.0 / half;
+	for (int i = 0; i < ws->size; i++) z[i] *= scale;
+}
+
+static double mean(const float * v, int n) {
+	double sum = 0;
+	for (int i = 0; i < n; i++) sum += v[i];
+	return sum / n;
+}
+
+
+/* --------------------------------------------------
+	Sync
+-------------------------------------------------- */
+
+bool syncSignals(const float * const * reference, int n, const float * const * signal, int m, int channels,
+	struct sync_workspace * ws, struct sync_result * result, float * scores) {
+	if (m < 2 || m > n || channels < 1 || channels > SYNC_MAX_CHANNELS) return false;
+	int lags = n - m + 1;
+	int size = 4;
+	while (size < n) size *= 2;
+	if (!prepare(ws, size, lags)) return false;
+	int half = size / 2;
+
+	double signalEnergy = 0;
+	memset(ws->cross, 0, (half + 1) * 2 * sizeof(double));
+	memset(ws->energy, 0, lags * sizeof(double));
+	for (int c = 0; c < channels; c++) {
+		// reference spectrum
+		double refMean = mean(reference[c], n);
+		forward(ws, reference[c], n, refMean);
+		for (int k = 0; k <= half; k++) realBin(ws, k, ws->spectrum[2 * k], ws->spectrum[2 * k + 1]);
+
+		// energy of the reference under the signal at every lag, about the window mean
+		double s1 = 0, s2 = 0;
+		for (int i = 0; i < m; i++) {
+			double r = reference[c][i] - refMean;
+			s1 += r;
+			s2 += r * r;
+		}
+		for (int lag = 0; lag < lags; lag++) {
+			if (lag > 0) {
+				double in = reference[c][lag + m - 1] - refMean, out = reference[c][lag - 1] - refMean;
+				s1 += in - out;
+				s2 += in * in - out * out;
+			}
+			double e = s2 - s1 * s1 / m;
+			ws->energy[lag] += e > 0 ? e : 0;
+		}
+
+		// signal spectrum, accumulate reference x conj(signal)
+		double sigMean = mean(signal[c], m);
+		for (int i = 0; i < m; i++) {
+			double s = signal[c][i] - sigMean;
+			signalEnergy += s * s;
+		}
+		forward(ws, signal[c], m, sigMean);
+		for (int k = 0; k <= half; k++) {
+			double br, bi;
+			realBin(ws, k, br, bi);
+			double ar = ws->spectrum[2 * k], ai = ws->spectrum[2 * k + 1];
+			ws->cross[2 * k] += ar * br + ai * bi;
+			ws->cross[2 * k + 1] += ai * br - ar * bi;
+		}
+	}
+	if (signalEnergy < min_energy) return false;
+	inverse(ws);
+
+	// normalize, the signal has zero mean so the window mean drops out of the numerator
+	const double * corr = ws->work;
+	int best = -1;
+	double bestScore = -2;
+	for (int lag = 0; lag < lags; lag++) {
+		double e = ws->energy[lag];
+		double score = e > min_energy ? corr[lag] / sqrt(signalEnergy * e) : 0;
+		ws->energy[lag] = score; // scores from here on
+		if (scores) scores[lag] = (float)score;
+		if (score > bestScore) {
+			bestScore = score;
+			best = lag;
+		}
+	}
+	result->lag = best;
+	result->score = bestScore;
+	result->offset = best;
+	if (best > 0 && best < lags - 1) {
+		double l = ws->energy[best - 1], c = bestScore, r = ws->energy[best + 1];
+		double d = l - 2 * c + r;
+		if (d < 0) result->offset = best + 0.5 * (l - r) / d;
+	}
+	return true;
+}
+
+void freeSyncWorkspace(struct sync_workspace * ws) {
+	free(ws->cos_table);
+	free(ws->sin_table);
+	free(ws->spectrum);
+	free(ws->cross);
+	free(ws->work);
+	free(ws->energy);
+	memset(ws, 0, sizeof(*ws));
+}
+
+
+/* --------------------------------------------------
+	Signal preparation
+-------------------------------------------------- */
+
+void lowPass(float * v, int n, double cutoff) {
+	// bilinear transform of the analog 2nd order Butterworth
+	double k = tan(pi * cutoff / 2);
+	double norm = 1 / (1 + sqrt(2.0) * k + k * k);
+	double b0 = k * k * norm, b1 = 2 * b0, b2 = b0;
+	double a1 = 2 * (k * k - 1) * norm, a2 = (1 - sqrt(2.0) * k + k * k) * norm;
+	// direct form II transposed. Unlike filter(), the state starts settled on the first sample:
+	// a ramp up from zero at the start of both recordings would match itself at lag 0
+	if (n <= 0) return;
+	double z1 = v[0] * (1 - b0), z2 = v[0] * (b2 - a2);
+	for (int i = 0; i < n; i++) {
+		double x = v[i];
+		double y = b0 * x + z1;
+		z1 = b1 * x - a1 * y + z2;
+		z2 = b2 * x - a2 * y;
+		v[i] = (float)y;
+	}
+}
+
+void motionPower(const float * x, const float * y, const float * z, int n, float * power) {
+	for (int i = 0; i + 1 < n; i++) {
+		float dx = x[i + 1] - x[i], dy = y[i + 1] - y[i], dz = z[i + 1] - z[i];
+		power[i] = sqrtf(dx * dx + dy * dy + dz * dz);
+	}
+}
@@ -0,0 +1,50 @@
+/* *******************************************************************************
+ *	                              timeSync.h
+ *
+ * Offset between two recordings of the same motion (Kinect and watch),
+ * replacing the offset search of timeSync.m / scalarTimeSync.m.
+ * The score of an offset is the normalized cross correlation of the signal
+ * with the part of the reference it overlaps, over all channels together
+ * (e.g. the three axes of the arm direction, or one motion power channel).
+ * All offsets are scored at once through FFTs, O(n log n) instead of
+ * O(n m), and the best one is refined to a fraction of a sample.
+ *********************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+
+const int SYNC_MAX_CHANNELS = 8;
+
+struct sync_result {
+	int lag; // best whole sample offset: reference[lag + i] matches signal[i]
+	double offset; // lag with the sub-sample peak position (parabola through the peak)
+	double score; // normalized correlation at lag, -1 .. 1
+};
+
+// Buffers of syncSignals, reused between calls. Must start zeroed
+struct sync_workspace {
+	int size; // FFT length (real samples), power of two
+	double * cos_table; // twiddles: size / 4 for the half length complex FFT, then size / 2 + 1 for the real split
+	double * sin_table;
+	double * spectrum; // one channel's reference spectrum, size / 2 + 1 complex
+	double * cross; // reference x conj(signal) spectra summed over channels
+	double * work; // size samples, FFT input and output
+	double * energy; // reference energy under the signal at each lag
+	int lags; // entries in energy
+};
+
+/* Find the signal (m samples) in the reference (n >= m samples), both with channels columns.
+   Every offset where the signal lies fully inside the reference is scored.
+   scores (may be NULL) receives the n - m + 1 scores. false if m > n or the signal is flat */
+bool syncSignals(const float * const * reference, int n, const float * const * signal, int m, int channels,
+	struct sync_workspace * ws, struct sync_result * result, float * scores = NULL);
+
+void freeSyncWorkspace(struct sync_workspace * ws);
+
+/* 2nd order Butterworth low pass in place, as filter(butter(2, cutoff), v) in MATLAB
+   (cutoff relative to half the sample rate), but starting settled at v[0] */
+void lowPass(float * v, int n, double cutoff);
+
+/* Motion power as in timeSync.m: |p(i+1) - p(i)| of a 3 channel signal, n - 1 samples */
+void motionPower(const float * x, const float * y, const float * z, int n, float * power);
@@ -0,0 +1,127 @@
+/* *******************************************************************************
+ *	                              batchAnalysisTool
+ *
+ * Runs the Kinect / watch comparison (see batchAnalysis.h) over every
+ * session under the given directories on all cores and writes one summary
+ * table, a tab separated row per session as soon as it is done (so rows
+ * come in completion order; sort by the first column for a stable table).
+ * Results are cached in <first root>/.batch_cache unless -cache or
+ * -nocache is given: a re-run only analyzes sessions whose files changed.
+ * Columns: session, status, gyro rows, seconds, bias x y z (rad/s), drift
+ * (deg), kinect rows, offset (s), sync score, pairs, inliers, fit rms, arm
+ * error (deg), K (w x y z), ms (0 if cached).
+ *
+ * Usage: batchAnalysisTool root... [-out summary.tsv] [-cache dir] [-nocache] [-threads n]
+ *        [-rate hz] [-cutoff c] [-skip n]
+ * Build: ../batchAnalysis.cpp ../kindataLog.cpp ../resampler.cpp ../orientation.cpp ../timeSync.cpp ../rotationFit.cpp ../imuLog.cpp
+ *********************************************************************************/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+#include "../batchAnalysis.h"
+
+using namespace std;
+
+static const char * status_names[] = { "ok", "no_kinect", "no_sync", "failed" };
+
+struct summary {
+	FILE * out;
+	int done, total, cached;
+};
+
+static void printRow(const struct batch_session & s, const struct batch_result & r, bool cached, void * user) {
+	struct summary & sum = *(struct summary *)user;
+	fprintf(sum.out, "%s\t%s\t%d\t%.2f\t%.5f\t%.5f\t%.5f\t%.2f\t%d\t%.6f\t%.3f\t%d\t%d\t%.4f\t%.2f\t%.5f\t%.5f\t%.5f\t%.5f\t%.1f\n",
+		s.name, status_names[r.status], r.gyro_rows, r.seconds, r.bias[0], r.bias[1], r.bias[2], r.drift,
+		r.kinect_rows, r.offset, r.score, r.pairs, r.inliers, r.rms, r.arm_error, r.K[0], r.K[1], r.K[2], r.K[3], r.ms);
+	fflush(sum.out);
+	sum.done++;
+	if (cached) sum.cached++;
+	fprintf(stderr, "\r%d / %d sessions (%d cached)", sum.done, sum.total, sum.cached);
+}
+
+static bool makeDirectory(const char * path) {
+#ifdef _WIN32
+	return _mkdir(path) == 0 || errno == EEXIST;
+#else
+	struct stat st;
+	return mkdir(path, 0777) == 0 || (stat(path, &st) == 0 && S_ISDIR(st.st_mode));
+#endif
+}
+
+int main(int argc, char ** argv) {
+	vector<const char *> roots;
+	const char * outPath = NULL;
+	string cacheDir;
+	bool useCache = true;
+	int threads = 0;
+	struct batch_params params;
+	defaultBatchParams(&params);
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-out") == 0 && i + 1 < argc) outPath = argv[++i];
+		else if (strcmp(argv[i], "-cache") == 0 && i + 1 < argc) cacheDir = argv[++i];
+		else if (strcmp(argv[i], "-nocache") == 0) useCache = false;
+		else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) threads = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-rate") == 0 && i + 1 < argc) params.rate = atof(argv[++i]);
+		else if (strcmp(argv[i], "-cutoff") == 0 && i + 1 < argc) params.cutoff = atof(argv[++i]);
+		else if (strcmp(argv[i], "-skip") == 0 && i + 1 < argc) params.skip = atoi(argv[++i]);
+		else if (argv[i][0] != '-') roots.push_back(argv[i]);
+	}
+	if (roots.empty()) {
+		printf("usage: batchAnalysisTool root... [-out summary.tsv] [-cache dir] [-nocache] [-threads n] [-rate hz] [-cutoff c] [-skip n]\n");
+		return 1;
+	}
+
+	vector<struct batch_session> sessions;
+	for (size_t r = 0; r < roots.size(); r++) {
+		struct batch_session * found;
+		int n = findSessions(roots[r], &found);
+		sessions.insert(sessions.end(), found, found + n);
+		free(found);
+	}
+	if (sessions.empty()) {
+		printf("no sessions under %s\n", roots[0]);
+		return 1;
+	}
+	if (useCache && cacheDir.empty()) cacheDir = string(roots[0]) + "/.batch_cache";
+	if (useCache && !makeDirectory(cacheDir.c_str())) {
+		fprintf(stderr, "cannot use cache %s, not caching\n", cacheDir.c_str());
+		useCache = false;
+	}
+
+	struct summary sum;
+	sum.out = outPath ? fopen(outPath, "w") : stdout;
+	if (!sum.out) {
+		printf("cannot write %s\n", outPath);
+		return 1;
+	}
+	sum.done = 0;
+	sum.total = (int)sessions.size();
+	sum.cached = 0;
+	fprintf(sum.out, "session\tstatus\tgyro_rows\tseconds\tbias_x\tbias_y\tbias_z\tdrift_deg\tkinect_rows\toffset_s\tscore\t"
+		"pairs\tinliers\trms\tarm_error_deg\tK_w\tK_x\tK_y\tK_z\tms\n");
+	vector<struct batch_result> results(sessions.size());
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	int analyzed = runBatch(&sessions[0], (int)sessions.size(), params, useCache ? cacheDir.c_str() : NULL,
+		&results[0], printRow, &sum, threads);
+	double s = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (outPath) fclose(sum.out);
+	int ok = 0;
+	for (size_t i = 0; i < results.size(); i++) ok += results[i].status == BATCH_OK;
+	fprintf(stderr, "\r%d sessions, %d analyzed, %d cached, %d synced and fitted, %.2f s\n",
+		sum.total, analyzed, sum.total - analyzed, ok, s);
+	return 0;
+}
@@ -0,0 +1,252 @@
+/* *******************************************************************************
+ *	                              sessionPackTool
+ *
+ * Packs a session directory into one session file (see sessionFile.h) and
+ * reads it back.
+ *	pack    every log in the directory: *_gyro.txt, *_accel.txt,
+ *	        *_rotVector.txt as streams gyro, accel, rotVector (other logs
+ *	        by file name), kindata*.txt as stream kindata (time in us since
+ *	        midnight, values exact with quantum 1e-6). A device time column
+ *	        written by exportKindata becomes stream kindata_device, one time
+ *	        stamp per kindata row. Logs are stored exactly unless -quantum
+ *	        is given. Untimed logs (phone) get the row number as time.
+ *	info    streams, rows, chunks and sizes
+ *	cat     the rows of a stream between t0 and t1 (stream time units) as text
+ *
+ * Usage: sessionPackTool pack session_dir out.kses [-rows n] [-quantum q]
+ *        sessionPackTool info in.kses
+ *        sessionPackTool cat in.kses stream [t0 t1]
+ * Build: ../sessionFile.cpp ../imuLog.cpp
+ *********************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <dirent.h>
+#include <sys/stat.h>
+#endif
+
+#include "../imuLog.h"
+#include "../sessionFile.h"
+
+using namespace std;
+
+static const double kindata_quantum = 1e-6; // %f in exportKindata
+static const long long min_device_stamp = 1000000000LL; // a device time column holds ns stamps
+
+/* .txt files directly in dir */
+static void findTexts(const string & dir, vector<string> & files) {
+#ifdef _WIN32
+	WIN32_FIND_DATAA fd;
+	HANDLE h = FindFirstFileA((dir + "\\*.txt").c_str(), &fd);
+	if (h == INVALID_HANDLE_VALUE) return;
+	do {
+		if (!(fd.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY)) files.push_back(dir + "\\" + fd.cFileName);
+	} while (FindNextFileA(h, &fd));
+	FindClose(h);
+#else
+	DIR * d = opendir(dir.c_str());
+	if (!d) return;
+	while (struct dirent * e = readdir(d)) {
+		string name = e->d_name;
+		string path = dir + "/" + name;
+		struct stat st;
+		if (name.size() > 4 && name.compare(name.size() - 4, 4, ".txt") == 0 && stat(path.c_str(), &st) == 0 && S_ISREG(st.st_mode)) {
+			files.push_back(path);
+		}
+	}
+	closedir(d);
+#endif
+}
+
+static string baseName(const string & path) {
+	size_t slash = path.find_last_of("/\\");
+	string name = slash == string::npos ? path : path.substr(slash + 1);
+	return name.substr(0, name.size() - 4);
+}
+
+/* kindata.txt as stream kindata (and kindata_device) */
+static bool packKindata(const char * path, SessionWriter & writer) {
+	FILE * in = fopen(path, "r");
+	if (!in) return false;
+	int stream = -1, device = -1, columns = -1;
+	long long rows = 0;
+	static char line[1 << 16];
+	while (fgets(line, sizeof(line), in)) {
+		double col[SESSION_MAX_COLUMNS + 2];
+		bool integer[SESSION_MAX_COLUMNS + 2];
+		int n = 0;
+		char * p = line;
+		while (n < SESSION_MAX_COLUMNS + 2) {
+			char * end;
+			col[n] = strtod(p, &end);
+			if (end == p) break;
+			integer[n] = memchr(p, '.', end - p) == NULL;
+			p = end;
+			n++;
+		}
+		if (n < 2) continue;
+		if (columns < 0) {
+			// the layout of the first row: time, values, maybe the device time
+			bool hasDevice = integer[n - 1] && fabs(col[n - 1]) >= min_device_stamp;
+			columns = n - 1 - (hasDevice ? 1 : 0);
+			if (columns > SESSION_MAX_COLUMNS) break;
+			stream = writer.addStream("kindata", columns, 1e-6, SESSION_QUANTIZED, kindata_quantum);
+			if (hasDevice) device = writer.addStream("kindata_device", 0, 1e-9);
+			if (stream < 0 || (hasDevice && device < 0)) break;
+		}
+		if (n != columns + 1 + (device >= 0 ? 1 : 0)) continue;
+		float v[SESSION_MAX_COLUMNS];
+		for (int c = 0; c < columns; c++) v[c] = (float)col[c + 1];
+		long long t = (long long)floor(col[0] * 1e6 + 0.5);
+		if (!writer.append(stream, t, v)) break;
+		if (device >= 0 && !writer.append(device, (long long)col[n - 1], v)) break;
+		rows++;
+	}
+	fclose(in);
+	printf("%-28s kindata, %lld rows, %d columns\n", baseName(path).c_str(), rows, columns);
+	return stream >= 0;
+}
+
+static int pack(const char * dir, const char * outPath, int chunkRows, double quantum) {
+	vector<string> files;
+	findTexts(dir, files);
+	SessionWriter writer;
+	if (!writer.open(outPath, chunkRows)) {
+		printf("cannot write %s\n", outPath);
+		return 1;
+	}
+	struct imu_log log;
+	memset(&log, 0, sizeof(log));
+	long long textBytes = 0;
+	for (size_t i = 0; i < files.size(); i++) {
+		const char * path = files[i].c_str();
+		string name = baseName(files[i]);
+		FILE * f = fopen(path, "rb");
+		if (f) {
+			fseek(f, 0, SEEK_END);
+			textBytes += ftell(f);
+			fclose(f);
+		}
+		if (name.compare(0, 7, "kindata") == 0) {
+			if (!packKindata(path, writer)) printf("%-28s skipped\n", name.c_str());
+			continue;
+		}
+		if (!loadImuLog(path, &log) || log.rows == 0) {
+			printf("%-28s skipped\n", name.c_str());
+			continue;
+		}
+		imu_kind kind = imuKindFromName(path);
+		const char * stream = kind == IMU_GYRO ? "gyro" : kind == IMU_ACCEL ? "accel" : kind == IMU_ROTVECTOR ? "rotVector" : NULL;
+		if (!stream) {
+			name = name.substr(0, SESSION_NAME_SIZE - 1);
+			stream = name.c_str();
+		}
+		int s = writer.addStream(stream, log.columns, log.timed ? 1e-9 : 0,
+			quantum > 0 ? SESSION_QUANTIZED : SESSION_EXACT, quantum);
+		if (s < 0) {
+			printf("%-28s skipped (stream %s)\n", baseName(files[i]).c_str(), stream);
+			continue;
+		}
+		vector<long long> rowNumbers;
+		if (!log.timed) {
+			for (int r = 0; r < log.rows; r++) rowNumbers.push_back(r);
+		}
+		writer.appendColumns(s, log.timed ? log.t : &rowNumbers[0], log.v, log.rows);
+		printf("%-28s %s, %d rows, %d columns\n", baseName(files[i]).c_str(), stream, log.rows, log.columns);
+	}
+	freeImuLog(&log);
+	if (!writer.close()) {
+		printf("error writing %s\n", outPath);
+		return 1;
+	}
+	FILE * f = fopen(outPath, "rb");
+	fseek(f, 0, SEEK_END);
+	long long packed = ftell(f);
+	fclose(f);
+	printf("%lld bytes of text -> %lld bytes (%.1f%%)\n", textBytes, packed, textBytes ? 100.0 * packed / textBytes : 0);
+	return 0;
+}
+
+static int info(const char * path) {
+	struct session_file file;
+	memset(&file, 0, sizeof(file));
+	if (!openSession(path, &file)) {
+		printf("cannot read session %s\n", path);
+		return 1;
+	}
+	const struct session_file_header & h = *file.header;
+	printf("%d streams, %d chunks of up to %d rows, %lld bytes\n", h.streams, h.chunks, h.chunk_rows, (long long)file.size);
+	for (int s = 0; s < h.streams; s++) {
+		const struct session_stream & st = h.stream[s];
+		long long bytes = 0;
+		for (int i = 0; i < st.chunks; i++) bytes += file.index[st.first_chunk + i].bytes;
+		double seconds = 0;
+		if (st.chunks > 0) {
+			const struct session_chunk & first = file.index[st.first_chunk], & last = file.index[st.first_chunk + st.chunks - 1];
+			seconds = (last.t_last - first.t_first) * st.time_unit;
+		}
+		printf("%-16s %8lld rows %3d columns %4d chunks %9lld bytes (%5.2f per value) %7.1f s %s",
+			st.name, st.rows, st.columns, st.chunks, bytes, st.rows ? (double)bytes / (st.rows * (st.columns + 1)) : 0,
+			seconds, st.codec == SESSION_QUANTIZED ? "quantized" : "exact");
+		if (st.codec == SESSION_QUANTIZED) printf(" %g", st.quantum);
+		printf("\n");
+	}
+	closeSession(&file);
+	return 0;
+}
+
+static int cat(const char * path, const char * name, long long t0, long long t1) {
+	struct session_file file;
+	memset(&file, 0, sizeof(file));
+	if (!openSession(path, &file)) {
+		printf("cannot read session %s\n", path);
+		return 1;
+	}
+	int s = findSessionStream(file, name);
+	struct session_table table;
+	memset(&table, 0, sizeof(table));
+	if (s < 0 || !readSessionWindow(file, s, t0, t1, &table)) {
+		printf("cannot read stream %s\n", name);
+		closeSession(&file);
+		return 1;
+	}
+	for (int r = 0; r < table.rows; r++) {
+		printf("%lld", table.t[r]);
+		for (int c = 0; c < table.columns; c++) printf("\t%.9g", table.v[c][r]);
+		printf("\n");
+	}
+	freeSessionTable(&table);
+	closeSession(&file);
+	return 0;
+}
+
+int main(int argc, char ** argv) {
+	if (argc >= 4 && strcmp(argv[1], "pack") == 0) {
+		int rows = SESSION_CHUNK_ROWS;
+		double quantum = 0;
+		for (int i = 4; i + 1 < argc; i++) {
+			if (strcmp(argv[i], "-rows") == 0) rows = atoi(argv[++i]);
+			else if (strcmp(argv[i], "-quantum") == 0) quantum = atof(argv[++i]);
+		}
+		return pack(argv[2], argv[3], rows, quantum);
+	}
+	if (argc >= 3 && strcmp(argv[1], "info") == 0) return info(argv[2]);
+	if (argc >= 4 && strcmp(argv[1], "cat") == 0) {
+		long long t0 = argc >= 6 ? atoll(argv[4]) : -0x7FFFFFFFFFFFFFFFLL;
+		long long t1 = argc >= 6 ? atoll(argv[5]) : 0x7FFFFFFFFFFFFFFFLL;
+		return cat(argv[2], argv[3], t0, t1);
+	}
+	printf("usage: sessionPackTool pack session_dir out.kses [-rows n] [-quantum q]\n");
+	printf("       sessionPackTool info in.kses\n");
+	printf("       sessionPackTool cat in.kses stream [t0 t1]\n");
+	return 1;
+}
@@ -0,0 +1,119 @@
+/* *******************************************************************************
+ *	                              swingSegmentTool
+ *
+ * Runs a watch session through SwingDetector as if it arrived live: gyro
+ * and accel samples merged by time stamp, one at a time. Prints the swing
+ * events and, with -out, saves every swing window (start to end) as its
+ * own gyro log, keeping only a bounded ring of recent samples as a
+ * recorder would.
+ *
+ * Usage: swingSegmentTool session_gyro.txt [session_accel.txt] [-out prefix] [-axis n] [-impact m/s^2]
+ * Build: ../swingDetector.cpp ../imuLog.cpp
+ *********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../imuLog.h"
+#include "../swingDetector.h"
+
+const int RING_ROWS = 4096; // recent gyro samples kept (about 40 s at 100 Hz, more than max_lookback)
+
+struct gyro_row {
+	long long t;
+	float w[3];
+};
+
+static const char * eventName(swing_event_type type) {
+	switch (type) {
+	case SWING_START: return "start";
+	case SWING_TOP: return "top";
+	case SWING_IMPACT: return "impact";
+	case SWING_END: return "end";
+	default: return "cancel";
+	}
+}
+
+int main(int argc, char ** argv) {
+	if (argc < 2) {
+		printf("usage: swingSegmentTool session_gyro.txt [session_accel.txt] [-out prefix] [-axis n] [-impact m/s^2]\n");
+		return 1;
+	}
+	struct swing_params params;
+	defaultSwingParams(&params);
+	const char * accelPath = NULL;
+	const char * out = NULL;
+	for (int i = 2; i < argc; i++) {
+		if (strcmp(argv[i], "-out") == 0 && i + 1 < argc) out = argv[++i];
+		else if (strcmp(argv[i], "-axis") == 0 && i + 1 < argc) params.axis = atoi(argv[++i]);
+		else if (strcmp(argv[i], "-impact") == 0 && i + 1 < argc) params.impact_accel = (float)atof(argv[++i]);
+		else if (argv[i][0] != '-') accelPath = argv[i];
+	}
+	struct imu_log gyro, accel;
+	memset(&gyro, 0, sizeof(gyro));
+	memset(&accel, 0, sizeof(accel));
+	if (!loadImuLog(argv[1], &gyro) || !gyro.timed || gyro.columns != 3) {
+		printf("cannot read gyro log %s\n", argv[1]);
+		return 1;
+	}
+	if (accelPath && (!loadImuLog(accelPath, &accel) || !accel.timed || accel.columns != 3)) {
+		printf("cannot read accel log %s\n", accelPath);
+		return 1;
+	}
+
+	SwingDetector detector(params);
+	struct swing_event events[SWING_MAX_EVENTS];
+	static struct gyro_row ring[RING_ROWS];
+	long long received = 0;
+	long long swingStart = 0;
+	bool inSwing = false;
+	int saved = 0;
+	long long t0 = gyro.t[0];
+	int j = 0;
+	for (int i = 0; i < gyro.rows; i++) {
+		int n = 0;
+		for (; j < accel.rows && accel.t[j] <= gyro.t[i]; j++) {
+			float a[3] = { accel.v[0][j], accel.v[1][j], accel.v[2][j] };
+			n += detector.accel(accel.t[j], a, events + n);
+			if (n == SWING_MAX_EVENTS) break;
+		}
+		struct gyro_row & row = ring[received % RING_ROWS];
+		row.t = gyro.t[i];
+		for (int c = 0; c < 3; c++) row.w[c] = gyro.v[c][i];
+		received++;
+		struct swing_event more[SWING_MAX_EVENTS];
+		int m = detector.gyro(gyro.t[i], row.w, more);
+		for (int k = 0; k < m && n < SWING_MAX_EVENTS; k++) events[n++] = more[k];
+
+		for (int k = 0; k < n; k++) {
+			const struct swing_event & e = events[k];
+			printf("%8.3f s  %-7s angle %6.2f rad  peak %6.2f rad/s\n",
+				(e.t - t0) * params.time_unit, eventName(e.type), e.angle, e.peak_rate);
+			if (e.type == SWING_START) {
+				swingStart = e.t;
+				inSwing = true;
+			}
+			else if (e.type == SWING_CANCEL) inSwing = false;
+			else if (e.type == SWING_END && inSwing) {
+				inSwing = false;
+				if (!out) continue;
+				// the window is still in the ring: start is at most max_lookback back
+				char path[512];
+				snprintf(path, sizeof(path), "%s_%d_gyro.txt", out, ++saved);
+				FILE * f = fopen(path, "w");
+				if (!f) continue;
+				long long first = received > RING_ROWS ? received - RING_ROWS : 0;
+				for (long long r = first; r < received; r++) {
+					const struct gyro_row & s = ring[r % RING_ROWS];
+					if (s.t >= swingStart && s.t <= e.t) fprintf(f, "%lld\t%.9g\t%.9g\t%.9g\n", s.t, s.w[0], s.w[1], s.w[2]);
+				}
+				fclose(f);
+			}
+		}
+	}
+	printf("%d swings in %.1f s\n", detector.swings(), (gyro.t[gyro.rows - 1] - t0) * params.time_unit);
+	freeImuLog(&gyro);
+	freeImuLog(&accel);
+	return 0;
+}
@@ -0,0 +1,206 @@
+/* *******************************************************************************
+ *	                              timeSyncTool
+ *
+ * Time offset between a Kinect recording and a watch rotation vector log,
+ * the sync step of syncData.m / sync_kindata.m.
+ * Both are reduced to the arm direction: wrist - elbow from kindata.txt,
+ * the watch x axis (R * [1 0 0]) from the rotation vector, resampled to a
+ * common rate and low passed as in timeSync.m. By default the motion power
+ * (|change of direction|) is matched, which does not depend on how the two
+ * coordinate frames are rotated; -axes matches the three direction
+ * components instead, for recordings already in one frame.
+ * Prints the watch -> Kinect time offset: kinect_s = watch_ns * 1e-9 + offset_s,
+ * and the rotation K from the watch's world frame to camera space fitted
+ * over the aligned directions (fitRotationMatrix in syncData.m).
+ *
+ * Usage: timeSyncTool kindata.txt watch_rotVector.txt [-rate hz] [-cutoff c] [-axes]
+ * Build: ../timeSync.cpp ../rotationFit.cpp ../imuLog.cpp ../kindataLog.cpp
+ *********************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include "../imuLog.h"
+#include "../kindataLog.h"
+#include "../rotationFit.h"
+#include "../timeSync.h"
+
+using namespace std;
+
+// arm direction samples at their own times
+struct direction_track {
+	vector<double> t; // s
+	vector<float> v[3];
+};
+
+static bool addKinectArm(const struct kindata_arm & arm, void * user) {
+	struct direction_track & track = *(struct direction_track *)user;
+	if (!arm.body) return true;
+	track.t.push_back(arm.t);
+	for (int c = 0; c < 3; c++) track.v[c].push_back(arm.d[c]);
+	return true;
+}
+
+/* Wrist - elbow of the first body in kindata.txt (kindataLog), rows with a body only */
+static bool loadKinectArm(const char * path, struct direction_track & track) {
+	return readKindataArm(path, addKinectArm, &track) > 0 && !track.t.empty();
+}
+
+/* Watch x axis in the watch's world frame, from the Android rotation vector x y z w (quatToMat.m) */
+static bool loadWatchArm(const char * path, struct direction_track & track) {
+	struct imu_log log;
+	memset(&log, 0, sizeof(log));
+	if (!loadImuLog(path, &log) || !log.timed || log.columns < 4) {
+		freeImuLog(&log);
+		return false;
+	}
+	for (int i = 0; i < log.rows; i++) {
+		float x = log.v[0][i], y = log.v[1][i], z = log.v[2][i], w = log.v[3][i];
+		float n = sqrtf(x * x + y * y + z * z + w * w);
+		if (n <= 0) continue;
+		x /= n; y /= n; z /= n; w /= n;
+		track.t.push_back(log.t[i] * 1e-9);
+		track.v[0].push_back(1 - 2 * (y * y + z * z));
+		track.v[1].push_back(2 * (x * y + w * z));
+		track.v[2].push_back(2 * (x * z - w * y));
+	}
+	freeImuLog(&log);
+	return !track.t.empty();
+}
+
+/* Linear interpolation onto t0 + i / rate. Out of order samples are dropped */
+static void resample(const struct direction_track & track, double rate, double & t0, vector<float> out[3]) {
+	t0 = track.t[0];
+	double t1 = track.t.back();
+	int count = (int)floor((t1 - t0) * rate) + 1;
+	for (int c = 0; c < 3; c++) out[c].resize(count);
+	size_t j = 0;
+	for (int i = 0; i < count; i++) {
+		double t = t0 + i / rate;
+		while (j + 1 < track.t.size() && track.t[j + 1] <= t) j++;
+		size_t k = j + 1;
+		while (k < track.t.size() && track.t[k] <= track.t[j]) k++;
+		double a = k < track.t.size() ? (t - track.t[j]) / (track.t[k] - track.t[j]) : 0;
+		if (a < 0) a = 0;
+		for (int c = 0; c < 3; c++) {
+			float v0 = track.v[c][j];
+			float v1 = k < track.t.size() ? track.v[c][k] : v0;
+			out[c][i] = (float)(v0 + a * (v1 - v0));
+		}
+	}
+}
+
+int main(int argc, char ** argv) {
+	if (argc < 3) {
+		printf("usage: timeSyncTool kindata.txt watch_rotVector.txt [-rate hz] [-cutoff c] [-axes]\n");
+		return 1;
+	}
+	double rate = 100; // common_rate in syncData.m
+	double cutoff = 0.01; // butter(2, 0.01) in timeSync.m
+	bool axes = false;
+	for (int i = 3; i < argc; i++) {
+		if (strcmp(argv[i], "-rate") == 0 && i + 1 < argc) rate = atof(argv[++i]);
+		else if (strcmp(argv[i], "-cutoff") == 0 && i + 1 < argc) cutoff = atof(argv[++i]);
+		else if (strcmp(argv[i], "-axes") == 0) axes = true;
+	}
+	struct direction_track kinect, watch;
+	if (!loadKinectArm(argv[1], kinect)) {
+		printf("no left arm of the first body in %s\n", argv[1]);
+		return 1;
+	}
+	if (!loadWatchArm(argv[2], watch)) {
+		printf("cannot read %s\n", argv[2]);
+		return 1;
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	double kt0, wt0;
+	vector<float> k[3], w[3];
+	resample(kinect, rate, kt0, k);
+	resample(watch, rate, wt0, w);
+	vector<float> kRaw[3], wRaw[3];
+	for (int c = 0; c < 3; c++) {
+		kRaw[c] = k[c];
+		wRaw[c] = w[c];
+	}
+	for (int c = 0; c < 3; c++) {
+		lowPass(&k[c][0], (int)k[c].size(), cutoff);
+		lowPass(&w[c][0], (int)w[c].size(), cutoff);
+	}
+	vector<float> kPower(k[0].size() - 1), wPower(w[0].size() - 1);
+	const float * kc[3];
+	const float * wc[3];
+	int kn, wn, channels;
+	if (axes) {
+		for (int c = 0; c < 3; c++) {
+			kc[c] = &k[c][0];
+			wc[c] = &w[c][0];
+		}
+		kn = (int)k[0].size();
+		wn = (int)w[0].size();
+		channels = 3;
+	}
+	else {
+		if (kPower.empty() || wPower.empty()) {
+			printf("recordings too short\n");
+			return 1;
+		}
+		motionPower(&k[0][0], &k[1][0], &k[2][0], (int)k[0].size(), &kPower[0]);
+		motionPower(&w[0][0], &w[1][0], &w[2][0], (int)w[0].size(), &wPower[0]);
+		kc[0] = &kPower[0];
+		wc[0] = &wPower[0];
+		kn = (int)kPower.size();
+		wn = (int)wPower.size();
+		channels = 1;
+	}
+
+	// the shorter recording is searched for in the longer one
+	struct sync_workspace ws;
+	memset(&ws, 0, sizeof(ws));
+	struct sync_result result;
+	bool watchInside = wn <= kn;
+	bool ok = watchInside ? syncSignals(kc, kn, wc, wn, channels, &ws, &result)
+		: syncSignals(wc, wn, kc, kn, channels, &ws, &result);
+	freeSyncWorkspace(&ws);
+	if (!ok) {
+		printf("no motion to sync on\n");
+		return 1;
+	}
+	// kinect sample (i + offset) is watch sample i
+	double offset = watchInside ? result.offset : -result.offset;
+	double offsetS = kt0 + offset / rate - wt0;
+
+	// rotation over the overlap
+	int lag = watchInside ? result.lag : -result.lag;
+	int first = lag < 0 ? -lag : 0;
+	int last = (int)wRaw[0].size();
+	if (last + lag > (int)kRaw[0].size()) last = (int)kRaw[0].size() - lag;
+	const float * u[3];
+	const float * kd[3];
+	for (int c = 0; c < 3; c++) {
+		u[c] = &wRaw[c][first];
+		kd[c] = &kRaw[c][first + lag];
+	}
+	struct fit_params params;
+	defaultFitParams(&params);
+	struct fit_workspace fws;
+	memset(&fws, 0, sizeof(fws));
+	struct rotation_fit fit;
+	bool fitted = last > first && fitRotation(u, kd, last - first, params, &fws, &fit);
+	freeFitWorkspace(&fws);
+	double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+	printf("kinect %d samples, watch %d samples at %.0f Hz (%s)\n", kn, wn, rate, axes ? "axes" : "power");
+	printf("offset %.2f samples, score %.3f, %.1f ms\n", offset, result.score, ms);
+	printf("offset_s %.6f\n", offsetS);
+	if (fitted) {
+		printf("K (rms %.3f, %d of %d inliers)\n", fit.rms, fit.inliers, last - first);
+		for (int r = 0; r < 3; r++) printf("%9.5f %9.5f %9.5f\n", fit.R[r][0], fit.R[r][1], fit.R[r][2]);
+	}
+	return 0;
+}
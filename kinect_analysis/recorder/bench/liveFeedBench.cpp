@@ -0,0 +1,199 @@
+/* *******************************************************************************
+ *	                              liveFeedBench
+ *
+ * The live feed under load: one publisher thread publishes records (and a
+ * 960x540 frame with every frame_every-th) as fast as it can, or at a rate,
+ * while readers follow it through their own mappings, as separate
+ * processes would: fast readers that poll, one slow reader that sleeps a
+ * millisecond per record, and one frame reader that peeks at frames in
+ * place. Every record and frame (the pixels readers look at) is filled with
+ * its index, so a torn copy that passed the version check would show up as
+ * corrupt.
+ * Reports the publish cost (which must not depend on the readers) and per
+ * reader what was read, lost and corrupt.
+ *
+ * Usage: liveFeedBench [records] [fast readers] [rate per second, 0 = full speed]
+ * Build: ../liveFeed.cpp ../latencyStats.cpp ../recordWriter.cpp ../clockSync.cpp
+ *********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#include "../latencyStats.h"
+#include "../liveFeed.h"
+
+using namespace std;
+
+static const char * feed_name = "liveFeedBench";
+static const int frame_width = 960, frame_height = 540;
+static const int frame_every = 16; // records per frame
+static const size_t sample_step = 4099; // frame bytes looked at
+
+struct reader_result {
+	long long records;
+	long long lost;
+	long long corrupt;
+	long long frames; // frame reader: intact frames looked at
+	long long torn; // frame reader: frames overwritten while looking
+};
+
+static std::atomic<int> ready(0);
+static std::atomic<bool> go(false);
+
+/* Every value of a record holds its index */
+static void fillRecord(struct record_row * rec, long long index) {
+	rec->time = index;
+	rec->host_ns = index;
+	for (int m = 0; m < MAX_MARKERS; m++) {
+		rec->haveMarker[m] = true;
+		rec->marker[m].X = rec->marker[m].Y = rec->marker[m].Z = (float)index;
+	}
+	for (int b = 0; b < BODY_COUNT; b++) {
+		rec->bodyId[b] = index;
+		for (int j = 0; j < JointType_Count; j++) rec->joint[b][j].X = rec->joint[b][j].Y = rec->joint[b][j].Z = (float)index;
+	}
+}
+
+static bool recordIntact(const struct record_row & rec) {
+	float v = (float)rec.time;
+	if (rec.host_ns != rec.time) return false;
+	for (int m = 0; m < MAX_MARKERS; m++) {
+		if (rec.marker[m].X != v || rec.marker[m].Y != v || rec.marker[m].Z != v) return false;
+	}
+	for (int b = 0; b < BODY_COUNT; b++) {
+		if (rec.bodyId[b] != (unsigned long long)rec.time) return false;
+		for (int j = 0; j < JointType_Count; j++) {
+			if (rec.joint[b][j].X != v || rec.joint[b][j].Y != v || rec.joint[b][j].Z != v) return false;
+		}
+	}
+	return true;
+}
+
+static void readRecords(struct reader_result * r, bool slow) {
+	LiveFeedReader reader;
+	if (!reader.open(feed_name)) {
+		printf("cannot open the feed\n");
+		exit(1);
+	}
+	ready++;
+	while (!go) std::this_thread::yield();
+	struct record_row rec;
+	long long expected = 0;
+	for (;;) {
+		live_status status = reader.next(&rec);
+		if (status == LIVE_CLOSED) break;
+		if (status == LIVE_NONE) {
+			std::this_thread::yield();
+			continue;
+		}
+		r->records++;
+		if (!recordIntact(rec) || rec.time < expected) r->corrupt++;
+		expected = rec.time + 1;
+		if (slow) std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	r->lost = reader.lost();
+}
+
+static void readFrames(struct reader_result * r) {
+	LiveFeedReader reader;
+	if (!reader.open(feed_name)) {
+		printf("cannot open the feed\n");
+		exit(1);
+	}
+	ready++;
+	while (!go) std::this_thread::yield();
+	struct record_row rec;
+	for (;;) {
+		// the records only tell when the feed is closed
+		while (reader.next(&rec) == LIVE_RECORD) {}
+		if (reader.next(&rec) == LIVE_CLOSED) break;
+		long long ticket, record;
+		const unsigned char * pixels = reader.peekFrame(&ticket, &record);
+		if (!pixels) continue;
+		// what an analysis would do with the pixels: look at some of them
+		unsigned char first = pixels[0];
+		bool same = true;
+		for (size_t i = 0; i < (size_t)frame_width * frame_height * 4; i += sample_step) same = same && pixels[i] == first;
+		if (!reader.frameIntact(ticket)) {
+			r->torn++;
+			continue;
+		}
+		r->frames++;
+		if (!same || first != (unsigned char)record) r->corrupt++;
+	}
+}
+
+int main(int argc, char ** argv) {
+	long long records = argc > 1 ? atoll(argv[1]) : 100000;
+	int fastReaders = argc > 2 ? atoi(argv[2]) : 3;
+	double rate = argc > 3 ? atof(argv[3]) : 0;
+
+	struct record_schema schema;
+	defaultSchema(&schema);
+	LiveFeedPublisher publisher;
+	if (!publisher.open(feed_name, schema, frame_width, frame_height)) {
+		printf("cannot create the feed\n");
+		return 1;
+	}
+	int readers = fastReaders + 2;
+	vector<struct reader_result> results(readers);
+	memset(&results[0], 0, readers * sizeof(struct reader_result));
+	vector<std::thread> threads;
+	for (int i = 0; i < fastReaders; i++) threads.push_back(std::thread(readRecords, &results[i], false));
+	threads.push_back(std::thread(readRecords, &results[fastReaders], true));
+	threads.push_back(std::thread(readFrames, &results[fastReaders + 1]));
+	while (ready < readers) std::this_thread::yield();
+
+	vector<unsigned char> frame((size_t)frame_width * frame_height * 4);
+	struct record_row rec;
+	memset(&rec, 0, sizeof(rec));
+	LatencyHistogram recordTime, frameTime;
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	go = true;
+	for (long long i = 0; i < records; i++) {
+		if (rate > 0) std::this_thread::sleep_until(start + std::chrono::duration<double>(i / rate));
+		fillRecord(&rec, i);
+		long long t0 = timerTicks();
+		publisher.publish(rec);
+		recordTime.record(timerTicks() - t0);
+		if (i % frame_every == 0) {
+			for (size_t k = 0; k < frame.size(); k += sample_step) frame[k] = (unsigned char)i;
+			t0 = timerTicks();
+			publisher.publishFrame(&frame[0], frame_width * 4, i);
+			frameTime.record(timerTicks() - t0);
+		}
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	publisher.close();
+	for (size_t i = 0; i < threads.size(); i++) threads[i].join();
+
+	printf("%lld records of %d bytes and %lld frames of %d bytes in %.2f s, %d readers\n", records, (int)sizeof(rec),
+		(records + frame_every - 1) / frame_every, frame_width * frame_height * 4, seconds, readers);
+	struct latency_snapshot snap;
+	struct latency_summary s;
+	recordTime.snapshot(&snap);
+	summarizeLatency(snap, NULL, &s);
+	printf("publish record  %8.0f ns mean %8.0f p50 %8.0f p99 %8.0f max\n", s.mean, s.p50, s.p99, s.max);
+	frameTime.snapshot(&snap);
+	summarizeLatency(snap, NULL, &s);
+	printf("publish frame   %8.0f ns mean %8.0f p50 %8.0f p99 %8.0f max\n", s.mean, s.p50, s.p99, s.max);
+	long long corrupt = 0;
+	for (int i = 0; i < readers; i++) {
+		const struct reader_result & r = results[i];
+		const char * kind = i < fastReaders ? "fast" : i == fastReaders ? "slow" : "frames";
+		if (i <= fastReaders) {
+			printf("reader %d %-6s %10lld records %10lld lost %6lld corrupt\n", i, kind, r.records, r.lost, r.corrupt);
+		}
+		else {
+			printf("reader %d %-6s %10lld frames  %10lld torn %6lld corrupt\n", i, kind, r.frames, r.torn, r.corrupt);
+		}
+		corrupt += r.corrupt;
+	}
+	return corrupt ? 1 : 0;
+}
@@ -0,0 +1,138 @@
+/* *******************************************************************************
+ *	                              markerKernelBench
+ *
+ * Microbenchmark of the fused marker threshold kernel against the OpenCV chain
+ * it replaces (resize, cvtColor, inRange, erode x2, dilate x2).
+ * Frames are synthetic 1920x1080 BGRA: noise plus a marker colored blob.
+ * Also checks that OpenCV, scalar and AVX2 masks are identical, and times the
+ * blob search (findContours + moments against the run labeler).
+ *
+ * Usage: markerKernelBench [iterations]
+ * Build: the recorder sources markerKernel.cpp markerBlobs.cpp markerTracker.cpp and OpenCV
+ *********************************************************************************/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <chrono>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "../markerKernel.h"
+#include "../markerTracker.h"
+
+using namespace std;
+using namespace cv;
+
+// the range used for recording so far (loadHSVRange)
+static const struct hsv_range range = { 76, 102, 112, 256, 171, 256 };
+
+/* Noise with a filled circle of marker color and some stray marker colored pixels */
+static void makeFrame(unsigned char * bgra, int cx, int cy, int radius) {
+	for (int y = 0; y < c_height; y++) {
+		for (int x = 0; x < c_width; x++) {
+			unsigned char * p = bgra + ((size_t)y * c_width + x) * 4;
+			int dx = x - cx, dy = y - cy;
+			if (dx * dx + dy * dy < radius * radius || rand() % 64 == 0) {
+				p[0] = 220 + rand() % 30;
+				p[1] = 150 + rand() % 40;
+				p[2] = 20 + rand() % 20;
+			}
+			else {
+				p[0] = rand() % 256;
+				p[1] = rand() % 256;
+				p[2] = rand() % 256;
+			}
+			p[3] = 255;
+		}
+	}
+}
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double elapsedNs(bench_clock::time_point start, int iterations) {
+	return std::chrono::duration<double, std::nano>(bench_clock::now() - start).count() / iterations;
+}
+
+/* Time both paths on one search window (rectangle in small image pixels) */
+static void benchWindow(const char * name, const unsigned char * bgra, Rect window, int iterations) {
+	Mat full(c_height, c_width, CV_8UC4, (void *)bgra);
+	Mat small, cvMask, kernelMask;
+	struct marker_mask mask;
+	memset(&mask, 0, sizeof(mask));
+	struct bgra_view view = makeBgraView(bgra, c_width, small_step, window.x, window.y, window.width, window.height);
+
+	// correctness first
+	resize(full, small, Size(s_width, s_height), 0, 0, INTER_NEAREST);
+	thresholdMarkerCv(small(window), range, cvMask);
+	thresholdMarker(view, range, &mask, KERNEL_SCALAR);
+	maskToMat(mask, kernelMask);
+	bool scalarSame = countNonZero(cvMask != kernelMask) == 0;
+	bool avx2Same = true;
+	if (haveAvx2()) {
+		thresholdMarker(view, range, &mask, KERNEL_AVX2);
+		maskToMat(mask, kernelMask);
+		avx2Same = countNonZero(cvMask != kernelMask) == 0;
+	}
+
+	bench_clock::time_point start = bench_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		resize(full, small, Size(s_width, s_height), 0, 0, INTER_NEAREST);
+		thresholdMarkerCv(small(window), range, cvMask);
+	}
+	double cvNs = elapsedNs(start, iterations);
+
+	start = bench_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		thresholdMarker(view, range, &mask, KERNEL_SCALAR);
+	}
+	double scalarNs = elapsedNs(start, iterations);
+
+	double avx2Ns = 0;
+	if (haveAvx2()) {
+		start = bench_clock::now();
+		for (int i = 0; i < iterations; i++) {
+			thresholdMarker(view, range, &mask, KERNEL_AVX2);
+		}
+		avx2Ns = elapsedNs(start, iterations);
+	}
+
+	printf("%-6s %4dx%-4d opencv %9.0f ns  scalar %9.0f ns  avx2 %9.0f ns  speedup %5.1fx  identical: scalar %s avx2 %s\n",
+		name, window.width, window.height, cvNs, scalarNs, avx2Ns, cvNs / (avx2Ns > 0 ? avx2Ns : scalarNs),
+		scalarSame ? "yes" : "NO", avx2Same ? "yes" : "NO");
+
+	// blob search on the same mask
+	struct blob_labeler labeler;
+	memset(&labeler, 0, sizeof(labeler));
+	struct marker_blob blobs[MAX_MARKER_BLOBS];
+	int nBlobs = 0;
+	int cvX = -1, cvY = -1, blobX = -1, blobY = -1;
+	start = bench_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		trackFilteredObject(cvX, cvY, cvMask);
+	}
+	double contoursNs = elapsedNs(start, iterations);
+	start = bench_clock::now();
+	for (int i = 0; i < iterations; i++) {
+		findMarker(blobX, blobY, mask, &labeler, blobs, &nBlobs);
+	}
+	double blobsNs = elapsedNs(start, iterations);
+	printf("%-6s blobs      contours %9.0f ns  labeler %9.0f ns  speedup %5.1fx  marker %d,%d / %d,%d\n",
+		name, contoursNs, blobsNs, contoursNs / blobsNs, cvX, cvY, blobX, blobY);
+	freeBlobLabeler(&labeler);
+	freeMask(&mask);
+}
+
+int main(int argc, char** argv) {
+	int iterations = argc > 1 ? atoi(argv[1]) : 200;
+	vector<unsigned char> bgra((size_t)c_width * c_height * 4);
+	srand(1);
+	makeFrame(bgra.data(), 1100, 500, 60);
+
+	printf("avx2 %s, %d iterations\n", haveAvx2() ? "available" : "not available", iterations);
+	benchWindow("full", bgra.data(), Rect(0, 0, s_width, s_height), iterations);
+	benchWindow("local", bgra.data(), Rect(550 - local_size, 250 - local_size, 2 * local_size, 2 * local_size), iterations);
+	return 0;
+}
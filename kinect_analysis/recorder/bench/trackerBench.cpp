@@ -0,0 +1,370 @@
+/* *******************************************************************************
+ *	                              trackerBench
+ *
+ * Per frame cost of the tracker's hot paths, to show that a change is a win
+ * before it goes to the capture rig. Runs the work of the tracker's stages
+ * frame by frame on one thread: the preview resize, the marker search, the
+ * extract stage (writeMarker / writeBodies) and RecordWriter::append, and
+ * after the last frame the text export (exportKindata, which replaced
+ * saveRecordedData). Frames come from
+ * - a synthetic scene: 1920x1080 BGRA sensor noise with stray marker colored
+ *   pixels, a marker swinging on a pendulum arc that passes behind an
+ *   occluder, a camera space plane for the depth lookups and two bodies
+ *   whose left arm follows the swing (all 25 joints recorded)
+ * - and optionally a capture file (see CaptureWriter)
+ * in four search modes:
+ *	opencv   the old chain every frame: cvtColor, inRange, morphOps, trackFilteredObject
+ *	full     fused kernel and blob labeler on the whole frame, every frame
+ *	local    MarkerSearch SEARCH_FIXED: square around the last position, full frame when lost
+ *	predict  MarkerSearch SEARCH_PREDICT
+ * Reports ns per frame of every step, operator new calls per frame (all
+ * threads; OpenCV's own allocator is not counted), frames/s of the whole per
+ * frame work (frame generation is not timed) and, for the synthetic scene,
+ * how often and how exactly the marker was found. The scene is seeded, so
+ * two builds see the same frames. The tracker only downscales the frames it
+ * shows, so the resize counts in the total of the opencv mode only, whose
+ * chain works on the downscaled image.
+ *
+ * Usage: trackerBench [frames] [capture file]
+ * Build: the recorder sources frameSource.cpp replaySource.cpp recordWriter.cpp recordExtract.cpp clockSync.cpp
+ *        markerKernel.cpp markerBlobs.cpp markerTracker.cpp markerSearch.cpp latencyStats.cpp and OpenCV
+ *********************************************************************************/
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <new>
+#include <vector>
+
+#include <opencv2/opencv.hpp>
+
+#include "../clockSync.h"
+#include "../frameSource.h"
+#include "../markerSearch.h"
+#include "../recordExtract.h"
+#include "../recordWriter.h"
+
+using namespace std;
+using namespace cv;
+
+static std::atomic<long long> allocations(0);
+
+void * operator new(size_t size) {
+	allocations++;
+	void * p = malloc(size ? size : 1);
+	if (!p) throw std::bad_alloc();
+	return p;
+}
+
+void operator delete(void * p) noexcept {
+	free(p);
+}
+
+// the range used for recording so far (loadHSVRange)
+static const struct hsv_range range = { 76, 102, 112, 256, 171, 256 };
+
+static const char * record_path = "trackerBench.bin";
+static const char * text_path = "trackerBench.txt";
+
+static const double pi = 3.14159265358979323846;
+
+// synthetic scene, color image pixels and seconds
+static const int backgrounds = 4; // noise frames, cycled
+static const double frame_time = 1.0 / 30;
+static const double pivot_x = 960, pivot_y = 60, arm_length = 720;
+static const double swing_amplitude = 0.9; // rad
+static const double swing_period = 1.6;
+static const int marker_radius = 40;
+static const int occluder_left = 1300, occluder_right = 1420; // a post the marker passes behind
+static const float plane_z = 2.5f; // m
+static const float focal = 1050; // px
+
+/* Pendulum angle at time t */
+static double swingAngle(double t) {
+	return swing_amplitude * sin(2 * pi * t / swing_period);
+}
+
+static void markerPixel(unsigned char * p) {
+	p[0] = 220 + rand() % 30;
+	p[1] = 150 + rand() % 40;
+	p[2] = 20 + rand() % 20;
+	p[3] = 255;
+}
+
+/* The synthetic scene as a frame source */
+class SyntheticSource : public FrameSource {
+public:
+	SyntheticSource(int frames);
+	frame_status acquire(struct kinect_frame & frame);
+	double true_x, true_y; // marker center of the last frame, small image pixels
+	bool visible; // marker not behind the occluder
+private:
+	int frames;
+	int next;
+	vector<unsigned char> background[backgrounds];
+	vector<unsigned char> rgb;
+	vector<CameraSpacePoint> xyz;
+};
+
+SyntheticSource::SyntheticSource(int frames) : true_x(0), true_y(0), visible(false), frames(frames), next(0) {
+	srand(1);
+	for (int b = 0; b < backgrounds; b++) {
+		background[b].resize((size_t)c_width * c_height * 4);
+		for (int y = 0; y < c_height; y++) {
+			for (int x = 0; x < c_width; x++) {
+				unsigned char * p = &background[b][((size_t)y * c_width + x) * 4];
+				if (x >= occluder_left && x < occluder_right) {
+					p[0] = 40 + rand() % 8;
+					p[1] = 40 + rand() % 8;
+					p[2] = 48 + rand() % 8;
+					p[3] = 255;
+				}
+				else if (rand() % 64 == 0) {
+					markerPixel(p);
+				}
+				else {
+					p[0] = rand() % 256;
+					p[1] = rand() % 256;
+					p[2] = rand() % 256;
+					p[3] = 255;
+				}
+			}
+		}
+	}
+	rgb.resize((size_t)c_width * c_height * 4);
+	xyz.resize((size_t)c_width * c_height);
+	for (int y = 0; y < c_height; y++) {
+		for (int x = 0; x < c_width; x++) {
+			CameraSpacePoint & p = xyz[(size_t)y * c_width + x];
+			p.X = (x - c_width / 2) / focal * plane_z;
+			p.Y = (c_height / 2 - y) / focal * plane_z;
+			p.Z = plane_z;
+		}
+	}
+}
+
+frame_status SyntheticSource::acquire(struct kinect_frame & frame) {
+	if (next >= frames) return FRAME_END;
+	double t = next * frame_time;
+	double a = swingAngle(t);
+	double cx = pivot_x + arm_length * sin(a);
+	double cy = pivot_y + arm_length * cos(a);
+	memcpy(&rgb[0], &background[next % backgrounds][0], rgb.size());
+	int hidden = 0, pixels = 0;
+	for (int y = (int)cy - marker_radius; y <= (int)cy + marker_radius; y++) {
+		for (int x = (int)cx - marker_radius; x <= (int)cx + marker_radius; x++) {
+			if (x < 0 || y < 0 || x >= c_width || y >= c_height) continue;
+			if ((x - cx) * (x - cx) + (y - cy) * (y - cy) > marker_radius * marker_radius) continue;
+			pixels++;
+			if (x >= occluder_left && x < occluder_right) hidden++;
+			else markerPixel(&rgb[((size_t)y * c_width + x) * 4]);
+		}
+	}
+	true_x = cx * small_ratio;
+	true_y = cy * small_ratio;
+	visible = hidden == 0;
+
+	frame.time = (long long)(t * 1e7);
+	frame.rgb = &rgb[0];
+	frame.depth = NULL;
+	frame.xyz = &xyz[0];
+	// two standing bodies, the first one's left arm swings the marker
+	frame.bodies = 2;
+	for (int b = 0; b < frame.bodies; b++) {
+		struct kinect_body & body = frame.body[b];
+		body.id = 72057594037930000ULL + b;
+		for (int j = 0; j < JointType_Count; j++) {
+			Joint & joint = body.joints[j];
+			joint.JointType = (JointType)j;
+			joint.TrackingState = TrackingState_Tracked;
+			joint.Position.X = (float)(b * 0.8 - 0.4 + 0.02 * (j % 5) + 0.001 * (rand() % 10));
+			joint.Position.Y = (float)(0.6 - 0.07 * j + 0.001 * (rand() % 10));
+			joint.Position.Z = (float)(plane_z - 0.3 + 0.001 * (rand() % 10));
+		}
+		if (b > 0) continue;
+		const CameraSpacePoint & shoulder = body.joints[JointType_ShoulderLeft].Position;
+		const int arm[3] = { JointType_ElbowLeft, JointType_WristLeft, JointType_HandLeft };
+		for (int k = 0; k < 3; k++) {
+			CameraSpacePoint & p = body.joints[arm[k]].Position;
+			double r = 0.3 * (k + 1);
+			p.X = (float)(shoulder.X + r * sin(a));
+			p.Y = (float)(shoulder.Y - r * cos(a));
+			p.Z = shoulder.Z;
+		}
+	}
+	next++;
+	return FRAME_NEW;
+}
+
+/* --------------------------------------------------
+	Per frame work
+-------------------------------------------------- */
+
+enum bench_mode {
+	MODE_OPENCV,
+	MODE_FULL,
+	MODE_LOCAL,
+	MODE_PREDICT,
+	MODE_COUNT
+};
+static const char * mode_names[MODE_COUNT] = { "opencv", "full", "local", "predict" };
+
+struct bench_result {
+	int frames;
+	double resize, search, extract, record; // ns, all frames
+	double export_ns;
+	long long allocations;
+	int found;
+	int visible; // synthetic: frames with the marker in view
+	int hits; // synthetic: found while visible, within marker_radius of the truth
+	double error; // synthetic: px (small image), summed over hits
+};
+
+typedef std::chrono::steady_clock bench_clock;
+
+static double ns(bench_clock::time_point a, bench_clock::time_point b) {
+	return std::chrono::duration<double, std::nano>(b - a).count();
+}
+
+/* Every frame of source through one mode. synthetic is the source if it is the synthetic scene */
+static void runMode(FrameSource * source, SyntheticSource * synthetic, bench_mode mode, struct bench_result * r) {
+	memset(r, 0, sizeof(*r));
+	struct record_schema schema;
+	defaultSchema(&schema);
+	schema.bodies = 2;
+	schema.joints = JointType_Count;
+	for (int j = 0; j < JointType_Count; j++) schema.joint_ids[j] = j;
+
+	struct kinect_frame frame;
+	memset(&frame, 0, sizeof(frame));
+	struct record_row rec;
+	memset(&rec, 0, sizeof(rec));
+	struct body_slots slots;
+	memset(&slots, 0, sizeof(slots));
+	Mat small, thresImg;
+	struct marker_mask mask;
+	memset(&mask, 0, sizeof(mask));
+	struct blob_labeler labeler;
+	memset(&labeler, 0, sizeof(labeler));
+	struct marker_blob blobs[MAX_MARKER_BLOBS];
+	int nBlobs = 0;
+	MarkerSearch search;
+	search.setRange(range);
+	search.setMode(mode == MODE_PREDICT ? SEARCH_PREDICT : SEARCH_FIXED);
+	{
+		RecordWriter recorder;
+		if (!recorder.start(record_path, NULL, schema)) {
+			printf("cannot write %s\n", record_path);
+			exit(1);
+		}
+		while (source->acquire(frame) == FRAME_NEW) {
+			GetSystemTime(&rec.st);
+			rec.time = frame.time;
+			rec.host_ns = frame.time * 100;
+			long long allocated = allocations;
+			bench_clock::time_point t0 = bench_clock::now();
+			Mat full(c_height, c_width, CV_8UC4, (void *)frame.rgb);
+			resize(full, small, Size(s_width, s_height), 0, 0, INTER_NEAREST);
+			bench_clock::time_point t1 = bench_clock::now();
+			int x = -1, y = -1;
+			bool found;
+			if (mode == MODE_OPENCV) {
+				thresholdMarkerCv(small, range, thresImg);
+				found = trackFilteredObject(x, y, thresImg);
+			}
+			else if (mode == MODE_FULL) {
+				thresholdMarker(makeBgraView(frame.rgb, c_width, small_step, 0, 0, s_width, s_height), range, &mask);
+				found = findMarker(x, y, mask, &labeler, blobs, &nBlobs);
+			}
+			else {
+				found = search.search(frame.rgb, frame.time, x, y);
+			}
+			bench_clock::time_point t2 = bench_clock::now();
+			if (found) writeMarker(&rec, source, frame, 0, x / small_ratio, y / small_ratio);
+			else rec.haveMarker[0] = false;
+			writeBodies(&rec, schema, frame, &slots);
+			bench_clock::time_point t3 = bench_clock::now();
+			recorder.append(rec, true);
+			bench_clock::time_point t4 = bench_clock::now();
+			r->allocations += allocations - allocated;
+			r->resize += ns(t0, t1);
+			r->search += ns(t1, t2);
+			r->extract += ns(t2, t3);
+			r->record += ns(t3, t4);
+			r->frames++;
+			if (found) r->found++;
+			if (synthetic && synthetic->visible) {
+				r->visible++;
+				double e = hypot(x - synthetic->true_x, y - synthetic->true_y);
+				if (found && e < marker_radius * small_ratio) {
+					r->hits++;
+					r->error += e;
+				}
+			}
+		}
+		recorder.stop();
+		// the writer finishes the file when it is destroyed
+	}
+	bench_clock::time_point start = bench_clock::now();
+	if (!exportKindata(record_path, text_path)) printf("cannot export %s\n", record_path);
+	r->export_ns = ns(start, bench_clock::now());
+	remove(record_path);
+	remove(text_path);
+	freeMask(&mask);
+	freeBlobLabeler(&labeler);
+}
+
+static void printResult(bench_mode mode, const struct bench_result & r) {
+	if (r.frames == 0) return;
+	double n = r.frames;
+	double total = ((mode == MODE_OPENCV ? r.resize : 0) + r.search + r.extract + r.record) / n;
+	printf("%-8s %9.0f %9.0f %9.0f %9.0f %10.0f %8.2f %8.1f %6.1f%%", mode_names[mode], r.resize / n, r.search / n,
+		r.extract / n, r.record / n, total, r.allocations / n, 1e9 / total, 100.0 * r.found / n);
+	if (r.visible > 0) {
+		printf(" %6.1f%% %6.2f", 100.0 * r.hits / r.visible, r.hits ? r.error / r.hits : 0);
+	}
+	printf(" %9.0f\n", r.export_ns / n);
+}
+
+static void printHeader(bool synthetic) {
+	printf("%-8s %9s %9s %9s %9s %10s %8s %8s %7s", "ns/frame", "resize", "search", "extract", "record", "total",
+		"allocs", "fps", "found");
+	if (synthetic) printf(" %7s %6s", "tracked", "err px");
+	printf(" %9s\n", "export");
+}
+
+int main(int argc, char ** argv) {
+	int frames = argc > 1 ? atoi(argv[1]) : 300;
+	const char * capture = argc > 2 ? argv[2] : NULL;
+
+	printf("avx2 %s, %d synthetic frames of %dx%d (swing %.1f s, marker behind the post at the ends)\n",
+		haveAvx2() ? "available" : "not available", frames, c_width, c_height, swing_period);
+	printHeader(true);
+	for (int m = 0; m < MODE_COUNT; m++) {
+		struct bench_result r;
+		SyntheticSource source(frames);
+		runMode(&source, &source, (bench_mode)m, &r);
+		printResult((bench_mode)m, r);
+	}
+
+	if (capture) {
+		printf("capture %s\n", capture);
+		printHeader(false);
+		for (int m = 0; m < MODE_COUNT; m++) {
+			FrameSource * source = openReplaySource(capture, false);
+			if (!source) {
+				printf("cannot read %s\n", capture);
+				return 1;
+			}
+			struct bench_result r;
+			runMode(source, NULL, (bench_mode)m, &r);
+			delete source;
+			printResult((bench_mode)m, r);
+		}
+	}
+	return 0;
+}
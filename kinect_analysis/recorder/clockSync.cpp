@@ -0,0 +1,121 @@
+/* *******************************************************************************
+ *	                              clockSync.cpp
+ *
+ * The fit is on y = device - host (ns, after removing the first sample)
+ * against host seconds, which keeps the normal equations well conditioned
+ * over hours. Samples are weighted by 1 / uncertainty^2. Once the fit is
+ * settled, a sample further than 4 sigma from it (a delayed handshake
+ * reply, a frame that waited in a queue) is rejected.
+ *********************************************************************************/
+
+#include "clockSync.h"
+
+#include <stdio.h>
+#include <math.h>
+
+#include <chrono>
+
+static const double min_uncertainty_ns = 1000; // 1 us, floor for exact looking pairs
+static const int settle_samples = 8; // samples before outliers are rejected
+static const double reject_sigmas = 4;
+
+long long hostNs() {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+ClockSync::ClockSync(double halfLife) {
+	lambda = halfLife > 0 ? pow(0.5, 1 / halfLife) : 1;
+	reset();
+}
+
+void ClockSync::reset() {
+	host_ref = device_ref = 0;
+	sw = sx = sy = sxx = sxy = syy = 0;
+	a = b = 0;
+	n_samples = 0;
+	n_rejected = 0;
+}
+
+bool ClockSync::addPair(long long host_ns, long long device_ns, long long uncertainty_ns) {
+	if (n_samples == 0) {
+		host_ref = host_ns;
+		device_ref = device_ns;
+	}
+	double x = (host_ns - host_ref) * 1e-9;
+	double y = (double)((device_ns - device_ref) - (host_ns - host_ref));
+	double u = uncertainty_ns > min_uncertainty_ns ? (double)uncertainty_ns : min_uncertainty_ns;
+	if (n_samples >= settle_samples) {
+		double limit = reject_sigmas * (u > residualNs() ? u : residualNs());
+		if (fabs(y - (a + b * x)) > limit) {
+			n_rejected++;
+			return false;
+		}
+	}
+	double w = 1 / (u * u);
+	sw = lambda * sw + w;
+	sx = lambda * sx + w * x;
+	sy = lambda * sy + w * y;
+	sxx = lambda * sxx + w * x * x;
+	sxy = lambda * sxy + w * x * y;
+	syy = lambda * syy + w * y * y;
+	n_samples++;
+	solve();
+	return true;
+}
+
+bool ClockSync::addExchange(long long host_send_ns, long long device_ns, long long host_recv_ns) {
+	if (host_recv_ns < host_send_ns) return false;
+	long long half = (host_recv_ns - host_send_ns) / 2;
+	return addPair(host_send_ns + half, device_ns, half);
+}
+
+void ClockSync::solve() {
+	double det = sw * sxx - sx * sx;
+	// a single sample or samples at one instant: offset only
+	if (n_samples < 2 || det <= 1e-12 * sw * sxx) {
+		b = 0;
+		a = sy / sw;
+		return;
+	}
+	b = (sw * sxy - sx * sy) / det;
+	a = (sy - b * sx) / sw;
+}
+
+double ClockSync::residualNs() const {
+	if (sw <= 0) return 0;
+	// sum w (y - a - b x)^2 expanded
+	double r = syy - 2 * a * sy - 2 * b * sxy + a * a * sw + 2 * a * b * sx + b * b * sxx;
+	return r > 0 ? sqrt(r / sw) : 0;
+}
+
+double ClockSync::offsetNs(long long host_ns) const {
+	double x = (host_ns - host_ref) * 1e-9;
+	return (double)(device_ref - host_ref) + a + b * x;
+}
+
+long long ClockSync::toDevice(long long host_ns) const {
+	double x = (host_ns - host_ref) * 1e-9;
+	return device_ref + (host_ns - host_ref) + (long long)llround(a + b * x);
+}
+
+long long ClockSync::toHost(long long device_ns) const {
+	// device - device_ref = dx + a + b dx / 1e9, dx = host - host_ref in ns
+	double dx = ((device_ns - device_ref) - a) / (1 + b * 1e-9);
+	return host_ref + (long long)llround(dx);
+}
+
+int loadClockSync(const char * path, ClockSync & sync) {
+	FILE * in = fopen(path, "r");
+	if (!in) return -1;
+	char line[256];
+	int used = 0;
+	while (fgets(line, sizeof(line), in)) {
+		long long v[3];
+		int n = sscanf(line, "%lld %lld %lld", &v[0], &v[1], &v[2]);
+		if (n == 3) used += sync.addExchange(v[0], v[1], v[2]) ? 1 : 0;
+		else if (n == 2) used += sync.addPair(v[0], v[1], 0) ? 1 : 0;
+	}
+	fclose(in);
+	return used;
+}
@@ -0,0 +1,58 @@
+/* *******************************************************************************
+ *	                              clockSync.h
+ *
+ * Host clock <-> device clock mapping.
+ * All host times are steady (monotonic) nanoseconds from hostNs(). A device
+ * clock (Kinect relative time, the watch's or phone's sensor time stamps)
+ * is modeled as device = host + offset + drift * host. The estimate is a
+ * weighted least squares fit over (host, device) pairs, updated per sample,
+ * optionally forgetting old samples so a drifting clock is followed.
+ * Pairs come from
+ * - a handshake: host send time, device time, host receive time; the pair
+ *   is the midpoint, uncertain by half the round trip
+ * - direct observations (a frame's device time and its arrival on the host)
+ * - an offset found by cross-correlating two recordings
+ * so merged recordings are aligned without searching for the offset.
+ *********************************************************************************/
+
+#pragma once
+
+/* Steady host clock in nanoseconds */
+long long hostNs();
+
+class ClockSync {
+public:
+	/* halfLife: samples after which an old sample counts half, 0 never forgets */
+	ClockSync(double halfLife = 0);
+	void reset();
+	/* One observation: device clock read device_ns at host time host_ns, +- uncertainty_ns */
+	bool addPair(long long host_ns, long long device_ns, long long uncertainty_ns);
+	/* One handshake: host sent at host_send_ns, device stamped device_ns, reply arrived at host_recv_ns */
+	bool addExchange(long long host_send_ns, long long device_ns, long long host_recv_ns);
+	bool valid() const { return n_samples > 0; }
+	long long toDevice(long long host_ns) const;
+	long long toHost(long long device_ns) const;
+	/* device - host at host time host_ns */
+	double offsetNs(long long host_ns) const;
+	/* Device clock rate error, e.g. 20e-6 = device runs 20 ppm fast */
+	double drift() const { return b * 1e-9; }
+	/* Weighted rms of the residuals */
+	double residualNs() const;
+	int samples() const { return n_samples; }
+	int rejected() const { return n_rejected; }
+private:
+	void solve();
+
+	double lambda; // forgetting factor per sample
+	long long host_ref, device_ref; // first sample, keeps the sums small
+	// weighted sums of x = host seconds since host_ref, y = (device - device_ref) - (host - host_ref) in ns
+	double sw, sx, sy, sxx, sxy, syy;
+	double a, b; // y = a + b x
+	int n_samples;
+	int n_rejected;
+};
+
+/* Feed a text file of sync samples into sync. Each line is either
+   "host_send_ns device_ns host_recv_ns" (handshake) or "host_ns device_ns" (pair).
+   Returns the number of samples used, -1 if the file cannot be read */
+int loadClockSync(const char * path, ClockSync & sync);
@@ -0,0 +1,53 @@
+/* *******************************************************************************
+ *	                              frameSource.cpp
+ *
+ * Point lookup shared by the FrameSource backends.
+ *********************************************************************************/
+
+#include "frameSource.h"
+
+#include <algorithm>
+#include <cmath>
+
+static bool zLess(const CameraSpacePoint & a, const CameraSpacePoint & b) {
+	return a.Z < b.Z;
+}
+
+bool medianCameraPoint(CameraSpacePoint * points, int count, CameraSpacePoint & point) {
+	// keep the valid samples at the front (also drops NaN and -inf of unmapped pixels)
+	int n = 0;
+	for (int i = 0; i < count; i++) {
+		if (points[i].Z > 0 && std::isfinite(points[i].X) && std::isfinite(points[i].Y) && std::isfinite(points[i].Z)) {
+			points[n++] = points[i];
+		}
+	}
+	if (n == 0) return false;
+	std::nth_element(points, points + n / 2, points + n, zLess);
+	float z = points[n / 2].Z;
+	// the direction of the queried pixel is the mean of the sample directions
+	double dx = 0, dy = 0;
+	for (int i = 0; i < n; i++) {
+		dx += points[i].X / points[i].Z;
+		dy += points[i].Y / points[i].Z;
+	}
+	point.X = (float)(dx / n * z);
+	point.Y = (float)(dy / n * z);
+	point.Z = z;
+	return true;
+}
+
+bool FrameSource::mapColorPoint(const struct kinect_frame & kf, float x, float y, CameraSpacePoint & point) {
+	if (!kf.xyz) return false;
+	CameraSpacePoint samples[(2 * depth_radius + 1) * (2 * depth_radius + 1)];
+	int cx = (int)x, cy = (int)y;
+	int n = 0;
+	for (int v = cy - depth_radius; v <= cy + depth_radius; v++) {
+		if (v < 0 || v >= c_height) continue;
+		for (int u = cx - depth_radius; u <= cx + depth_radius; u++) {
+			if (u < 0 || u >= c_width) continue;
+			if ((u - cx) * (u - cx) + (v - cy) * (v - cy) > depth_radius * depth_radius) continue;
+			samples[n++] = kf.xyz[(size_t)v * c_width + u];
+		}
+	}
+	return medianCameraPoint(samples, n, point);
+}
@@ -0,0 +1,117 @@
+/* *******************************************************************************
+ *	                              frameSource.h
+ *
+ * Where kinectTracker3 gets its frames from.
+ * A FrameSource delivers, per frame, the color image, the depth image and
+ * the body joints. Camera space points of color pixels are looked up on
+ * demand with mapColorPoint(); the full color pixel -> camera space map
+ * (24 MB per frame) is only computed by mapColorFrame() when it is needed,
+ * e.g. for captures. Two backends exist:
+ * - Kinect : live sensor through the Kinect SDK (Windows only)
+ * - Replay : a capture file written by CaptureWriter, memory mapped and played
+ *            back either as fast as possible or at the original frame pace
+ *********************************************************************************/
+
+#pragma once
+
+#include <stdio.h>
+
+#include "kinectCompat.h"
+
+// Kinect constants
+const int d_width = 512;
+const int d_height = 424;
+const int c_width = 1920;
+const int c_height = 1080;
+const int depth_radius = 8; // color pixels around a queried point that vote for its depth
+
+// One tracked body
+struct kinect_body {
+	unsigned long long id; // tracking id, stays the same while the body is tracked
+	Joint joints[JointType_Count];
+	ColorSpacePoint joints2d[JointType_Count]; // same joints in color image coordinates
+};
+
+// One acquired frame. Buffers are owned by the caller, but a source may point
+// rgb/depth/xyz at its own storage as long as that storage outlives the source.
+struct kinect_frame {
+	long long time; // sensor relative time (100ns ticks)
+	unsigned char * rgb; // BGRA color image, c_width x c_height
+	unsigned short * depth; // depth image in mm, d_width x d_height, NULL if the source has none
+	CameraSpacePoint * xyz; // color pixel -> camera space mapping, c_width x c_height, filled by mapColorFrame()
+	int bodies; // tracked bodies in this frame
+	struct kinect_body body[BODY_COUNT]; // tracked bodies first, in sensor order
+};
+
+enum frame_status {
+	FRAME_NEW, // frame was filled with new data
+	FRAME_NONE, // no new frame yet, frame left untouched
+	FRAME_END // source is exhausted (end of replay)
+};
+
+/* Frame source interface */
+class FrameSource {
+public:
+	virtual ~FrameSource() {}
+	virtual frame_status acquire(struct kinect_frame & frame) = 0;
+	/* Camera space point of color pixel (x, y) of an acquired frame: median depth of the
+	   valid points within depth_radius. false if there is no depth there.
+	   The default reads frame.xyz. Not reentrant, call it from one thread */
+	virtual bool mapColorPoint(const struct kinect_frame & frame, float x, float y, CameraSpacePoint & point);
+	/* Fill frame.xyz for every color pixel. The default has nothing to do (xyz came with the frame) */
+	virtual void mapColorFrame(struct kinect_frame & /* frame */) {}
+};
+
+/* Robust point of count samples: median Z, direction from the mean X/Z and Y/Z.
+   Invalid samples (Z not > 0, not finite) are skipped. Reorders points. false if none is valid */
+bool medianCameraPoint(CameraSpacePoint * points, int count, CameraSpacePoint & point);
+
+/* Open the default Kinect sensor. NULL if there is none (or no SDK) */
+FrameSource * openKinectSource();
+
+/* Open a capture file for replay. realtime paces frames by their recorded time stamps */
+FrameSource * openReplaySource(const char * path, bool realtime);
+
+
+/* --------------------------------------------------
+	Capture files
+-------------------------------------------------- */
+
+// Every part of a capture file starts on a page boundary so it can be mapped directly
+const int CAPTURE_ALIGN = 4096;
+const int CAPTURE_XYZ = 1; // frames carry the camera space mapping
+
+struct capture_header {
+	char magic[8]; // "KTCAP02"
+	int width;
+	int height;
+	int flags;
+	int frames;
+	long long frame_bytes; // size of one frame record including padding
+};
+
+// Frame record: this header (padded to CAPTURE_ALIGN), rgb, then xyz if CAPTURE_XYZ
+struct capture_frame_header {
+	long long time;
+	int bodies;
+	int reserved;
+	struct kinect_body body[BODY_COUNT];
+};
+
+/* Size of one frame record for the given flags */
+long long captureFrameBytes(int flags);
+
+/* Writes acquired frames into a capture file for later replay */
+class CaptureWriter {
+public:
+	CaptureWriter();
+	~CaptureWriter();
+	bool open(const char * path, int flags);
+	bool write(const struct kinect_frame & frame);
+	void close();
+	int frames() const { return header.frames; }
+private:
+	FILE * fp;
+	struct capture_header header;
+	unsigned char * pad;
+};
@@ -0,0 +1,117 @@
+/* *******************************************************************************
+ *	                              kinectCompat.h
+ *
+ * Kinect SDK and Win32 declarations the tracker relies on.
+ * On Windows these come straight from the SDK headers. Elsewhere (Linux build
+ * servers replaying recorded captures) layout-compatible stand-ins are declared
+ * so the tracking and recording code compiles without the SDK.
+ *********************************************************************************/
+
+#pragma once
+
+#ifdef _WIN32
+
+#include <Windows.h>
+#include <Ole2.h>
+#include <Kinect.h>
+
+#else
+
+#include <stdio.h>
+#include <time.h>
+#include <sys/time.h>
+
+typedef unsigned char BOOLEAN;
+
+#define BODY_COUNT 6
+
+#define sprintf_s snprintf
+
+struct CameraSpacePoint {
+	float X;
+	float Y;
+	float Z;
+};
+
+struct ColorSpacePoint {
+	float X;
+	float Y;
+};
+
+struct DepthSpacePoint {
+	float X;
+	float Y;
+};
+
+// same numbering as Kinect.h so recorded joints stay comparable
+enum _JointType {
+	JointType_SpineBase = 0,
+	JointType_SpineMid = 1,
+	JointType_Neck = 2,
+	JointType_Head = 3,
+	JointType_ShoulderLeft = 4,
+	JointType_ElbowLeft = 5,
+	JointType_WristLeft = 6,
+	JointType_HandLeft = 7,
+	JointType_ShoulderRight = 8,
+	JointType_ElbowRight = 9,
+	JointType_WristRight = 10,
+	JointType_HandRight = 11,
+	JointType_HipLeft = 12,
+	JointType_KneeLeft = 13,
+	JointType_AnkleLeft = 14,
+	JointType_FootLeft = 15,
+	JointType_HipRight = 16,
+	JointType_KneeRight = 17,
+	JointType_AnkleRight = 18,
+	JointType_FootRight = 19,
+	JointType_SpineShoulder = 20,
+	JointType_HandTipLeft = 21,
+	JointType_ThumbLeft = 22,
+	JointType_HandTipRight = 23,
+	JointType_ThumbRight = 24,
+	JointType_Count = (JointType_ThumbRight + 1)
+};
+typedef enum _JointType JointType;
+
+enum _TrackingState {
+	TrackingState_NotTracked = 0,
+	TrackingState_Inferred = 1,
+	TrackingState_Tracked = 2
+};
+typedef enum _TrackingState TrackingState;
+
+struct Joint {
+	enum _JointType JointType;
+	CameraSpacePoint Position;
+	enum _TrackingState TrackingState;
+};
+
+struct SYSTEMTIME {
+	unsigned short wYear;
+	unsigned short wMonth;
+	unsigned short wDayOfWeek;
+	unsigned short wDay;
+	unsigned short wHour;
+	unsigned short wMinute;
+	unsigned short wSecond;
+	unsigned short wMilliseconds;
+};
+
+/* UTC wall clock time, as GetSystemTime() on Windows */
+inline void GetSystemTime(SYSTEMTIME * st) {
+	struct timeval tv;
+	struct tm t;
+	gettimeofday(&tv, NULL);
+	gmtime_r(&tv.tv_sec, &t);
+	st->wYear = (unsigned short)(t.tm_year + 1900);
+	st->wMonth = (unsigned short)(t.tm_mon + 1);
+	st->wDayOfWeek = (unsigned short)t.tm_wday;
+	st->wDay = (unsigned short)t.tm_mday;
+	st->wHour = (unsigned short)t.tm_hour;
+	st->wMinute = (unsigned short)t.tm_min;
+	st->wSecond = (unsigned short)t.tm_sec;
+	st->wMilliseconds = (unsigned short)(tv.tv_usec / 1000);
+}
+
+#endif
@@ -0,0 +1,253 @@
+/* *******************************************************************************
+ *	                              kinectSource.cpp
+ *
+ * Kinect backend of FrameSource. Acquires depth, color and body frames from the
+ * default sensor through the Kinect SDK.
+ * Only the depth image is kept per frame. A color pixel is mapped to camera
+ * space by finding the depth pixels that project next to it: a coarse grid
+ * of depth pixels is projected into the color image, then the window around
+ * the closest one. Both are sparse mapper calls of a few thousand points
+ * instead of MapColorFrameToCameraSpace for all 2 million color pixels.
+ *********************************************************************************/
+
+#include "frameSource.h"
+
+#include <string.h>
+
+#ifdef _WIN32
+
+// Sparse lookup: grid step and fine window half size, in depth pixels
+static const int coarse_step = 8;
+static const int coarse_points = ((d_width + coarse_step - 1) / coarse_step) * ((d_height + coarse_step - 1) / coarse_step);
+static const int fine_half = coarse_step;
+static const int fine_points = (2 * fine_half + 1) * (2 * fine_half + 1);
+
+class KinectFrameSource : public FrameSource {
+public:
+	KinectFrameSource() : sensor(NULL), reader(NULL), mapper(NULL) {}
+	~KinectFrameSource();
+	bool initKinect();
+	frame_status acquire(struct kinect_frame & frame);
+	bool mapColorPoint(const struct kinect_frame & frame, float x, float y, CameraSpacePoint & point);
+	void mapColorFrame(struct kinect_frame & frame);
+private:
+	void getDepthData(IMultiSourceFrame* frame, struct kinect_frame & kf);
+	void getRgbData(IMultiSourceFrame* frame, struct kinect_frame & kf);
+	void getBodyData(IMultiSourceFrame* frame, struct kinect_frame & kf);
+
+	IKinectSensor* sensor;
+	IMultiSourceFrameReader* reader;
+	ICoordinateMapper* mapper;
+
+	// mapColorPoint scratch
+	DepthSpacePoint depth_points[coarse_points];
+	UINT16 depths[coarse_points];
+	ColorSpacePoint color_points[coarse_points];
+	CameraSpacePoint camera_points[fine_points];
+};
+
+KinectFrameSource::~KinectFrameSource() {
+	if (reader) reader->Release();
+	if (mapper) mapper->Release();
+	if (sensor) {
+		sensor->Close();
+		sensor->Release();
+	}
+}
+
+/* Initialize Kinect for acuqiring depth, color, bodytracking data */
+bool KinectFrameSource::initKinect() {
+	if (FAILED(GetDefaultKinectSensor(&sensor))) {
+		return false;
+	}
+	if (sensor) {
+		sensor->get_CoordinateMapper(&mapper);
+		sensor->Open();
+		sensor->OpenMultiSourceFrameReader(
+			FrameSourceTypes::FrameSourceTypes_Depth
+			| FrameSourceTypes::FrameSourceTypes_Color
+			| FrameSourceTypes::FrameSourceTypes_Body,
+			&reader);
+		return reader;
+	}
+	else {
+		return false;
+	}
+}
+
+/* Get depth information from Kinect, copied into kf.depth for mapping on demand */
+void KinectFrameSource::getDepthData(IMultiSourceFrame* frame, struct kinect_frame & kf) {
+	IDepthFrame* depthframe = NULL;
+	IDepthFrameReference* frameref = NULL;
+	frame->get_DepthFrameReference(&frameref);
+	frameref->AcquireFrame(&depthframe);
+	if (frameref) frameref->Release();
+	if (!depthframe) return;
+	// Get data from frame
+	unsigned int sz;
+	unsigned short* buf;
+	depthframe->AccessUnderlyingBuffer(&sz, &buf);
+	if (kf.depth && sz == d_width*d_height) {
+		memcpy(kf.depth, buf, sz * sizeof(unsigned short));
+	}
+	if (depthframe) depthframe->Release();
+}
+
+/* Full ColorSpace->CameraSpace mapping (xyz), only when somebody needs all of it */
+void KinectFrameSource::mapColorFrame(struct kinect_frame & kf) {
+	if (!kf.depth || !kf.xyz) return;
+	mapper->MapColorFrameToCameraSpace(d_width*d_height, kf.depth, c_width*c_height, kf.xyz);
+}
+
+/* Camera space point of one color pixel from the depth pixels projecting next to it */
+bool KinectFrameSource::mapColorPoint(const struct kinect_frame & kf, float x, float y, CameraSpacePoint & point) {
+	if (!kf.depth) return false;
+
+	// coarse: closest grid depth pixel in the color image
+	int n = 0;
+	for (int v = 0; v < d_height; v += coarse_step) {
+		for (int u = 0; u < d_width; u += coarse_step) {
+			UINT16 d = kf.depth[v * d_width + u];
+			if (d == 0) continue;
+			depth_points[n].X = (float)u;
+			depth_points[n].Y = (float)v;
+			depths[n] = d;
+			n++;
+		}
+	}
+	if (n == 0) return false;
+	if (FAILED(mapper->MapDepthPointsToColorSpace(n, depth_points, n, depths, n, color_points))) return false;
+	int best = -1;
+	float bestDist = 0;
+	for (int i = 0; i < n; i++) {
+		float dx = color_points[i].X - x;
+		float dy = color_points[i].Y - y;
+		float dist = dx * dx + dy * dy;
+		if (best < 0 || dist < bestDist) {
+			best = i;
+			bestDist = dist;
+		}
+	}
+	int bu = (int)depth_points[best].X;
+	int bv = (int)depth_points[best].Y;
+
+	// fine: depth pixels around it that land within depth_radius of (x, y)
+	n = 0;
+	for (int v = bv - fine_half; v <= bv + fine_half; v++) {
+		if (v < 0 || v >= d_height) continue;
+		for (int u = bu - fine_half; u <= bu + fine_half; u++) {
+			if (u < 0 || u >= d_width) continue;
+			UINT16 d = kf.depth[v * d_width + u];
+			if (d == 0) continue;
+			depth_points[n].X = (float)u;
+			depth_points[n].Y = (float)v;
+			depths[n] = d;
+			n++;
+		}
+	}
+	if (n == 0) return false;
+	if (FAILED(mapper->MapDepthPointsToColorSpace(n, depth_points, n, depths, n, color_points))) return false;
+	int m = 0;
+	for (int i = 0; i < n; i++) {
+		float dx = color_points[i].X - x;
+		float dy = color_points[i].Y - y;
+		if (dx * dx + dy * dy > depth_radius * depth_radius) continue;
+		depth_points[m] = depth_points[i];
+		depths[m] = depths[i];
+		m++;
+	}
+	if (m == 0) return false;
+	if (FAILED(mapper->MapDepthPointsToCameraSpace(m, depth_points, m, depths, m, camera_points))) return false;
+	return medianCameraPoint(camera_points, m, point);
+}
+
+/* Get color information from Kinect. Basically just camera video. (rgb) */
+void KinectFrameSource::getRgbData(IMultiSourceFrame* frame, struct kinect_frame & kf) {
+	IColorFrame* colorframe = NULL;
+	IColorFrameReference* frameref = NULL;
+	frame->get_ColorFrameReference(&frameref);
+	frameref->AcquireFrame(&colorframe);
+	if (frameref) frameref->Release();
+	if (!colorframe) return;
+	// Get data from frame
+	TIMESPAN time;
+	if (SUCCEEDED(colorframe->get_RelativeTime(&time))) {
+		kf.time = time;
+	}
+	colorframe->CopyConvertedFrameDataToArray(c_width*c_height * 4, kf.rgb, ColorImageFormat_Bgra);
+	if (colorframe) colorframe->Release();
+}
+
+/* Get bodytracking information of all joints of every tracked person. (joints) */
+void KinectFrameSource::getBodyData(IMultiSourceFrame* frame, struct kinect_frame & kf) {
+	IBodyFrame* bodyframe = NULL;
+	IBodyFrameReference* frameref = NULL;
+	frame->get_BodyFrameReference(&frameref);
+	frameref->AcquireFrame(&bodyframe);
+	if (frameref) frameref->Release();
+
+	kf.bodies = 0;
+	if (!bodyframe) return;
+
+	IBody* body[BODY_COUNT] = { 0 };
+	bodyframe->GetAndRefreshBodyData(BODY_COUNT, body);
+	for (int i = 0; i < BODY_COUNT; i++) {
+		if (!body[i]) continue;
+		BOOLEAN tracked = false;
+		body[i]->get_IsTracked(&tracked);
+		if (tracked) {
+			struct kinect_body * kb = &kf.body[kf.bodies++];
+			UINT64 id = 0;
+			body[i]->get_TrackingId(&id);
+			kb->id = id;
+			body[i]->GetJoints(JointType_Count, kb->joints);
+		}
+	}
+	for (int i = 0; i < BODY_COUNT; i++) {
+		if (body[i]) body[i]->Release();
+	}
+
+	// project joints for display, so consumers never need the coordinate mapper
+	for (int b = 0; b < kf.bodies; b++) {
+		struct kinect_body * kb = &kf.body[b];
+		CameraSpacePoint cameraPoints[JointType_Count];
+		for (int j = 0; j < JointType_Count; j++) {
+			cameraPoints[j] = kb->joints[j].Position;
+		}
+		mapper->MapCameraPointsToColorSpace(JointType_Count, cameraPoints, JointType_Count, kb->joints2d);
+	}
+
+	if (bodyframe) bodyframe->Release();
+}
+
+/* Single wrapper for all Kinect get functions */
+frame_status KinectFrameSource::acquire(struct kinect_frame & kf) {
+	IMultiSourceFrame* frame = NULL;
+	frame_status status = FRAME_NONE;
+	if (SUCCEEDED(reader->AcquireLatestFrame(&frame))) {
+		getDepthData(frame, kf);
+		getRgbData(frame, kf);
+		getBodyData(frame, kf);
+		status = FRAME_NEW;
+	}
+	if (frame) frame->Release();
+	return status;
+}
+
+FrameSource * openKinectSource() {
+	KinectFrameSource * source = new KinectFrameSource();
+	if (!source->initKinect()) {
+		delete source;
+		return NULL;
+	}
+	return source;
+}
+
+#else
+
+FrameSource * openKinectSource() {
+	// no Kinect SDK on this platform, only replay is available
+	return NULL;
+}
+
+#endif
@@ -0,0 +1,111 @@
+/* *******************************************************************************
+ *	                              latencyStats.cpp
+ *
+ * Bucket b < 2 * LATENCY_SUB_BUCKETS holds exactly b ticks. Above, bucket
+ * (shift + 1) * SUB + k holds [(SUB + k) << shift, (SUB + k + 1) << shift),
+ * i.e. each power of two is split into SUB equal buckets.
+ * The tick rate is measured once against the steady clock, from program
+ * start to the first report; a session of seconds gives it to well under
+ * a per mille.
+ *********************************************************************************/
+
+#include "latencyStats.h"
+
+#include <string.h>
+
+#include <chrono>
+#include <thread>
+
+typedef std::chrono::steady_clock latency_clock;
+
+// reference points for the tick rate, taken at program start
+static const long long start_ticks = timerTicks();
+static const latency_clock::time_point start_time = latency_clock::now();
+
+static const double min_calibration_s = 0.01;
+
+double timerTickNs() {
+#ifdef LATENCY_TSC
+	double seconds = std::chrono::duration<double>(latency_clock::now() - start_time).count();
+	if (seconds < min_calibration_s) {
+		std::this_thread::sleep_for(std::chrono::duration<double>(min_calibration_s - seconds));
+	}
+	long long ticks = timerTicks();
+	seconds = std::chrono::duration<double>(latency_clock::now() - start_time).count();
+	return ticks > start_ticks ? seconds * 1e9 / (ticks - start_ticks) : 1;
+#else
+	return 1;
+#endif
+}
+
+LatencyHistogram::LatencyHistogram() {
+	count = 0;
+	sum = 0;
+	for (int b = 0; b < LATENCY_BUCKETS; b++) buckets[b] = 0;
+}
+
+void LatencyHistogram::snapshot(struct latency_snapshot * s) const {
+	// count first: the buckets read afterwards hold at least that many samples
+	s->count = count.load(std::memory_order_acquire);
+	s->sum = sum.load(std::memory_order_relaxed);
+	for (int b = 0; b < LATENCY_BUCKETS; b++) s->buckets[b] = buckets[b].load(std::memory_order_relaxed);
+}
+
+/* Lower edge and width of a bucket, in ticks */
+static void bucketRange(int b, double & lower, double & width) {
+	if (b < 2 * LATENCY_SUB_BUCKETS) {
+		lower = b;
+		width = 1;
+		return;
+	}
+	int shift = b / LATENCY_SUB_BUCKETS - 1;
+	lower = (double)((long long)(LATENCY_SUB_BUCKETS + b % LATENCY_SUB_BUCKETS) << shift);
+	width = (double)(1LL << shift);
+}
+
+static inline long long bucketDiff(const struct latency_snapshot & now, const struct latency_snapshot * before, int b) {
+	return now.buckets[b] - (before ? before->buckets[b] : 0);
+}
+
+void summarizeLatency(const struct latency_snapshot & now, const struct latency_snapshot * before,
+	struct latency_summary * summary) {
+	memset(summary, 0, sizeof(*summary));
+	long long total = 0;
+	for (int b = 0; b < LATENCY_BUCKETS; b++) total += bucketDiff(now, before, b);
+	if (total <= 0) return;
+	double ns = timerTickNs();
+	summary->count = total;
+	summary->mean = (double)(now.sum - (before ? before->sum : 0)) / total * ns;
+	const double q[4] = { 0.5, 0.9, 0.99, 0.999 };
+	double * p[4] = { &summary->p50, &summary->p90, &summary->p99, &summary->p999 };
+	int next = 0;
+	long long seen = 0;
+	for (int b = 0; b < LATENCY_BUCKETS; b++) {
+		long long n = bucketDiff(now, before, b);
+		if (n <= 0) continue;
+		double lower, width;
+		bucketRange(b, lower, width);
+		// percentiles at the middle of their bucket
+		seen += n;
+		while (next < 4 && seen >= q[next] * total) *p[next++] = (lower + width / 2) * ns;
+		summary->max = (lower + width) * ns;
+	}
+}
+
+void writeLatencyJson(FILE * out, const struct latency_snapshot & now, const struct latency_snapshot * before) {
+	struct latency_summary s;
+	summarizeLatency(now, before, &s);
+	fprintf(out, "{\"count\": %lld, \"mean_ns\": %.0f, \"p50_ns\": %.0f, \"p90_ns\": %.0f, \"p99_ns\": %.0f, "
+		"\"p999_ns\": %.0f, \"max_ns\": %.0f, \"buckets\": [", s.count, s.mean, s.p50, s.p90, s.p99, s.p999, s.max);
+	double ns = timerTickNs();
+	bool first = true;
+	for (int b = 0; b < LATENCY_BUCKETS; b++) {
+		long long n = bucketDiff(now, before, b);
+		if (n <= 0) continue;
+		double lower, width;
+		bucketRange(b, lower, width);
+		fprintf(out, "%s[%.0f, %lld]", first ? "" : ", ", lower * ns, n);
+		first = false;
+	}
+	fprintf(out, "]}");
+}
@@ -0,0 +1,118 @@
+/* *******************************************************************************
+ *	                              latencyStats.h
+ *
+ * Low overhead timing of the tracker's stages.
+ * Timers read the CPU time stamp counter (the steady clock where there is
+ * none); ticks are converted to nanoseconds only when reporting. Durations
+ * go into fixed size log-linear histograms (HDR style: LATENCY_SUB_BUCKETS
+ * linear buckets per power of two, so every percentile is within about 3%).
+ * A histogram has a single writing thread: each timed section belongs to
+ * the stage thread that runs it, so recording is a relaxed load and store
+ * per counter, no lock and no atomic read-modify-write. Any other thread
+ * can take a snapshot at any time; reports are the difference between two
+ * snapshots (the last period, one recording session).
+ *********************************************************************************/
+
+#pragma once
+
+#include <stdio.h>
+
+#include <atomic>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#if defined(_MSC_VER) && (defined(_M_X64) || defined(_M_IX86))
+#define LATENCY_TSC
+#elif defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define LATENCY_TSC
+#else
+#include <chrono>
+#endif
+
+const int LATENCY_SUB_BITS = 5;
+const int LATENCY_SUB_BUCKETS = 1 << LATENCY_SUB_BITS; // linear buckets per power of two
+const int LATENCY_MAX_BITS = 44; // durations of up to 2^45 ticks are told apart (hours), longer ones share the last bucket
+const int LATENCY_BUCKETS = (LATENCY_MAX_BITS - LATENCY_SUB_BITS + 2) * LATENCY_SUB_BUCKETS;
+
+/* Timer ticks: the time stamp counter, or steady clock ns */
+inline long long timerTicks() {
+#ifdef LATENCY_TSC
+	return (long long)__rdtsc();
+#else
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+/* Nanoseconds per tick, measured against the steady clock since program start */
+double timerTickNs();
+
+/* Histogram bucket of a duration in ticks */
+inline int latencyBucket(long long ticks) {
+	if (ticks < 2 * LATENCY_SUB_BUCKETS) return ticks < 0 ? 0 : (int)ticks;
+#if defined(_MSC_VER) && defined(_M_X64)
+	unsigned long index;
+	_BitScanReverse64(&index, (unsigned long long)ticks);
+	int top = (int)index; // highest set bit
+#elif defined(_MSC_VER)
+	int top = 0;
+	for (unsigned long long v = (unsigned long long)ticks >> 1; v; v >>= 1) top++;
+#else
+	int top = 63 - __builtin_clzll((unsigned long long)ticks);
+#endif
+	if (top > LATENCY_MAX_BITS) return LATENCY_BUCKETS - 1;
+	int shift = top - LATENCY_SUB_BITS;
+	return (shift + 1) * LATENCY_SUB_BUCKETS + (int)(ticks >> shift) - LATENCY_SUB_BUCKETS;
+}
+
+// Copy of a histogram's counters at one time
+struct latency_snapshot {
+	long long count;
+	long long sum; // ticks
+	long long buckets[LATENCY_BUCKETS];
+};
+
+// A period between two snapshots, in ns
+struct latency_summary {
+	long long count;
+	double mean;
+	double p50, p90, p99, p999;
+	double max; // upper edge of the highest bucket used
+};
+
+class LatencyHistogram {
+public:
+	LatencyHistogram();
+	/* One duration. Only ever called from one thread */
+	void record(long long ticks) {
+		int b = latencyBucket(ticks);
+		buckets[b].store(buckets[b].load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+		sum.store(sum.load(std::memory_order_relaxed) + ticks, std::memory_order_relaxed);
+		count.store(count.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+	/* From any thread */
+	void snapshot(struct latency_snapshot * s) const;
+private:
+	std::atomic<long long> count;
+	std::atomic<long long> sum;
+	std::atomic<long long> buckets[LATENCY_BUCKETS];
+};
+
+// Times its own scope into a histogram
+class ScopedTimer {
+public:
+	explicit ScopedTimer(LatencyHistogram & h) : histogram(h), start(timerTicks()) {}
+	~ScopedTimer() { histogram.record(timerTicks() - start); }
+private:
+	LatencyHistogram & histogram;
+	long long start;
+};
+
+/* Summary of the durations recorded between before (NULL: program start) and now */
+void summarizeLatency(const struct latency_snapshot & now, const struct latency_snapshot * before,
+	struct latency_summary * summary);
+
+/* The same as a JSON object: count, mean and percentiles in ns, and the non-empty buckets
+   as [lower edge ns, count] pairs, so periods can be merged and percentiles recomputed */
+void writeLatencyJson(FILE * out, const struct latency_snapshot & now, const struct latency_snapshot * before);
@@ -0,0 +1,317 @@
+/* *******************************************************************************
+ *	                              liveFeed.cpp
+ *
+ * Shared memory is a named file mapping on Windows ("Local\name") and a
+ * POSIX shared memory object ("/name") elsewhere. Readers map it read only.
+ * The version checks are the usual seqlock: the copy a reader makes may be
+ * torn, but then the version read after it (behind an acquire fence)
+ * differs from the one read before, and the copy is thrown away.
+ *********************************************************************************/
+
+#include "liveFeed.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static const char live_magic[8] = "KTLIVE1";
+static const size_t live_align = 64; // cache line
+
+static size_t alignUp(size_t n) {
+	return (n + live_align - 1) / live_align * live_align;
+}
+
+static void platformName(const char * name, char * out) {
+#ifdef _WIN32
+	snprintf(out, LIVE_NAME_SIZE + 8, "Local\\%s", name);
+#else
+	snprintf(out, LIVE_NAME_SIZE + 8, "/%s", name);
+#endif
+}
+
+static void clearMapping(struct live_mapping * m) {
+	m->data = NULL;
+	m->size = 0;
+#ifdef _WIN32
+	m->handle = NULL;
+#else
+	m->fd = -1;
+#endif
+}
+
+static void unmap(struct live_mapping * m) {
+#ifdef _WIN32
+	if (m->data) UnmapViewOfFile(m->data);
+	if (m->handle) CloseHandle(m->handle);
+#else
+	if (m->data) munmap(m->data, m->size);
+	if (m->fd >= 0) ::close(m->fd);
+#endif
+	clearMapping(m);
+}
+
+static struct live_record * recordSlot(const struct live_feed_header * h, long long index) {
+	unsigned char * records = (unsigned char *)h + alignUp(sizeof(struct live_feed_header));
+	return (struct live_record *)(records + (index & (h->slots - 1)) * alignUp(sizeof(struct live_record)));
+}
+
+
+/* --------------------------------------------------
+	Publisher
+-------------------------------------------------- */
+
+LiveFeedPublisher::LiveFeedPublisher() : header(NULL) {
+	clearMapping(&mapping);
+	name[0] = 0;
+}
+
+LiveFeedPublisher::~LiveFeedPublisher() {
+	close();
+}
+
+bool LiveFeedPublisher::open(const char * feedName, const struct record_schema & schema, int frameWidth, int frameHeight) {
+	close();
+	if (strlen(feedName) >= LIVE_NAME_SIZE) return false;
+	strcpy(name, feedName);
+	int frameSlots = frameWidth > 0 && frameHeight > 0 ? LIVE_FRAME_SLOTS : 0;
+	size_t frameOffset = alignUp(sizeof(struct live_feed_header)) + LIVE_SLOTS * alignUp(sizeof(struct live_record));
+	size_t frameBytes = alignUp(sizeof(struct live_frame) + (size_t)frameWidth * frameHeight * 4);
+	size_t size = frameOffset + frameSlots * frameBytes;
+
+	char path[LIVE_NAME_SIZE + 8];
+	platformName(name, path);
+#ifdef _WIN32
+	mapping.handle = CreateFileMappingA(INVALID_HANDLE_VALUE, NULL, PAGE_READWRITE,
+		(DWORD)((unsigned long long)size >> 32), (DWORD)size, path);
+	if (!mapping.handle) return false;
+	bool existed = GetLastError() == ERROR_ALREADY_EXISTS;
+	mapping.data = (unsigned char *)MapViewOfFile(mapping.handle, FILE_MAP_WRITE, 0, 0, size);
+	mapping.size = size;
+	if (!mapping.data) {
+		unmap(&mapping);
+		return false;
+	}
+	// a mapping kept alive by readers of an earlier tracker can only be reused if it is as large
+	if (existed && ((struct live_feed_header *)mapping.data)->size != (long long)size) {
+		unmap(&mapping);
+		return false;
+	}
+#else
+	// readers of an earlier feed keep their (closed) copy, new readers find the new one
+	shm_unlink(path);
+	mapping.fd = shm_open(path, O_CREAT | O_EXCL | O_RDWR, 0644);
+	if (mapping.fd < 0) return false;
+	if (ftruncate(mapping.fd, size) != 0) {
+		unmap(&mapping);
+		shm_unlink(path);
+		return false;
+	}
+	void * p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, mapping.fd, 0);
+	if (p == MAP_FAILED) {
+		unmap(&mapping);
+		shm_unlink(path);
+		return false;
+	}
+	mapping.data = (unsigned char *)p;
+	mapping.size = size;
+#endif
+	header = (struct live_feed_header *)mapping.data;
+	// readers check the magic last written, the layout is complete by then
+	memset(header->magic, 0, sizeof(header->magic));
+	std::atomic_thread_fence(std::memory_order_release);
+	header->slots = LIVE_SLOTS;
+	header->frame_slots = frameSlots;
+	header->frame_width = frameSlots ? frameWidth : 0;
+	header->frame_height = frameSlots ? frameHeight : 0;
+	header->frame_offset = frameOffset;
+	header->frame_bytes = frameBytes;
+	header->size = size;
+	header->schema = schema;
+	header->records.store(0, std::memory_order_relaxed);
+	header->frames.store(0, std::memory_order_relaxed);
+	for (int i = 0; i < LIVE_SLOTS; i++) recordSlot(header, i)->version.store(0, std::memory_order_relaxed);
+	for (int i = 0; i < frameSlots; i++) {
+		((struct live_frame *)(mapping.data + frameOffset + i * frameBytes))->version.store(0, std::memory_order_relaxed);
+	}
+	header->open.store(1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(header->magic, live_magic, sizeof(live_magic));
+	return true;
+}
+
+void LiveFeedPublisher::close() {
+	if (header) {
+		header->open.store(0, std::memory_order_release);
+#ifndef _WIN32
+		char path[LIVE_NAME_SIZE + 8];
+		platformName(name, path);
+		shm_unlink(path);
+#endif
+	}
+	header = NULL;
+	unmap(&mapping);
+}
+
+void LiveFeedPublisher::publish(const struct record_row & rec) {
+	if (!header) return;
+	long long n = header->records.load(std::memory_order_relaxed);
+	struct live_record * slot = recordSlot(header, n);
+	slot->version.store(2 * n + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	memcpy(&slot->rec, &rec, sizeof(rec));
+	slot->version.store(2 * n + 2, std::memory_order_release);
+	header->records.store(n + 1, std::memory_order_release);
+}
+
+void LiveFeedPublisher::publishFrame(const unsigned char * bgra, size_t step, long long time) {
+	if (!header || header->frame_slots == 0) return;
+	long long n = header->frames.load(std::memory_order_relaxed);
+	struct live_frame * slot = (struct live_frame *)(mapping.data + header->frame_offset
+		+ (n & (header->frame_slots - 1)) * header->frame_bytes);
+	slot->version.store(2 * n + 1, std::memory_order_relaxed);
+	std::atomic_thread_fence(std::memory_order_release);
+	slot->record = header->records.load(std::memory_order_relaxed) - 1;
+	slot->time = time;
+	unsigned char * dst = (unsigned char *)(slot + 1);
+	size_t row = (size_t)header->frame_width * 4;
+	for (int y = 0; y < header->frame_height; y++) {
+		memcpy(dst + y * row, bgra + y * step, row);
+	}
+	slot->version.store(2 * n + 2, std::memory_order_release);
+	header->frames.store(n + 1, std::memory_order_release);
+}
+
+
+/* --------------------------------------------------
+	Reader
+-------------------------------------------------- */
+
+LiveFeedReader::LiveFeedReader() : header(NULL), next_record(0), n_lost(0) {
+	clearMapping(&mapping);
+}
+
+LiveFeedReader::~LiveFeedReader() {
+	close();
+}
+
+bool LiveFeedReader::open(const char * name) {
+	close();
+	if (strlen(name) >= LIVE_NAME_SIZE) return false;
+	char path[LIVE_NAME_SIZE + 8];
+	platformName(name, path);
+#ifdef _WIN32
+	mapping.handle = OpenFileMappingA(FILE_MAP_READ, FALSE, path);
+	if (!mapping.handle) return false;
+	mapping.data = (unsigned char *)MapViewOfFile(mapping.handle, FILE_MAP_READ, 0, 0, 0);
+	if (!mapping.data) {
+		unmap(&mapping);
+		return false;
+	}
+	MEMORY_BASIC_INFORMATION info;
+	mapping.size = VirtualQuery(mapping.data, &info, sizeof(info)) ? info.RegionSize : 0;
+#else
+	mapping.fd = shm_open(path, O_RDONLY, 0);
+	if (mapping.fd < 0) return false;
+	struct stat st;
+	if (fstat(mapping.fd, &st) != 0 || st.st_size < (off_t)sizeof(struct live_feed_header)) {
+		unmap(&mapping);
+		return false;
+	}
+	void * p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, mapping.fd, 0);
+	if (p == MAP_FAILED) {
+		unmap(&mapping);
+		return false;
+	}
+	mapping.data = (unsigned char *)p;
+	mapping.size = st.st_size;
+#endif
+	const struct live_feed_header * h = (const struct live_feed_header *)mapping.data;
+	bool valid = mapping.size >= sizeof(struct live_feed_header) && memcmp(h->magic, live_magic, sizeof(live_magic)) == 0;
+	std::atomic_thread_fence(std::memory_order_acquire);
+	valid = valid && h->size <= (long long)mapping.size && h->slots == LIVE_SLOTS
+		&& (h->frame_slots == 0 || h->frame_offset + h->frame_slots * h->frame_bytes <= h->size);
+	if (!valid) {
+		unmap(&mapping);
+		return false;
+	}
+	header = h;
+	next_record = header->records.load(std::memory_order_acquire);
+	n_lost = 0;
+	return true;
+}
+
+void LiveFeedReader::close() {
+	header = NULL;
+	unmap(&mapping);
+}
+
+live_status LiveFeedReader::next(struct record_row * rec) {
+	if (!header) return LIVE_CLOSED;
+	for (;;) {
+		long long written = header->records.load(std::memory_order_acquire);
+		// a new publisher started over in the same mapping (Windows keeps it while readers hold it)
+		if (written < next_record - LIVE_SLOTS) return LIVE_CLOSED;
+		if (next_record >= written) {
+			return header->open.load(std::memory_order_acquire) ? LIVE_NONE : LIVE_CLOSED;
+		}
+		// the slot of written - LIVE_SLOTS may already be overwritten
+		if (written - next_record >= LIVE_SLOTS) {
+			long long oldest = written - LIVE_SLOTS + 1;
+			n_lost += oldest - next_record;
+			next_record = oldest;
+		}
+		const struct live_record * slot = recordSlot(header, next_record);
+		long long version = slot->version.load(std::memory_order_acquire);
+		if (version == 2 * next_record + 2) {
+			memcpy(rec, &slot->rec, sizeof(*rec));
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot->version.load(std::memory_order_relaxed) == version) {
+				next_record++;
+				return LIVE_RECORD;
+			}
+		}
+		// overwritten while reading: the publisher is a ring ahead, skip on
+		n_lost++;
+		next_record++;
+	}
+}
+
+const struct live_frame * LiveFeedReader::frameSlot(long long index) const {
+	return (const struct live_frame *)(mapping.data + header->frame_offset + (index & (header->frame_slots - 1)) * header->frame_bytes);
+}
+
+const unsigned char * LiveFeedReader::peekFrame(long long * ticket, long long * record) {
+	if (!header || header->frame_slots == 0) return NULL;
+	for (;;) {
+		long long n = header->frames.load(std::memory_order_acquire) - 1;
+		if (n < 0) return NULL;
+		const struct live_frame * slot = frameSlot(n);
+		long long version = slot->version.load(std::memory_order_acquire);
+		if (version != 2 * n + 2) continue; // a newer frame is being written there, take that one
+		*record = slot->record;
+		*ticket = n;
+		return (const unsigned char *)(slot + 1);
+	}
+}
+
+bool LiveFeedReader::frameIntact(long long ticket) const {
+	std::atomic_thread_fence(std::memory_order_acquire);
+	return frameSlot(ticket)->version.load(std::memory_order_relaxed) == 2 * ticket + 2;
+}
+
+bool LiveFeedReader::latestFrame(unsigned char * bgra, long long * record) {
+	long long ticket;
+	const unsigned char * pixels;
+	do {
+		pixels = peekFrame(&ticket, record);
+		if (!pixels) return false;
+		memcpy(bgra, pixels, (size_t)header->frame_width * header->frame_height * 4);
+	} while (!frameIntact(ticket));
+	return true;
+}
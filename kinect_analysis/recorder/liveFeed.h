@@ -0,0 +1,131 @@
+/* *******************************************************************************
+ *	                              liveFeed.h
+ *
+ * Live feed of tracked frames to other processes on the same machine.
+ * The tracker publishes every record_row (and optionally the downscaled
+ * color frame) into a named shared memory ring; any number of readers
+ * follow it at their own pace. Slots are versioned (a seqlock per slot):
+ * the publisher marks a slot odd while writing it and even when done,
+ * a reader copies the slot and keeps the copy only if the version did not
+ * change meanwhile. The publisher never waits for, or even knows about,
+ * readers; a reader that falls more than a ring behind skips ahead and
+ * counts the records it lost.
+ * Layout: live_feed_header, LIVE_SLOTS live_record slots, then frame_slots
+ * live_frame slots, each followed by its BGRA pixels.
+ *********************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+
+#include <atomic>
+
+#include "recordWriter.h"
+
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+#if ATOMIC_LLONG_LOCK_FREE != 2
+#error "the live feed needs lock free 64-bit atomics to share them between processes"
+#endif
+
+const int LIVE_SLOTS = 256; // records in the ring, power of two (about 8 s at 30 fps)
+const int LIVE_FRAME_SLOTS = 4; // color frames in the ring, power of two
+const int LIVE_NAME_SIZE = 64;
+
+struct live_feed_header {
+	char magic[8]; // "KTLIVE1"
+	int slots; // records
+	int frame_slots; // color frames, 0 if the feed has none
+	int frame_width, frame_height; // BGRA
+	long long frame_offset; // first live_frame
+	long long frame_bytes; // size of one live_frame including its pixels
+	long long size; // of the whole mapping
+	struct record_schema schema;
+	std::atomic<int> open; // cleared when the publisher closes the feed
+	std::atomic<long long> records; // records published so far
+	std::atomic<long long> frames; // frames published so far
+};
+
+struct live_record {
+	std::atomic<long long> version; // 2 * index + 1 while being written, 2 * index + 2 when complete
+	struct record_row rec;
+};
+
+struct live_frame {
+	std::atomic<long long> version; // as live_record
+	long long record; // index of the record of this frame
+	long long time; // sensor time (100 ns ticks)
+	long long reserved;
+	// frame_width * frame_height * 4 bytes of BGRA follow
+};
+
+enum live_status {
+	LIVE_RECORD, // a record was read
+	LIVE_NONE, // nothing new yet
+	LIVE_CLOSED // the publisher is gone, open the feed again to follow a new one
+};
+
+/* The shared memory of a feed */
+struct live_mapping {
+	unsigned char * data;
+	size_t size;
+#ifdef _WIN32
+	HANDLE handle;
+#else
+	int fd;
+#endif
+};
+
+/* Writes the feed. One thread publishes */
+class LiveFeedPublisher {
+public:
+	LiveFeedPublisher();
+	~LiveFeedPublisher();
+	/* Create the feed called name for records of schema, with frameWidth x frameHeight BGRA frames
+	   (0 for records only). A feed of the same name left by an earlier tracker is replaced */
+	bool open(const char * name, const struct record_schema & schema, int frameWidth = 0, int frameHeight = 0);
+	void close();
+	bool isOpen() const { return header != NULL; }
+	bool hasFrames() const { return header && header->frame_slots > 0; }
+	/* Publish one record. Never waits */
+	void publish(const struct record_row & rec);
+	/* Publish a frame of the last published record, rows step bytes apart. Never waits */
+	void publishFrame(const unsigned char * bgra, size_t step, long long time);
+private:
+	struct live_mapping mapping;
+	struct live_feed_header * header;
+	char name[LIVE_NAME_SIZE];
+};
+
+/* Follows a feed. One reader per thread; every reader sees every record */
+class LiveFeedReader {
+public:
+	LiveFeedReader();
+	~LiveFeedReader();
+	/* Attach to the feed called name, starting at its newest record. false if there is none */
+	bool open(const char * name);
+	void close();
+	const struct record_schema & schema() const { return header->schema; }
+	int frameWidth() const { return header->frame_width; }
+	int frameHeight() const { return header->frame_height; }
+	/* The next record in order. A reader that fell more than LIVE_SLOTS behind skips
+	   to the oldest record still in the ring; the records skipped count as lost */
+	live_status next(struct record_row * rec);
+	long long lost() const { return n_lost; }
+	/* Copy the newest frame (frameWidth() * frameHeight() * 4 bytes) and the index of its record.
+	   false if there is none */
+	bool latestFrame(unsigned char * bgra, long long * record);
+	/* The newest frame's pixels in place, without copying. Whatever was read from them is only
+	   valid if frameIntact(ticket) still holds afterwards. NULL if there is no frame */
+	const unsigned char * peekFrame(long long * ticket, long long * record);
+	bool frameIntact(long long ticket) const;
+private:
+	const struct live_frame * frameSlot(long long index) const;
+
+	struct live_mapping mapping;
+	const struct live_feed_header * header;
+	long long next_record;
+	long long n_lost;
+};
@@ -0,0 +1,192 @@
+/* *******************************************************************************
+ *	                              markerBlobs.cpp
+ *
+ * Run based labeling: runs are found with bit scans on the packed words,
+ * so empty parts of the mask cost one test per 64 pixels. A run gets the
+ * label of the first run above it that touches it (diagonals included,
+ * like findContours); further touching runs are merged into the smaller
+ * label. Sums go to the run's label and are folded into the roots at the end.
+ *********************************************************************************/
+
+#include "markerBlobs.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+/* Index of the lowest set bit, w != 0 */
+static inline int lowestBit(uint64_t w) {
+#ifdef _MSC_VER
+	unsigned long index;
+	_BitScanForward64(&index, w);
+	return (int)index;
+#else
+	return __builtin_ctzll(w);
+#endif
+}
+
+/* First x >= from whose bit equals set, words * 64 if there is none */
+static inline int findBit(const uint64_t * row, int words, int from, bool set) {
+	int w = from >> 6;
+	if (w >= words) return words * 64;
+	uint64_t bits = (set ? row[w] : ~row[w]) & (~0ULL << (from & 63));
+	while (!bits) {
+		if (++w >= words) return words * 64;
+		bits = set ? row[w] : ~row[w];
+	}
+	return w * 64 + lowestBit(bits);
+}
+
+static int findRoot(int * parent, int label) {
+	while (parent[label] != label) {
+		parent[label] = parent[parent[label]];
+		label = parent[label];
+	}
+	return label;
+}
+
+static void join(int * parent, int a, int b) {
+	a = findRoot(parent, a);
+	b = findRoot(parent, b);
+	if (a < b) parent[b] = a;
+	else if (b < a) parent[a] = b;
+}
+
+/* Room for one more label */
+static void growLabels(struct blob_labeler * labeler, size_t needed) {
+	if (needed <= labeler->labels_size) return;
+	size_t size = labeler->labels_size ? labeler->labels_size : 256;
+	while (size < needed) size *= 2;
+	labeler->parent = (int *)realloc(labeler->parent, size * sizeof(int));
+	labeler->stats = (struct blob_stats *)realloc(labeler->stats, size * sizeof(struct blob_stats));
+	labeler->labels_size = size;
+}
+
+/* Keep blobs sorted by area, largest first */
+static int insertBlob(struct marker_blob * blobs, int count, int max_blobs, const struct blob_stats & s) {
+	int i = count < max_blobs ? count : max_blobs - 1;
+	if (count == max_blobs && blobs[i].area >= s.area) return count;
+	while (i > 0 && blobs[i - 1].area < s.area) {
+		blobs[i] = blobs[i - 1];
+		i--;
+	}
+	struct marker_blob * b = &blobs[i];
+	b->area = s.area;
+	b->x = (float)((double)s.m10 / s.area);
+	b->y = (float)((double)s.m01 / s.area);
+	b->left = s.left;
+	b->top = s.top;
+	b->right = s.right;
+	b->bottom = s.bottom;
+	return count < max_blobs ? count + 1 : count;
+}
+
+int findBlobs(const struct marker_mask & mask, struct blob_labeler * labeler, long long min_area,
+	struct marker_blob * blobs, int max_blobs) {
+	// at most one run per two pixels
+	size_t rowRuns = (size_t)mask.width / 2 + 1;
+	if (2 * rowRuns > labeler->runs_size) {
+		free(labeler->runs);
+		labeler->runs = (struct blob_run *)malloc(2 * rowRuns * sizeof(struct blob_run));
+		labeler->runs_size = 2 * rowRuns;
+	}
+	struct blob_run * prev = labeler->runs;
+	struct blob_run * cur = labeler->runs + rowRuns;
+	int nPrev = 0;
+	int labels = 0;
+	long long runs = 0, links = 0;
+
+	for (int y = 0; y < mask.height; y++) {
+		const uint64_t * row = mask.bits + (size_t)y * mask.words;
+		int nCur = 0;
+		int j = 0; // first run above that may touch the current run
+		int x = findBit(row, mask.words, 0, true);
+		while (x < mask.width) {
+			int end = findBit(row, mask.words, x, false);
+			if (end > mask.width) end = mask.width;
+
+			// runs above touching [x - 1, end]
+			int label = -1;
+			while (j < nPrev && prev[j].x1 < x) j++;
+			for (int k = j; k < nPrev && prev[k].x0 <= end; k++) {
+				if (label < 0) label = prev[k].label;
+				else join(labeler->parent, label, prev[k].label);
+				links++;
+			}
+			runs++;
+			if (label < 0) {
+				growLabels(labeler, labels + 1);
+				label = labels++;
+				labeler->parent[label] = label;
+				struct blob_stats * s = &labeler->stats[label];
+				s->area = s->m10 = s->m01 = 0;
+				s->left = x;
+				s->right = end - 1;
+				s->top = y;
+				s->bottom = y;
+			}
+
+			long long len = end - x;
+			struct blob_stats * s = &labeler->stats[label];
+			s->area += len;
+			s->m10 += (long long)(x + end - 1) * len / 2;
+			s->m01 += (long long)y * len;
+			if (x < s->left) s->left = x;
+			if (end - 1 > s->right) s->right = end - 1;
+			s->bottom = y;
+
+			cur[nCur].x0 = x;
+			cur[nCur].x1 = end;
+			cur[nCur].label = label;
+			nCur++;
+			x = findBit(row, mask.words, end, true);
+		}
+		struct blob_run * t = prev;
+		prev = cur;
+		cur = t;
+		nPrev = nCur;
+	}
+
+	// fold the sums into the roots; parent[l] <= l, so roots are resolved in order
+	int * parent = labeler->parent;
+	int components = 0;
+	for (int l = 0; l < labels; l++) {
+		int root = parent[parent[l]];
+		parent[l] = root;
+		if (root == l) {
+			components++;
+			continue;
+		}
+		struct blob_stats * r = &labeler->stats[root];
+		const struct blob_stats * s = &labeler->stats[l];
+		r->area += s->area;
+		r->m10 += s->m10;
+		r->m01 += s->m01;
+		if (s->left < r->left) r->left = s->left;
+		if (s->right > r->right) r->right = s->right;
+		if (s->top < r->top) r->top = s->top;
+		if (s->bottom > r->bottom) r->bottom = s->bottom;
+	}
+	labeler->components = components;
+	// Euler: links - runs + components independent cycles, one around each hole
+	labeler->holes = (int)(links - runs + components);
+
+	int count = 0;
+	if (max_blobs <= 0) return 0;
+	for (int l = 0; l < labels; l++) {
+		if (parent[l] == l && labeler->stats[l].area > min_area) {
+			count = insertBlob(blobs, count, max_blobs, labeler->stats[l]);
+		}
+	}
+	return count;
+}
+
+void freeBlobLabeler(struct blob_labeler * labeler) {
+	free(labeler->runs);
+	free(labeler->parent);
+	free(labeler->stats);
+	memset(labeler, 0, sizeof(*labeler));
+}
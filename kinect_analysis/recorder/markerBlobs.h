@@ -0,0 +1,54 @@
+/* *******************************************************************************
+ *	                              markerBlobs.h
+ *
+ * Connected components of a packed marker mask.
+ * One pass over the mask rows: runs of set bits are linked to the runs of
+ * the row above (8-connected) with union-find, and area, first moments and
+ * bounding box are summed per component. All buffers live in the labeler
+ * and only grow, so labeling a frame does not allocate once warmed up.
+ * Holes (background regions enclosed by a blob, the inner contours of
+ * findContours) are counted from the run graph: each link between runs
+ * beyond those a spanning tree needs closes one hole.
+ *********************************************************************************/
+
+#pragma once
+
+#include "markerKernel.h"
+
+// One connected component
+struct marker_blob {
+	long long area; // pixels
+	float x, y; // centroid
+	int left, top, right, bottom; // bounding box, inclusive
+};
+
+// Run of set pixels [x0, x1) in one row
+struct blob_run {
+	int x0, x1;
+	int label;
+};
+
+// Per label sums
+struct blob_stats {
+	long long area;
+	long long m10, m01;
+	int left, top, right, bottom;
+};
+
+// Scratch of the labeler, must start zeroed
+struct blob_labeler {
+	struct blob_run * runs; // previous and current row
+	size_t runs_size;
+	int * parent; // union-find forest, parent[l] <= l
+	struct blob_stats * stats;
+	size_t labels_size;
+	int components; // blobs of any size found by the last findBlobs
+	int holes; // holes in those blobs
+};
+
+/* Label the 8-connected blobs of mask. The up to max_blobs largest blobs with more than
+ min_area pixels are written to blobs, largest first; returns their number */
+int findBlobs(const struct marker_mask & mask, struct blob_labeler * labeler, long long min_area,
+	struct marker_blob * blobs, int max_blobs);
+
+void freeBlobLabeler(struct blob_labeler * labeler);
@@ -0,0 +1,324 @@
+/* *******************************************************************************
+ *	                              markerKernel.cpp
+ *
+ * The pixels are read exactly once: each view row is converted to HSV,
+ * range tested and packed into bits. Erosion and dilation then run on the
+ * packed rows (64 pixels per word) through two small row rings, lagging
+ * 8 rows behind the thresholding, so everything stays in L1.
+ *
+ * Both OpenCV steps are reproduced exactly:
+ * - cvtColor BGR2HSV on 8 bits uses fixed point tables (hsv_shift = 12)
+ * - erode/dilate treat pixels outside the image as neutral, and twice a
+ *   rectangle equals one bigger rectangle: erode 3x3 x2 = offsets -2..2,
+ *   dilate 8x8 (anchor 4) x2 = offsets -8..6, applied rows then columns.
+ *********************************************************************************/
+
+#include "markerKernel.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define MARKER_KERNEL_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+#endif
+
+// OpenCV's fixed point HSV conversion
+static const int hsv_shift = 12;
+static const int hue_range = 180;
+
+struct hsv_tables {
+	int sdiv[256];
+	int hdiv[256];
+	hsv_tables() {
+		sdiv[0] = hdiv[0] = 0;
+		for (int i = 1; i < 256; i++) {
+			sdiv[i] = (int)lrint((255 << hsv_shift) / (1. * i));
+			hdiv[i] = (int)lrint((hue_range << hsv_shift) / (6. * i));
+		}
+	}
+};
+static const struct hsv_tables tables;
+
+// filter windows (pixel offsets) of the two erodes and the two dilates combined
+static const int erode_lo = -2;
+static const int erode_hi = 2;
+static const int dilate_lo = -8;
+static const int dilate_hi = 6;
+static const int erode_rows = erode_hi - erode_lo + 1; // ring of horizontally eroded rows
+static const int dilate_rows = 16; // ring of horizontally dilated rows (>= dilate_hi - dilate_lo + 1)
+static const int lag = erode_hi + dilate_hi; // rows between thresholding and output
+
+
+struct bgra_view makeBgraView(const unsigned char * bgra, int bufWidth, int step, int x, int y, int width, int height) {
+	struct bgra_view view;
+	view.data = bgra + ((size_t)y * step * bufWidth + (size_t)x * step) * 4;
+	view.width = width;
+	view.height = height;
+	view.pixel_step = 4 * step;
+	view.row_step = (size_t)bufWidth * 4 * step;
+	return view;
+}
+
+void resizeMask(struct marker_mask * mask, int width, int height) {
+	int words = (width + 63) / 64;
+	size_t bitsSize = (size_t)words * height;
+	size_t scratchSize = (size_t)words * (erode_rows + dilate_rows + 1);
+	if (bitsSize > mask->bits_size || !mask->bits) {
+		free(mask->bits);
+		mask->bits = (uint64_t *)malloc(bitsSize * sizeof(uint64_t));
+		mask->bits_size = bitsSize;
+	}
+	if (scratchSize > mask->scratch_size || !mask->scratch) {
+		free(mask->scratch);
+		mask->scratch = (uint64_t *)malloc(scratchSize * sizeof(uint64_t));
+		mask->scratch_size = scratchSize;
+	}
+	mask->width = width;
+	mask->height = height;
+	mask->words = words;
+}
+
+void freeMask(struct marker_mask * mask) {
+	free(mask->bits);
+	free(mask->scratch);
+	memset(mask, 0, sizeof(*mask));
+}
+
+bool haveAvx2() {
+#if defined(MARKER_KERNEL_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 1);
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	if (!osxsave || (_xgetbv(0) & 6) != 6) return false;
+	__cpuidex(info, 7, 0);
+	return (info[1] & (1 << 5)) != 0;
+#elif defined(MARKER_KERNEL_X86)
+	return __builtin_cpu_supports("avx2") != 0;
+#else
+	return false;
+#endif
+}
+
+
+/* --------------------------------------------------
+	Thresholding
+-------------------------------------------------- */
+
+/* HSV of one pixel exactly as cvtColor(COLOR_BGR2HSV), tested against range */
+static inline bool inHsvRange(int b, int g, int r, const struct hsv_range & range) {
+	int v = b > g ? b : g;
+	v = v > r ? v : r;
+	int vmin = b < g ? b : g;
+	vmin = vmin < r ? vmin : r;
+	int diff = v - vmin;
+	int vr = v == r ? -1 : 0;
+	int vg = v == g ? -1 : 0;
+	int s = (diff * tables.sdiv[v] + (1 << (hsv_shift - 1))) >> hsv_shift;
+	int h = (vr & (g - b)) + (~vr & ((vg & (b - r + 2 * diff)) + ((~vg) & (r - g + 4 * diff))));
+	h = (h * tables.hdiv[diff] + (1 << (hsv_shift - 1))) >> hsv_shift;
+	h += h < 0 ? hue_range : 0;
+	return h >= range.h_min && h <= range.h_max
+		&& s >= range.s_min && s <= range.s_max
+		&& v >= range.v_min && v <= range.v_max;
+}
+
+/* Threshold view pixels from..width-1 of one row into out (bits already cleared) */
+static void thresholdRowScalar(const unsigned char * row, int from, int width, int step,
+	const struct hsv_range & range, uint64_t * out) {
+	const unsigned char * p = row + (size_t)from * step;
+	for (int x = from; x < width; x++, p += step) {
+		if (inHsvRange(p[0], p[1], p[2], range)) {
+			out[x >> 6] |= 1ULL << (x & 63);
+		}
+	}
+}
+
+#ifdef MARKER_KERNEL_X86
+/* Same as thresholdRowScalar, 8 pixels at a time */
+TARGET_AVX2 static void thresholdRowAvx2(const unsigned char * row, int width, int step,
+	const struct hsv_range & range, uint64_t * out) {
+	const __m256i lowByte = _mm256_set1_epi32(0xff);
+	const __m256i half = _mm256_set1_epi32(1 << (hsv_shift - 1));
+	const __m256i hr = _mm256_set1_epi32(hue_range);
+	const __m256i zero = _mm256_setzero_si256();
+	const __m256i hMin = _mm256_set1_epi32(range.h_min);
+	const __m256i hMax = _mm256_set1_epi32(range.h_max);
+	const __m256i sMin = _mm256_set1_epi32(range.s_min);
+	const __m256i sMax = _mm256_set1_epi32(range.s_max);
+	const __m256i vMin = _mm256_set1_epi32(range.v_min);
+	const __m256i vMax = _mm256_set1_epi32(range.v_max);
+	const __m256i offsets = _mm256_setr_epi32(0, step, 2 * step, 3 * step, 4 * step, 5 * step, 6 * step, 7 * step);
+
+	int x = 0;
+	for (; x + 8 <= width; x += 8) {
+		const unsigned char * p = row + (size_t)x * step;
+		__m256i px;
+		if (step == 4) {
+			px = _mm256_loadu_si256((const __m256i *)p);
+		}
+		else if (step == 8) {
+			// keep the even pixels of two dense loads: a0 a2 b0 b2 | a4 a6 b4 b6, then fix lane order
+			__m256 a = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i *)p));
+			__m256 b = _mm256_castsi256_ps(_mm256_loadu_si256((const __m256i *)(p + 32)));
+			__m256 even = _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0));
+			px = _mm256_permute4x64_epi64(_mm256_castps_si256(even), _MM_SHUFFLE(3, 1, 2, 0));
+		}
+		else {
+			px = _mm256_i32gather_epi32((const int *)p, offsets, 1);
+		}
+
+		__m256i b = _mm256_and_si256(px, lowByte);
+		__m256i g = _mm256_and_si256(_mm256_srli_epi32(px, 8), lowByte);
+		__m256i r = _mm256_and_si256(_mm256_srli_epi32(px, 16), lowByte);
+		__m256i v = _mm256_max_epi32(_mm256_max_epi32(b, g), r);
+		__m256i vmin = _mm256_min_epi32(_mm256_min_epi32(b, g), r);
+		__m256i diff = _mm256_sub_epi32(v, vmin);
+		__m256i vr = _mm256_cmpeq_epi32(v, r);
+		__m256i vg = _mm256_cmpeq_epi32(v, g);
+
+		__m256i sdiv = _mm256_i32gather_epi32(tables.sdiv, v, 4);
+		__m256i s = _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(diff, sdiv), half), hsv_shift);
+
+		__m256i diff2 = _mm256_add_epi32(diff, diff);
+		__m256i hg = _mm256_add_epi32(_mm256_sub_epi32(b, r), diff2); // v == g
+		__m256i hb = _mm256_add_epi32(_mm256_sub_epi32(r, g), _mm256_add_epi32(diff2, diff2)); // v == b
+		__m256i h = _mm256_add_epi32(_mm256_and_si256(vg, hg), _mm256_andnot_si256(vg, hb));
+		h = _mm256_add_epi32(_mm256_and_si256(vr, _mm256_sub_epi32(g, b)), _mm256_andnot_si256(vr, h));
+		__m256i hdiv = _mm256_i32gather_epi32(tables.hdiv, diff, 4);
+		h = _mm256_srai_epi32(_mm256_add_epi32(_mm256_mullo_epi32(h, hdiv), half), hsv_shift);
+		h = _mm256_add_epi32(h, _mm256_and_si256(_mm256_cmpgt_epi32(zero, h), hr));
+
+		__m256i out_of_range = _mm256_or_si256(_mm256_cmpgt_epi32(hMin, h), _mm256_cmpgt_epi32(h, hMax));
+		out_of_range = _mm256_or_si256(out_of_range, _mm256_cmpgt_epi32(sMin, s));
+		out_of_range = _mm256_or_si256(out_of_range, _mm256_cmpgt_epi32(s, sMax));
+		out_of_range = _mm256_or_si256(out_of_range, _mm256_cmpgt_epi32(vMin, v));
+		out_of_range = _mm256_or_si256(out_of_range, _mm256_cmpgt_epi32(v, vMax));
+		unsigned int inside = ~(unsigned int)_mm256_movemask_ps(_mm256_castsi256_ps(out_of_range)) & 0xff;
+		out[x >> 6] |= (uint64_t)inside << (x & 63);
+	}
+	thresholdRowScalar(row, x, width, step, range, out);
+}
+#endif
+
+
+/* --------------------------------------------------
+	Morphology on packed rows
+-------------------------------------------------- */
+
+/* Horizontal erode (and) or dilate (or) of one packed row over bit offsets lo..hi.
+ Pixels outside the row count as neutral, like OpenCV's default constant border */
+static void morphRow(const uint64_t * in, uint64_t * out, int words, int width, int lo, int hi, bool erode) {
+	const uint64_t fill = erode ? ~0ULL : 0ULL;
+	const uint64_t tail = (width & 63) ? (~0ULL << (width & 63)) : 0ULL; // bits past width in the last word
+	for (int w = 0; w < words; w++) {
+		// the row words w-1, w, w+1 with neutral bits outside the image
+		uint64_t prev = w > 0 ? in[w - 1] : fill;
+		uint64_t cur = in[w];
+		uint64_t next = w + 1 < words ? in[w + 1] : fill;
+		if (erode) {
+			if (w == words - 1) cur |= tail;
+			if (w + 1 == words - 1) next |= tail;
+		}
+		uint64_t acc = fill;
+		for (int k = lo; k <= hi; k++) {
+			// bit x of shifted = bit x + k of the row
+			uint64_t shifted;
+			if (k > 0) shifted = (cur >> k) | (next << (64 - k));
+			else if (k < 0) shifted = (cur << -k) | (prev >> (64 + k));
+			else shifted = cur;
+			acc = erode ? (acc & shifted) : (acc | shifted);
+		}
+		out[w] = acc;
+	}
+	out[words - 1] &= ~tail;
+}
+
+void thresholdMarker(const struct bgra_view & src, const struct hsv_range & range,
+	struct marker_mask * mask, kernel_impl impl) {
+	resizeMask(mask, src.width, src.height);
+	const int words = mask->words;
+	const int height = src.height;
+	uint64_t * eroded = mask->scratch; // erode_rows ring: thresholded, eroded along the row
+	uint64_t * dilated = eroded + (size_t)erode_rows * words; // dilate_rows ring: eroded, dilated along the row
+	uint64_t * row = dilated + (size_t)dilate_rows * words;
+
+	bool simd = false;
+#ifdef MARKER_KERNEL_X86
+	static const bool avx2 = haveAvx2();
+	simd = (impl == KERNEL_AUTO || impl == KERNEL_AVX2) && avx2;
+#endif
+
+	for (int y = 0; y < height + lag; y++) {
+		// threshold row y
+		if (y < height) {
+			const unsigned char * pixels = src.data + src.row_step * y;
+			memset(row, 0, words * sizeof(uint64_t));
+#ifdef MARKER_KERNEL_X86
+			if (simd) thresholdRowAvx2(pixels, src.width, src.pixel_step, range, row);
+			else
+#endif
+			thresholdRowScalar(pixels, 0, src.width, src.pixel_step, range, row);
+			morphRow(row, eroded + (size_t)(y % erode_rows) * words, words, src.width, erode_lo, erode_hi, true);
+		}
+		// finish eroding row r (needs rows up to r + erode_hi) and dilate it along the row
+		int r = y - erode_hi;
+		if (r >= 0 && r < height) {
+			int first = r + erode_lo > 0 ? r + erode_lo : 0;
+			int last = r + erode_hi < height - 1 ? r + erode_hi : height - 1;
+			for (int w = 0; w < words; w++) {
+				uint64_t acc = ~0ULL;
+				for (int i = first; i <= last; i++) {
+					acc &= eroded[(size_t)(i % erode_rows) * words + w];
+				}
+				row[w] = acc;
+			}
+			morphRow(row, dilated + (size_t)(r % dilate_rows) * words, words, src.width, dilate_lo, dilate_hi, false);
+		}
+		// finish dilating row o (needs rows up to o + dilate_hi, i.e. r)
+		int o = y - lag;
+		if (o >= 0 && o < height) {
+			int first = o + dilate_lo > 0 ? o + dilate_lo : 0;
+			int last = o + dilate_hi < height - 1 ? o + dilate_hi : height - 1;
+			uint64_t * out = mask->bits + (size_t)o * words;
+			for (int w = 0; w < words; w++) {
+				uint64_t acc = 0;
+				for (int i = first; i <= last; i++) {
+					acc |= dilated[(size_t)(i % dilate_rows) * words + w];
+				}
+				out[w] = acc;
+			}
+		}
+	}
+}
+
+void unpackMask(const struct marker_mask & mask, unsigned char * dst, size_t dst_step) {
+	for (int y = 0; y < mask.height; y++) {
+		const uint64_t * bits = mask.bits + (size_t)y * mask.words;
+		unsigned char * out = dst + dst_step * y;
+		for (int x = 0; x < mask.width; x++) {
+			out[x] = (bits[x >> 6] >> (x & 63)) & 1 ? 255 : 0;
+		}
+	}
+}
+
+long long countMask(const struct marker_mask & mask) {
+	long long n = 0;
+	size_t total = (size_t)mask.words * mask.height;
+	for (size_t i = 0; i < total; i++) {
+		uint64_t w = mask.bits[i];
+		// population count, bit tricks keep it portable
+		w = w - ((w >> 1) & 0x5555555555555555ULL);
+		w = (w & 0x3333333333333333ULL) + ((w >> 2) & 0x3333333333333333ULL);
+		w = (w + (w >> 4)) & 0x0f0f0f0f0f0f0f0fULL;
+		n += (long long)((w * 0x0101010101010101ULL) >> 56);
+	}
+	return n;
+}
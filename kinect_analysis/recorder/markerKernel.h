@@ -0,0 +1,70 @@
+/* *******************************************************************************
+ *	                              markerKernel.h
+ *
+ * Fused marker threshold kernel.
+ * Does in one pass over the BGRA pixels what the tracker used to do with
+ *   cvtColor(BGR2HSV) -> inRange -> erode 3x3 (x2) -> dilate 8x8 (x2)
+ * and writes a bit-packed mask (one bit per pixel). The result is identical
+ * to the OpenCV chain, including OpenCV's integer HSV rounding and its
+ * constant borders. AVX2 is used when the CPU has it; the scalar version
+ * produces the same bits.
+ *********************************************************************************/
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Strided view of a BGRA image, e.g. every second pixel of every second row
+struct bgra_view {
+	const unsigned char * data; // first pixel of the view
+	int width; // pixels in the view
+	int height;
+	int pixel_step; // bytes between neighbouring view pixels (4 = dense)
+	size_t row_step; // bytes between view rows
+};
+
+struct hsv_range {
+	int h_min, h_max;
+	int s_min, s_max;
+	int v_min, v_max;
+};
+
+// Bit-packed binary image. Bit x of row y is bit (x % 64) of bits[y * words + x / 64].
+// Bits past width are always zero.
+struct marker_mask {
+	int width;
+	int height;
+	int words; // 64-bit words per row
+	uint64_t * bits;
+	uint64_t * scratch; // row rings used while filtering
+	size_t bits_size; // allocated words
+	size_t scratch_size;
+};
+
+enum kernel_impl {
+	KERNEL_AUTO, // AVX2 if available
+	KERNEL_SCALAR,
+	KERNEL_AVX2
+};
+
+/* View of a c_width x c_height style BGRA buffer, taking every step-th pixel of the given rectangle
+ (rectangle in view pixels). Reads may touch the skipped pixel right after the last view pixel of a row */
+struct bgra_view makeBgraView(const unsigned char * bgra, int bufWidth, int step, int x, int y, int width, int height);
+
+/* Size the mask for a width x height image. Only reallocates when it grows */
+void resizeMask(struct marker_mask * mask, int width, int height);
+void freeMask(struct marker_mask * mask);
+
+/* Is AVX2 usable on this machine */
+bool haveAvx2();
+
+/* Threshold src by range, erode 3x3 twice and dilate 8x8 twice into mask (resized to src) */
+void thresholdMarker(const struct bgra_view & src, const struct hsv_range & range,
+	struct marker_mask * mask, kernel_impl impl = KERNEL_AUTO);
+
+/* Expand the mask to one byte per pixel (0 / 255), as inRange would produce */
+void unpackMask(const struct marker_mask & mask, unsigned char * dst, size_t dst_step);
+
+/* Number of set bits (pixels) in the mask */
+long long countMask(const struct marker_mask & mask);
@@ -0,0 +1,204 @@
+/* *******************************************************************************
+ *	                              markerSearch.cpp
+ *
+ * Kalman filter per axis, state (position, velocity), white acceleration
+ * noise. The window half size is SEARCH_SIGMAS standard deviations of the
+ * predicted centroid plus the marker's own half extent. A blob that touches
+ * an inner window edge may be cut off, so it also counts as a miss.
+ *********************************************************************************/
+
+#include "markerSearch.h"
+
+#include <string.h>
+#include <math.h>
+
+#include <iostream>
+
+using namespace std;
+using namespace cv;
+
+static void predictAxis(struct motion_axis * a, double dt) {
+	double q = SEARCH_ACCEL_SD * SEARCH_ACCEL_SD;
+	a->p += a->v * dt;
+	a->pp += dt * (2 * a->pv + dt * a->vv) + q * dt * dt * dt * dt / 4;
+	a->pv += dt * a->vv + q * dt * dt * dt / 2;
+	a->vv += q * dt * dt;
+}
+
+static void updateAxis(struct motion_axis * a, double z) {
+	double s = a->pp + SEARCH_MEASURE_SD * SEARCH_MEASURE_SD;
+	double kp = a->pp / s;
+	double kv = a->pv / s;
+	double e = z - a->p;
+	a->p += kp * e;
+	a->v += kv * e;
+	a->vv -= kv * a->pv;
+	a->pv -= kp * a->pv;
+	a->pp -= kp * a->pp;
+}
+
+static void startAxis(struct motion_axis * a, double z) {
+	a->p = z;
+	a->v = 0;
+	a->pp = SEARCH_MEASURE_SD * SEARCH_MEASURE_SD;
+	a->pv = 0;
+	a->vv = SEARCH_START_SPEED_SD * SEARCH_START_SPEED_SD;
+}
+
+/* Window half size of one axis */
+static int halfSize(const struct motion_axis & a, int radius) {
+	double sd = sqrt(a.pp + SEARCH_MEASURE_SD * SEARCH_MEASURE_SD);
+	int half = (int)ceil(SEARCH_SIGMAS * sd) + radius;
+	return half < SEARCH_MIN_HALF ? SEARCH_MIN_HALF : half;
+}
+
+MarkerSearch::MarkerSearch() : n_blobs(0), mode(SEARCH_FIXED), area(0), found(false), prev_x(0), prev_y(0),
+	tracking(false), last_time(0), radius(0) {
+	memset(&range, 0, sizeof(range));
+	memset(&mask, 0, sizeof(mask));
+	memset(&labeler, 0, sizeof(labeler));
+	memset(&mx, 0, sizeof(mx));
+	memset(&my, 0, sizeof(my));
+	stats.frames = 0;
+	stats.pixels = 0;
+	stats.lost = 0;
+	stats.full_searches = 0;
+	stats.local_searches = 0;
+	stats.escalations = 0;
+}
+
+MarkerSearch::~MarkerSearch() {
+	freeMask(&mask);
+	freeBlobLabeler(&labeler);
+}
+
+/* Threshold one window and find the marker in it. x, y in window pixels,
+ cut if the blob touches a window edge that is not an image edge */
+bool MarkerSearch::searchWindow(const unsigned char * bgra, Rect win, float & x, float & y, bool & cut) {
+	{
+		ScopedTimer timer(threshold_time);
+		thresholdMarker(makeBgraView(bgra, c_width, small_step, win.x, win.y, win.width, win.height), range, &mask);
+	}
+	window = win;
+	area += win.width * win.height;
+	int ix, iy;
+	bool hit;
+	{
+		ScopedTimer timer(blob_time);
+		hit = findMarker(ix, iy, mask, &labeler, blobs, &n_blobs);
+	}
+	if (!hit) return false;
+	x = blobs[0].x;
+	y = blobs[0].y;
+	cut = (blobs[0].left == 0 && win.x > 0)
+		|| (blobs[0].top == 0 && win.y > 0)
+		|| (blobs[0].right == win.width - 1 && win.x + win.width < s_width)
+		|| (blobs[0].bottom == win.height - 1 && win.y + win.height < s_height);
+	return true;
+}
+
+bool MarkerSearch::search(const unsigned char * bgra, long long time, int & x, int & y) {
+	area = 0;
+	bool ok = mode == SEARCH_PREDICT ? searchPredicted(bgra, time, x, y) : searchFixed(bgra, x, y);
+	stats.frames++;
+	stats.pixels += area;
+	if (!ok) stats.lost++;
+	return ok;
+}
+
+/* Local square around the last position, full frame otherwise */
+bool MarkerSearch::searchFixed(const unsigned char * bgra, int & x, int & y) {
+	Rect interior(local_size, local_size, s_width - 2 * local_size, s_height - 2 * local_size);
+	float fx, fy;
+	bool cut;
+	if (found) {
+		// local search
+		stats.local_searches++;
+		found = searchWindow(bgra, Rect(prev_x - local_size, prev_y - local_size, 2 * local_size, 2 * local_size), fx, fy, cut);
+		if (found) {
+			x = (int)fx + prev_x - local_size - 1;
+			y = (int)fy + prev_y - local_size - 1;
+		}
+	}
+	else {
+		// full search
+		stats.full_searches++;
+		found = searchWindow(bgra, Rect(0, 0, s_width, s_height), fx, fy, cut);
+		if (found) {
+			x = (int)fx;
+			y = (int)fy;
+		}
+	}
+	found = found && interior.contains(Point(x, y));
+	if (found) {
+		prev_x = x;
+		prev_y = y;
+	}
+	return found;
+}
+
+/* Predicted window, widened on a miss, full frame last */
+bool MarkerSearch::searchPredicted(const unsigned char * bgra, long long time, int & x, int & y) {
+	Rect image(0, 0, s_width, s_height);
+	float fx = 0, fy = 0;
+	bool cut = false;
+	bool hit = false;
+	Rect win = image;
+	if (tracking) {
+		double dt = (time - last_time) * 1e-7;
+		if (dt <= 0 || dt > 0.5) dt = SEARCH_FRAME_TIME;
+		predictAxis(&mx, dt);
+		predictAxis(&my, dt);
+		int hx = halfSize(mx, radius);
+		int hy = halfSize(my, radius);
+		int cx = (int)floor(mx.p + 0.5);
+		int cy = (int)floor(my.p + 0.5);
+		for (int level = 0; level < SEARCH_LEVELS; level++) {
+			win = Rect(cx - (hx << level), cy - (hy << level), 2 * (hx << level) + 1, 2 * (hy << level) + 1) & image;
+			if (win.area() == 0 || win == image) break;
+			stats.local_searches++;
+			hit = searchWindow(bgra, win, fx, fy, cut) && !cut;
+			if (hit) break;
+			stats.escalations++;
+		}
+	}
+	if (!hit) {
+		win = image;
+		stats.full_searches++;
+		hit = searchWindow(bgra, win, fx, fy, cut);
+	}
+	last_time = time;
+	if (!hit) {
+		tracking = false;
+		return false;
+	}
+
+	double zx = win.x + fx;
+	double zy = win.y + fy;
+	if (tracking) {
+		updateAxis(&mx, zx);
+		updateAxis(&my, zy);
+	}
+	else {
+		startAxis(&mx, zx);
+		startAxis(&my, zy);
+		tracking = true;
+	}
+	const struct marker_blob & b = blobs[0];
+	int w = b.right - b.left;
+	int h = b.bottom - b.top;
+	radius = (w > h ? w : h) / 2 + 1;
+	x = (int)zx;
+	y = (int)zy;
+	return true;
+}
+
+void MarkerSearch::printStats(int channel) const {
+	long long n = stats.frames;
+	if (n == 0) return;
+	double perFrame = (double)stats.pixels / n;
+	cout << "marker " << channel << " search: " << n << " frames, " << (long long)perFrame << " px/frame ("
+		<< (int)(100 * perFrame / (s_width * s_height)) << "% of full), "
+		<< stats.lost << " lost, " << stats.local_searches << " local / " << stats.full_searches << " full searches, "
+		<< stats.escalations << " escalations" << endl;
+}
@@ -0,0 +1,96 @@
+/* *******************************************************************************
+ *	                              markerSearch.h
+ *
+ * Frame to frame marker search.
+ * SEARCH_FIXED is the original scheme: a square of local_size around the last
+ * position, a full frame search when that fails.
+ * SEARCH_PREDICT predicts position and velocity with a constant velocity
+ * Kalman filter (one per axis) and sizes the window from the predicted
+ * position variance. A miss widens the window (x2 per level) before falling
+ * back to the full frame, so fast swings stay in the cheap local search.
+ *********************************************************************************/
+
+#pragma once
+
+#include <atomic>
+
+#include <opencv2/opencv.hpp>
+
+#include "latencyStats.h"
+#include "markerKernel.h"
+#include "markerBlobs.h"
+#include "markerTracker.h"
+
+enum search_mode {
+	SEARCH_FIXED,
+	SEARCH_PREDICT
+};
+
+// Predictive search tuning (small image pixels, seconds)
+const double SEARCH_ACCEL_SD = 20000; // marker acceleration noise, px/s^2 (a swing is fast)
+const double SEARCH_MEASURE_SD = 1.5; // centroid noise, px
+const double SEARCH_START_SPEED_SD = 1000; // velocity uncertainty when the marker is (re)found, px/s
+const double SEARCH_SIGMAS = 3; // window half size in standard deviations of the prediction
+const int SEARCH_MIN_HALF = 16; // smallest window half size, px
+const int SEARCH_LEVELS = 3; // windows tried before the full frame search
+const double SEARCH_FRAME_TIME = 1.0 / 30; // used when frame times are missing
+
+// Counters, updated by the tracking thread
+struct search_stats {
+	std::atomic<long long> frames;
+	std::atomic<long long> pixels; // thresholded pixels, all windows of all frames
+	std::atomic<long long> lost; // frames without marker
+	std::atomic<long long> full_searches;
+	std::atomic<long long> local_searches; // windows searched around the last or predicted position
+	std::atomic<long long> escalations; // windows widened after a miss
+};
+
+// Constant velocity filter of one image axis
+struct motion_axis {
+	double p, v; // position, velocity
+	double pp, pv, vv; // covariance
+};
+
+class MarkerSearch {
+public:
+	MarkerSearch();
+	~MarkerSearch();
+	void setMode(search_mode m) { mode = m; }
+	void setRange(const struct hsv_range & r) { range = r; }
+	/* Find the marker in a c_width x c_height BGRA frame taken at time (100 ns ticks).
+	   true and x, y in small image pixels if found */
+	bool search(const unsigned char * bgra, long long time, int & x, int & y);
+	/* Mask and window (small image pixels) of the last search */
+	const struct marker_mask & lastMask() const { return mask; }
+	cv::Rect lastWindow() const { return window; }
+	int lastArea() const { return area; } // pixels thresholded for the last frame
+	/* Print the counters, labeled with the marker channel */
+	void printStats(int channel) const;
+
+	struct search_stats stats;
+	LatencyHistogram threshold_time; // thresholdMarker per window (HSV threshold and morphology)
+	LatencyHistogram blob_time; // findMarker per window (labeling, the tracked blob)
+	struct marker_blob blobs[MAX_MARKER_BLOBS]; // candidates of the last successful window
+	int n_blobs;
+private:
+	bool searchWindow(const unsigned char * bgra, cv::Rect win, float & x, float & y, bool & cut);
+	bool searchFixed(const unsigned char * bgra, int & x, int & y);
+	bool searchPredicted(const unsigned char * bgra, long long time, int & x, int & y);
+
+	search_mode mode;
+	struct hsv_range range;
+	struct marker_mask mask;
+	struct blob_labeler labeler;
+	cv::Rect window;
+	int area;
+
+	// fixed mode
+	bool found;
+	int prev_x, prev_y;
+
+	// predict mode
+	bool tracking;
+	long long last_time;
+	struct motion_axis mx, my;
+	int radius; // half extent of the last blob
+};
@@ -0,0 +1,92 @@
+/* *******************************************************************************
+ *	                              markerTracker.cpp
+ *
+ * Marker tracking functions
+ * - object tracking is based on this tutorial:
+	https://www.youtube.com/watch?v=bSeFrPrqZ2A
+ *********************************************************************************/
+
+#include "markerTracker.h"
+
+#include <vector>
+
+using namespace std;
+using namespace cv;
+
+/* Make the thresholded image less noisy */
+void morphOps(Mat &thresh) {
+	//create structuring element that will be used to "dilate" and "erode" image.
+	//the element chosen here is a 3px by 3px rectangle
+
+	Mat erodeElement = getStructuringElement(MORPH_RECT, Size(3, 3));
+	//dilate with larger element so make sure object is nicely visible
+	Mat dilateElement = getStructuringElement(MORPH_RECT, Size(8, 8));
+
+	erode(thresh, thresh, erodeElement);
+	erode(thresh, thresh, erodeElement);
+
+	dilate(thresh, thresh, dilateElement);
+	dilate(thresh, thresh, dilateElement);
+}
+
+/* Set x, y to center of the object in the filtered image */
+bool trackFilteredObject(int &x, int &y, Mat threshold) {
+
+	Mat temp;
+	threshold.copyTo(temp);
+	//these two vectors needed for output of findContours
+	vector< vector<Point> > contours;
+	vector<Vec4i> hierarchy;
+	//find contours of filtered image using openCV findContours function
+	findContours(temp, contours, hierarchy, CV_RETR_CCOMP, CV_CHAIN_APPROX_SIMPLE);
+	//use moments method to find our filtered object
+	double refArea = 0;
+	bool objectFound = false;
+	if (hierarchy.size() > 0) {
+		int numObjects = hierarchy.size();
+		//if number of objects greater than MAX_NUM_OBJECTS we have a noisy filter
+		if (numObjects<MAX_NUM_OBJECTS) {
+			for (int index = 0; index >= 0; index = hierarchy[index][0]) {
+
+				Moments moment = moments((cv::Mat)contours[index]);
+				double area = moment.m00;
+
+				//if the area is less than 20 px by 20px then it is probably just noise
+				//if the area is the same as the 3/2 of the image size, probably just a bad filter
+				//we only want the object with the largest area so we safe a reference area each
+				//iteration and compare it to the area in the next iteration.
+				if (area>MIN_OBJECT_AREA && area>refArea) {
+					x = moment.m10 / area;
+					y = moment.m01 / area;
+					objectFound = true;
+					refArea = area;
+				}
+				//else objectFound = false;
+			}
+		}
+	}
+	return objectFound;
+}
+
+bool findMarker(int &x, int &y, const struct marker_mask & mask, struct blob_labeler * labeler,
+	struct marker_blob * blobs, int * n_blobs) {
+	*n_blobs = findBlobs(mask, labeler, MIN_OBJECT_AREA, blobs, MAX_MARKER_BLOBS);
+	//if number of objects greater than MAX_NUM_OBJECTS we have a noisy filter
+	//(blobs and their holes, as the contours findContours(CV_RETR_CCOMP) returned)
+	if (labeler->components + labeler->holes >= MAX_NUM_OBJECTS || *n_blobs == 0) return false;
+	x = (int)blobs[0].x;
+	y = (int)blobs[0].y;
+	return true;
+}
+
+void thresholdMarkerCv(const Mat & bgra, const struct hsv_range & range, Mat & thresImg) {
+	Mat HSVimg;
+	cvtColor(bgra, HSVimg, COLOR_BGR2HSV);
+	inRange(HSVimg, Scalar(range.h_min, range.s_min, range.v_min), Scalar(range.h_max, range.s_max, range.v_max), thresImg);
+	morphOps(thresImg);
+}
+
+void maskToMat(const struct marker_mask & mask, Mat & thresImg) {
+	thresImg.create(mask.height, mask.width, CV_8UC1);
+	unpackMask(mask, thresImg.data, thresImg.step);
+}
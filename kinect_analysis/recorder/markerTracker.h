@@ -0,0 +1,42 @@
+/* *******************************************************************************
+ *	                              markerTracker.h
+ *
+ * Color marker tracking: find the marker blob in a thresholded image.
+ *********************************************************************************/
+
+#pragma once
+
+#include <opencv2/opencv.hpp>
+
+#include "frameSource.h"
+#include "markerKernel.h"
+#include "markerBlobs.h"
+
+// Marker tracking constants
+const int MAX_NUM_OBJECTS = 50;
+const int MIN_OBJECT_AREA = 20 * 20;
+const int MAX_MARKER_BLOBS = 4; // candidates kept per search
+
+const float small_ratio = 0.5;
+const int s_width = int(c_width * small_ratio);
+const int s_height = int(c_height * small_ratio);
+const float local_ratio = 0.2; // < 0.5
+const int local_size = int(s_height * local_ratio);
+const int small_step = int(1 / small_ratio); // color pixels per small image pixel
+
+/* Make the thresholded image less noisy */
+void morphOps(cv::Mat &thresh);
+
+/* Set x, y to center of the object in the filtered image (findContours version) */
+bool trackFilteredObject(int &x, int &y, cv::Mat threshold);
+
+/* Set x, y to center of the largest blob of the mask, same rules as trackFilteredObject.
+ blobs (MAX_MARKER_BLOBS) receives the candidates, largest first, n_blobs their number */
+bool findMarker(int &x, int &y, const struct marker_mask & mask, struct blob_labeler * labeler,
+	struct marker_blob * blobs, int * n_blobs);
+
+/* The OpenCV chain the fused kernel replaces: HSV, range test, morphOps */
+void thresholdMarkerCv(const cv::Mat & bgra, const struct hsv_range & range, cv::Mat & thresImg);
+
+/* Expand a packed mask into a 0/255 Mat for findContours and display */
+void maskToMat(const struct marker_mask & mask, cv::Mat & thresImg);
@@ -0,0 +1,52 @@
+/* *******************************************************************************
+ *	                              recordExtract.cpp
+ *
+ * Only the schema's bodies and joints are touched, so a row costs what the
+ * schema records. Bodies are matched to their slots by tracking id, a few
+ * compares for at most BODY_COUNT bodies.
+ *********************************************************************************/
+
+#include "recordExtract.h"
+
+void writeMarker(struct record_row * rec, FrameSource * source, const struct kinect_frame & frame, int m, float x, float y) {
+	CameraSpacePoint mp;
+	rec->haveMarker[m] = source->mapColorPoint(frame, x, y, mp);
+	if (!rec->haveMarker[m]) return;
+	rec->marker[m].X = mp.X;
+	rec->marker[m].Y = mp.Y;
+	rec->marker[m].Z = mp.Z;
+}
+
+void writeBodies(struct record_row * rec, const struct record_schema & schema, const struct kinect_frame & frame,
+	struct body_slots * slots) {
+	int in[BODY_COUNT]; // frame body in each slot, -1 for none
+	bool placed[BODY_COUNT] = { false };
+	for (int b = 0; b < schema.bodies; b++) {
+		in[b] = -1;
+		for (int i = 0; slots->used[b] && i < frame.bodies; i++) {
+			if (frame.body[i].id == slots->id[b]) in[b] = i;
+		}
+		if (in[b] >= 0) placed[in[b]] = true;
+		slots->used[b] = in[b] >= 0;
+	}
+	for (int i = 0, b = 0; i < frame.bodies; i++) {
+		if (placed[i]) continue;
+		while (b < schema.bodies && slots->used[b]) b++;
+		if (b == schema.bodies) break;
+		in[b] = i;
+		slots->used[b] = true;
+		slots->id[b] = frame.body[i].id;
+	}
+	for (int b = 0; b < schema.bodies; b++) {
+		rec->haveBody[b] = in[b] >= 0;
+		if (!rec->haveBody[b]) continue;
+		const struct kinect_body & body = frame.body[in[b]];
+		rec->bodyId[b] = body.id;
+		for (int j = 0; j < schema.joints; j++) {
+			const CameraSpacePoint & p = body.joints[schema.joint_ids[j]].Position;
+			rec->joint[b][j].X = p.X;
+			rec->joint[b][j].Y = p.Y;
+			rec->joint[b][j].Z = p.Z;
+		}
+	}
+}
@@ -0,0 +1,27 @@
+/* *******************************************************************************
+ *	                              recordExtract.h
+ *
+ * The tracker's extract stage: fills a record_row from a frame, the marker
+ * positions mapped to camera space and the schema's body joints. Shared by
+ * kinectTracker3 and trackerBench, so the bench times the tracker's code.
+ *********************************************************************************/
+
+#pragma once
+
+#include "frameSource.h"
+#include "recordWriter.h"
+
+/* Camera space position of marker channel m at color pixel (x, y).
+ No marker if there is no depth at its position */
+void writeMarker(struct record_row * rec, FrameSource * source, const struct kinect_frame & frame, int m, float x, float y);
+
+// Which body each recorded body slot holds, carried from frame to frame. Must start zeroed
+struct body_slots {
+	bool used[BODY_COUNT];
+	unsigned long long id[BODY_COUNT]; // tracking id of the body in the slot
+};
+
+/* Body tracking information of the schema's joints. A body keeps its slot while it is tracked
+ (the sensor's order changes as bodies come and go); a new body takes the first free slot */
+void writeBodies(struct record_row * rec, const struct record_schema & schema, const struct kinect_frame & frame,
+	struct body_slots * slots);
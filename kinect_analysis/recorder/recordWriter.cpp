@@ -0,0 +1,363 @@
+/* *******************************************************************************
+ *	                              recordWriter.cpp
+ *
+ * Background block writer for column blocks and the kindata.txt exporter.
+ *********************************************************************************/
+
+#include "recordWriter.h"
+#include "clockSync.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <iostream>
+
+using namespace std;
+
+static const char record_magic[8] = "KTREC03";
+
+void defaultSchema(struct record_schema * schema) {
+	memset(schema, 0, sizeof(*schema));
+	schema->markers = 1;
+	schema->bodies = 1;
+	schema->joints = 4;
+	schema->joint_ids[0] = JointType_ShoulderLeft;
+	schema->joint_ids[1] = JointType_ElbowLeft;
+	schema->joint_ids[2] = JointType_WristLeft;
+	schema->joint_ids[3] = JointType_SpineShoulder;
+}
+
+void recordLayout(const struct record_schema & schema, int frames, struct record_layout * layout) {
+	memset(layout, 0, sizeof(*layout));
+	int bitmap = frames / 64 * sizeof(uint64_t);
+	int xyz = 3 * frames * sizeof(float);
+	int at = 2 * sizeof(int);
+	layout->st = at;
+	at += frames * sizeof(SYSTEMTIME);
+	at = (at + 7) / 8 * 8;
+	layout->time = at;
+	at += frames * sizeof(long long);
+	layout->host_ns = at;
+	at += frames * sizeof(long long);
+	for (int m = 0; m < schema.markers; m++) {
+		layout->marker_valid[m] = at;
+		at += bitmap;
+		layout->marker_xyz[m] = at;
+		at += xyz;
+	}
+	for (int b = 0; b < schema.bodies; b++) {
+		layout->body_valid[b] = at;
+		at += bitmap;
+		layout->body_id[b] = at;
+		at += frames * sizeof(unsigned long long);
+		for (int j = 0; j < schema.joints; j++) {
+			layout->joint_xyz[b][j] = at;
+			at += xyz;
+		}
+	}
+	layout->bytes = at;
+}
+
+/* Is the schema within the limits of record_row */
+static bool validSchema(const struct record_schema & schema) {
+	if (schema.markers < 0 || schema.markers > MAX_MARKERS) return false;
+	if (schema.bodies < 0 || schema.bodies > BODY_COUNT) return false;
+	if (schema.joints < 0 || schema.joints > JointType_Count) return false;
+	for (int j = 0; j < schema.joints; j++) {
+		if (schema.joint_ids[j] < 0 || schema.joint_ids[j] >= JointType_Count) return false;
+	}
+	return true;
+}
+
+RecordWriter::RecordWriter() : active(NULL), recording(false), starting(false), n_frames(0), n_dropped(0), out(NULL),
+	failed(false), quit(false) {
+	blocks = new struct record_block[REC_BLOCKS];
+	for (int i = 0; i < REC_BLOCKS; i++) {
+		blocks[i].data = NULL;
+		blocks[i].capacity = 0;
+		free_blocks.push(&blocks[i]);
+	}
+	defaultSchema(&schema);
+	recordLayout(schema, REC_BLOCK_FRAMES, &layout);
+	path[0] = '\0';
+	text_path[0] = '\0';
+	writer = std::thread(&RecordWriter::run, this);
+}
+
+RecordWriter::~RecordWriter() {
+	stop();
+	quit = true;
+	writer.join();
+	for (int i = 0; i < REC_BLOCKS; i++) {
+		free(blocks[i].data);
+	}
+	delete[] blocks;
+}
+
+bool RecordWriter::start(const char * recordPath, const char * textPath, const struct record_schema & recordSchema) {
+	stop();
+	if (!validSchema(recordSchema)) return false;
+	schema = recordSchema;
+	recordLayout(schema, REC_BLOCK_FRAMES, &layout);
+	snprintf(path, REC_PATH_SIZE, "%s", recordPath);
+	snprintf(text_path, REC_PATH_SIZE, "%s", textPath ? textPath : "");
+	n_frames = 0;
+	n_dropped = 0;
+	recording = true;
+	starting = true;
+	return true;
+}
+
+/* Make sure there is an active block with room. false if all blocks are still queued for writing */
+bool RecordWriter::takeBlock() {
+	if (active) return true;
+	if (!free_blocks.pop(active)) return false;
+	// blocks grow to the largest schema used so far
+	if (active->capacity < layout.bytes) {
+		free(active->data);
+		active->data = (unsigned char *)malloc(layout.bytes);
+		active->capacity = layout.bytes;
+	}
+	// unused rows of the last block are written as zeros
+	memset(active->data, 0, layout.bytes);
+	active->bytes = layout.bytes;
+	active->count = 0;
+	active->first = starting;
+	active->last = false;
+	if (starting) {
+		struct record_file_header & header = active->header;
+		memset(&header, 0, sizeof(header));
+		memcpy(header.magic, record_magic, sizeof(record_magic));
+		header.block_frames = REC_BLOCK_FRAMES;
+		header.block_bytes = layout.bytes;
+		header.schema = schema;
+		snprintf(active->record_path, REC_PATH_SIZE, "%s", path);
+		starting = false;
+	}
+	return true;
+}
+
+/* Store a point into row i of an x, y, z column triple */
+static inline void putPoint(unsigned char * data, int offset, int i, const struct point_data & p) {
+	float * xyz = (float *)(data + offset);
+	xyz[i] = p.X;
+	xyz[REC_BLOCK_FRAMES + i] = p.Y;
+	xyz[2 * REC_BLOCK_FRAMES + i] = p.Z;
+}
+
+static inline void setValid(unsigned char * data, int offset, int i) {
+	((uint64_t *)(data + offset))[i >> 6] |= 1ULL << (i & 63);
+}
+
+void RecordWriter::append(const struct record_row & rec, bool wait) {
+	if (!recording) return;
+	while (!takeBlock()) {
+		if (!wait) {
+			n_dropped++;
+			return;
+		}
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	unsigned char * data = active->data;
+	int i = active->count++;
+	((SYSTEMTIME *)(data + layout.st))[i] = rec.st;
+	((long long *)(data + layout.time))[i] = rec.time;
+	((long long *)(data + layout.host_ns))[i] = rec.host_ns;
+	for (int m = 0; m < schema.markers; m++) {
+		if (!rec.haveMarker[m]) continue;
+		setValid(data, layout.marker_valid[m], i);
+		putPoint(data, layout.marker_xyz[m], i, rec.marker[m]);
+	}
+	for (int b = 0; b < schema.bodies; b++) {
+		if (!rec.haveBody[b]) continue;
+		setValid(data, layout.body_valid[b], i);
+		((unsigned long long *)(data + layout.body_id[b]))[i] = rec.bodyId[b];
+		for (int j = 0; j < schema.joints; j++) {
+			putPoint(data, layout.joint_xyz[b][j], i, rec.joint[b][j]);
+		}
+	}
+	n_frames++;
+	if (active->count == REC_BLOCK_FRAMES) {
+		full_blocks.push(active);
+		active = NULL;
+	}
+}
+
+void RecordWriter::stop() {
+	if (!recording) return;
+	// the last block closes the file, so one is needed even when empty
+	while (!takeBlock()) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+	active->last = true;
+	snprintf(active->record_path, REC_PATH_SIZE, "%s", path);
+	snprintf(active->export_path, REC_PATH_SIZE, "%s", text_path);
+	full_blocks.push(active);
+	active = NULL;
+	recording = false;
+}
+
+/* Writer thread: create session files, write full blocks, close finished sessions and export them.
+   After a failed write the rest of the session is skipped and it is not exported */
+void RecordWriter::run() {
+	struct record_block * block;
+	while (true) {
+		if (!full_blocks.pop(block)) {
+			if (quit) break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			continue;
+		}
+		if (block->first) {
+			out = fopen(block->record_path, "wb");
+			failed = !out || fwrite(&block->header, sizeof(block->header), 1, out) != 1;
+		}
+		if (block->count > 0 && !failed) {
+			((int *)block->data)[0] = block->count;
+			failed = fwrite(block->data, 1, block->bytes, out) != (size_t)block->bytes;
+		}
+		if (block->last) {
+			if (out && fclose(out) != 0) failed = true;
+			out = NULL;
+			if (failed) {
+				cerr << "cannot write " << block->record_path << ", the recording is incomplete and not exported" << endl;
+			}
+			else {
+				cout << "saved recorded data" << endl;
+				if (block->export_path[0]) {
+					if (exportKindata(block->record_path, block->export_path)) {
+						cout << "exported " << block->export_path << endl;
+					}
+					else {
+						cerr << "cannot export " << block->export_path << endl;
+					}
+				}
+			}
+			failed = false;
+		}
+		free_blocks.push(block);
+	}
+}
+
+
+/* --------------------------------------------------
+	Text export
+-------------------------------------------------- */
+
+/* Write one point as x, y, z columns */
+static void writePoint(FILE * out, const struct point_data & p) {
+	fprintf(out, "%f\t%f\t%f\t", p.X, p.Y, p.Z);
+}
+
+/* Row i of an x, y, z column triple */
+static inline struct point_data getPoint(const unsigned char * data, int offset, int frames, int i) {
+	const float * xyz = (const float *)(data + offset);
+	struct point_data p = { xyz[i], xyz[frames + i], xyz[2 * frames + i] };
+	return p;
+}
+
+static inline bool getValid(const unsigned char * data, int offset, int i) {
+	return (((const uint64_t *)(data + offset))[i >> 6] >> (i & 63)) & 1;
+}
+
+// acquisition latency varies by a few ms, frame times are exact
+static const long long frame_time_uncertainty_ns = 2000000;
+
+bool exportKindata(const char * recordPath, const char * textPath, const char * syncPath) {
+	FILE * in = fopen(recordPath, "rb");
+	if (!in) return false;
+	struct record_file_header header;
+	struct record_layout layout;
+	bool ok = fread(&header, sizeof(header), 1, in) == 1
+		&& memcmp(header.magic, record_magic, sizeof(record_magic)) == 0
+		&& validSchema(header.schema)
+		&& header.block_frames > 0 && header.block_frames % 64 == 0;
+	if (ok) {
+		recordLayout(header.schema, header.block_frames, &layout);
+		ok = layout.bytes == header.block_bytes;
+	}
+	if (!ok) {
+		fclose(in);
+		return false;
+	}
+	ClockSync device;
+	if (syncPath && loadClockSync(syncPath, device) <= 0) {
+		fclose(in);
+		return false;
+	}
+	FILE * out = fopen(textPath, "w");
+	if (!out) {
+		fclose(in);
+		return false;
+	}
+
+	const struct record_schema & schema = header.schema;
+	const int frames = header.block_frames;
+	unsigned char * block = (unsigned char *)malloc(layout.bytes);
+	const struct point_data zero = { 0, 0, 0 };
+
+	// the schema, for readers of other layouts than the default (MATLAB load skips % lines)
+	fprintf(out, "%% kindata markers %d bodies %d ids %d sync %d joints", schema.markers, schema.bodies,
+		schema.bodies > 1 ? 1 : 0, syncPath ? 1 : 0);
+	for (int j = 0; j < schema.joints; j++) fprintf(out, " %d", schema.joint_ids[j]);
+	fputs("\n", out);
+
+	// first pass: sensor clock -> host clock over the whole session, and the wall clock anchor
+	ClockSync sensor;
+	bool anchored = false;
+	double anchor = 0; // seconds since midnight at anchor_ns
+	long long anchor_ns = 0;
+	while (fread(block, layout.bytes, 1, in) == 1) {
+		int rows = ((int *)block)[0];
+		if (rows > frames) rows = frames;
+		const SYSTEMTIME * st = (const SYSTEMTIME *)(block + layout.st);
+		const long long * time = (const long long *)(block + layout.time);
+		const long long * host = (const long long *)(block + layout.host_ns);
+		for (int i = 0; i < rows; i++) {
+			if (!anchored) {
+				anchor = st[i].wHour * 3600 + st[i].wMinute * 60 + st[i].wSecond + st[i].wMilliseconds * 1e-3;
+				anchor_ns = host[i];
+				anchored = true;
+			}
+			if (time[i] != 0) sensor.addPair(host[i], time[i] * 100, frame_time_uncertainty_ns);
+		}
+	}
+	fseek(in, sizeof(header), SEEK_SET);
+
+	while (fread(block, layout.bytes, 1, in) == 1) {
+		int rows = ((int *)block)[0];
+		if (rows > frames) rows = frames;
+		const long long * time = (const long long *)(block + layout.time);
+		const long long * host = (const long long *)(block + layout.host_ns);
+		for (int i = 0; i < rows; i++) {
+			// time stamp
+			long long t = time[i] != 0 && sensor.valid() ? sensor.toHost(time[i] * 100) : host[i];
+			fprintf(out, "%.6f\t", anchor + (t - anchor_ns) * 1e-9);
+
+			// marker positions
+			for (int m = 0; m < schema.markers; m++) {
+				bool valid = getValid(block, layout.marker_valid[m], i);
+				fputs(valid ? "1\t" : "-1\t", out);
+				writePoint(out, valid ? getPoint(block, layout.marker_xyz[m], frames, i) : zero);
+			}
+
+			// joint positions
+			for (int b = 0; b < schema.bodies; b++) {
+				bool valid = getValid(block, layout.body_valid[b], i);
+				fputs(valid ? "1\t" : "-1\t", out);
+				if (schema.bodies > 1) fprintf(out, "%llu\t", valid ? ((const unsigned long long *)(block + layout.body_id[b]))[i] : 0ULL);
+				for (int j = 0; j < schema.joints; j++) {
+					writePoint(out, valid ? getPoint(block, layout.joint_xyz[b][j], frames, i) : zero);
+				}
+			}
+
+			// time on the synced device's clock
+			if (syncPath) fprintf(out, "%lld\t", device.toDevice(t));
+
+			fputs("\n", out);
+		}
+	}
+	free(block);
+	fclose(in);
+	return fclose(out) == 0;
+}
@@ -0,0 +1,146 @@
+/* *******************************************************************************
+ *	                              recordWriter.h
+ *
+ * Streaming recorder for tracked frames.
+ * What is recorded is set by a record_schema: a number of marker channels,
+ * a number of bodies and the joints recorded per body. Records are stored
+ * column-wise in fixed-size blocks (one array per coordinate of every
+ * channel plus a validity bitmap per marker and body), so storing a frame
+ * costs what the schema enables. Full blocks are written to disk by a
+ * background thread, so a session is only limited by disk space and
+ * neither starting nor stopping waits for formatting or I/O.
+ * The binary file is a record_file_header followed by the blocks;
+ * exportKindata() turns it into the kindata.txt layout read by parse_kindata.m.
+ *********************************************************************************/
+
+#pragma once
+
+#include <stdio.h>
+#include <stdint.h>
+
+#include <atomic>
+#include <thread>
+
+#include "kinectCompat.h"
+#include "spscQueue.h"
+
+// Recording variables
+struct point_data {
+	float X;
+	float Y;
+	float Z;
+};
+
+const int MAX_MARKERS = 4; // marker channels (HSV profiles)
+
+// What a recording contains
+struct record_schema {
+	int markers; // marker channels
+	int bodies; // tracked bodies, in the order the sensor reports them
+	int joints; // joints recorded per body
+	int joint_ids[JointType_Count]; // JointType of each recorded joint
+};
+
+/* The kindata.txt content so far: one marker, the first body's
+ left shoulder, elbow, wrist and the shoulder spine */
+void defaultSchema(struct record_schema * schema);
+
+// Everything measured for one time frame. Only the channels of the schema are filled
+struct record_row {
+	SYSTEMTIME st; // system time, anchors the session to the wall clock
+	long long time; // sensor time (100ns ticks), exact frame spacing
+	long long host_ns; // steady host clock at acquisition (hostNs)
+	bool haveMarker[MAX_MARKERS];
+	struct point_data marker[MAX_MARKERS]; // marker positions
+	bool haveBody[BODY_COUNT];
+	unsigned long long bodyId[BODY_COUNT];
+	struct point_data joint[BODY_COUNT][JointType_Count]; // by schema joint, not JointType
+};
+
+struct record_file_header {
+	char magic[8]; // "KTREC03"
+	int block_frames; // rows per block
+	int block_bytes; // size of one block
+	struct record_schema schema;
+};
+
+const int REC_BLOCK_FRAMES = 1024; // records per block (about 34 s at 30 fps), multiple of 64
+const int REC_BLOCKS = 4; // blocks in the ring, power of two
+const int REC_PATH_SIZE = 260;
+
+// Where the columns are in a block (byte offsets). A block is, in this order:
+//   int rows, int reserved
+//   SYSTEMTIME st[], long long time[], long long host_ns[]
+//   per marker: uint64_t valid[], float X[], Y[], Z[]
+//   per body: uint64_t valid[], unsigned long long id[], per joint float X[], Y[], Z[]
+// every array has block_frames entries (bitmaps block_frames / 64)
+struct record_layout {
+	int st, time, host_ns;
+	int marker_valid[MAX_MARKERS], marker_xyz[MAX_MARKERS];
+	int body_valid[BODY_COUNT], body_id[BODY_COUNT], joint_xyz[BODY_COUNT][JointType_Count];
+	int bytes;
+};
+
+/* Column offsets of a schema for blocks of frames rows */
+void recordLayout(const struct record_schema & schema, int frames, struct record_layout * layout);
+
+struct record_block {
+	int count; // records used
+	bool first; // create record_path and write header before this block
+	bool last; // close the file after writing this block
+	struct record_file_header header; // first block only
+	char export_path[REC_PATH_SIZE]; // text file to export to after closing (last block only)
+	char record_path[REC_PATH_SIZE]; // first and last block
+	unsigned char * data; // the columns
+	int bytes; // used size of data
+	int capacity; // allocated size of data
+};
+
+class RecordWriter {
+public:
+	RecordWriter();
+	~RecordWriter();
+	/* Start a new session with the given schema. textPath (may be NULL) receives a text export once
+	   the session is written. Returns right away: the writer thread creates the file once the previous
+	   session (which may use the same files) is written and exported. false if the schema is invalid;
+	   a file that cannot be written is reported when the session ends */
+	bool start(const char * path, const char * textPath, const struct record_schema & schema);
+	/* Append one record. Counts a drop if the disk falls that far behind, unless wait is set */
+	void append(const struct record_row & rec, bool wait = false);
+	/* End the session. Returns right away, the rest is written in the background */
+	void stop();
+	long long frames() const { return n_frames; }
+	long long dropped() const { return n_dropped; }
+private:
+	void run();
+	bool takeBlock();
+
+	struct record_block * blocks;
+	struct record_block * active;
+	SpscQueue<struct record_block *, REC_BLOCKS> full_blocks; // recording thread -> writer thread
+	SpscQueue<struct record_block *, REC_BLOCKS> free_blocks; // writer thread -> recording thread
+	bool recording; // between start and stop
+	bool starting; // the next block taken is the session's first
+	char path[REC_PATH_SIZE];
+	char text_path[REC_PATH_SIZE];
+	struct record_schema schema;
+	struct record_layout layout;
+	long long n_frames;
+	long long n_dropped;
+	FILE * out; // writer thread: the session being written
+	bool failed; // writer thread: a write of that session failed
+	std::atomic<bool> quit;
+	std::thread writer;
+};
+
+/* Write a binary recording as kindata.txt text, tab separated. false on error.
+   The first line describes the columns:
+     % kindata markers <markers> bodies <bodies> ids <0 / 1> sync <0 / 1> joints <JointType>...
+   Per row: time, then per marker: flag (1 / -1) and x y z, per body: flag and x y z of each joint.
+   With more than one body the body's tracking id (0 without one) follows its flag, so bodies
+   can be told apart. With the default schema this is the layout read by parse_kindata.m.
+   The time is seconds since midnight of the session start (it does not wrap within a session):
+   sensor frame times mapped to the host clock, anchored at the first frame's system time.
+   With a syncPath (see loadClockSync), a last column holds the frame time on that device's
+   clock in ns, directly comparable to the device's log stamps */
+bool exportKindata(const char * recordPath, const char * textPath, const char * syncPath = NULL);
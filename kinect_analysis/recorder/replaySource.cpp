@@ -0,0 +1,221 @@
+/* *******************************************************************************
+ *	                              replaySource.cpp
+ *
+ * Replay backend of FrameSource and the CaptureWriter producing its input.
+ * The capture file is memory mapped as a whole and frames are handed out
+ * without copying: rgb/xyz of the acquired frame point into the mapping.
+ *********************************************************************************/
+
+#include "frameSource.h"
+
+#include <string.h>
+#include <stdlib.h>
+
+#include <chrono>
+#include <thread>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+static const char capture_magic[8] = "KTCAP02";
+
+/* Round n up to the next multiple of CAPTURE_ALIGN */
+static long long alignUp(long long n) {
+	return (n + CAPTURE_ALIGN - 1) / CAPTURE_ALIGN * CAPTURE_ALIGN;
+}
+
+long long captureFrameBytes(int flags) {
+	long long n = alignUp(sizeof(struct capture_frame_header));
+	n += alignUp((long long)c_width * c_height * 4);
+	if (flags & CAPTURE_XYZ) {
+		n += alignUp((long long)c_width * c_height * sizeof(CameraSpacePoint));
+	}
+	return n;
+}
+
+
+/* --------------------------------------------------
+	Replay
+-------------------------------------------------- */
+
+class ReplayFrameSource : public FrameSource {
+public:
+	ReplayFrameSource(bool realtime) : realtime(realtime), data(NULL), size(0), next(0) {
+#ifdef _WIN32
+		file = INVALID_HANDLE_VALUE;
+		mapping = NULL;
+#else
+		fd = -1;
+#endif
+	}
+	~ReplayFrameSource();
+	bool open(const char * path);
+	frame_status acquire(struct kinect_frame & frame);
+private:
+	bool realtime;
+	unsigned char * data;
+	long long size;
+	struct capture_header header;
+	int next; // index of next frame to hand out
+	long long first_time;
+	std::chrono::steady_clock::time_point start;
+#ifdef _WIN32
+	HANDLE file;
+	HANDLE mapping;
+#else
+	int fd;
+#endif
+};
+
+/* Map the whole capture file and validate its header */
+bool ReplayFrameSource::open(const char * path) {
+#ifdef _WIN32
+	file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER sz;
+	if (!GetFileSizeEx(file, &sz)) return false;
+	size = sz.QuadPart;
+	if (size < (long long)sizeof(struct capture_header)) return false;
+	mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (!mapping) return false;
+	data = (unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (!data) return false;
+#else
+	fd = ::open(path, O_RDONLY);
+	if (fd < 0) return false;
+	struct stat st;
+	if (fstat(fd, &st) != 0) return false;
+	size = st.st_size;
+	if (size < (long long)sizeof(struct capture_header)) return false;
+	void * p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+	if (p == MAP_FAILED) return false;
+	data = (unsigned char *)p;
+	madvise(data, size, MADV_SEQUENTIAL);
+#endif
+	memcpy(&header, data, sizeof(header));
+	if (memcmp(header.magic, capture_magic, sizeof(capture_magic)) != 0) return false;
+	if (header.width != c_width || header.height != c_height) return false;
+	if (header.frame_bytes != captureFrameBytes(header.flags)) return false;
+	// a capture cut short (crash while recording) still replays what is complete
+	long long available = (size - CAPTURE_ALIGN) / header.frame_bytes;
+	if (header.frames <= 0 || header.frames > available) header.frames = (int)available;
+	return true;
+}
+
+ReplayFrameSource::~ReplayFrameSource() {
+#ifdef _WIN32
+	if (data) UnmapViewOfFile(data);
+	if (mapping) CloseHandle(mapping);
+	if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+#else
+	if (data) munmap(data, size);
+	if (fd >= 0) ::close(fd);
+#endif
+}
+
+/* Hand out the next recorded frame, pointing the frame buffers into the mapping */
+frame_status ReplayFrameSource::acquire(struct kinect_frame & kf) {
+	if (next >= header.frames) return FRAME_END;
+	unsigned char * rec = data + CAPTURE_ALIGN + header.frame_bytes * next;
+	struct capture_frame_header * fh = (struct capture_frame_header *)rec;
+
+	if (realtime) {
+		if (next == 0) {
+			first_time = fh->time;
+			start = std::chrono::steady_clock::now();
+		}
+		// time stamps are in 100ns ticks
+		std::this_thread::sleep_until(start + std::chrono::microseconds((fh->time - first_time) / 10));
+	}
+
+	kf.time = fh->time;
+	kf.bodies = fh->bodies < 0 ? 0 : fh->bodies > BODY_COUNT ? BODY_COUNT : fh->bodies; // a damaged capture
+	memcpy(kf.body, fh->body, sizeof(kf.body));
+	rec += alignUp(sizeof(struct capture_frame_header));
+	kf.rgb = rec;
+	kf.depth = NULL; // depth points are looked up in the stored map instead
+	kf.xyz = NULL;
+	if (header.flags & CAPTURE_XYZ) {
+		rec += alignUp((long long)c_width * c_height * 4);
+		kf.xyz = (CameraSpacePoint *)rec;
+	}
+	next++;
+	return FRAME_NEW;
+}
+
+FrameSource * openReplaySource(const char * path, bool realtime) {
+	ReplayFrameSource * source = new ReplayFrameSource(realtime);
+	if (!source->open(path)) {
+		delete source;
+		return NULL;
+	}
+	return source;
+}
+
+
+/* --------------------------------------------------
+	Capture writer
+-------------------------------------------------- */
+
+CaptureWriter::CaptureWriter() : fp(NULL) {
+	pad = (unsigned char *)calloc(CAPTURE_ALIGN, 1);
+	memset(&header, 0, sizeof(header));
+}
+
+CaptureWriter::~CaptureWriter() {
+	close();
+	free(pad);
+}
+
+/* Write a padded block */
+static bool writeAligned(FILE * fp, const void * buf, long long n, const unsigned char * pad) {
+	if (fwrite(buf, 1, (size_t)n, fp) != (size_t)n) return false;
+	long long rest = alignUp(n) - n;
+	return rest == 0 || fwrite(pad, 1, (size_t)rest, fp) == (size_t)rest;
+}
+
+/* Start a new capture file. The header is rewritten with the frame count on close() */
+bool CaptureWriter::open(const char * path, int flags) {
+	close();
+	fp = fopen(path, "wb");
+	if (!fp) return false;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, capture_magic, sizeof(capture_magic));
+	header.width = c_width;
+	header.height = c_height;
+	header.flags = flags;
+	header.frame_bytes = captureFrameBytes(flags);
+	return writeAligned(fp, &header, sizeof(header), pad);
+}
+
+/* Append one frame. Fails if the capture stores xyz but the frame has no map */
+bool CaptureWriter::write(const struct kinect_frame & kf) {
+	if (!fp) return false;
+	if ((header.flags & CAPTURE_XYZ) && !kf.xyz) return false;
+	struct capture_frame_header fh;
+	memset(&fh, 0, sizeof(fh));
+	fh.time = kf.time;
+	fh.bodies = kf.bodies;
+	memcpy(fh.body, kf.body, sizeof(fh.body));
+	bool ok = writeAligned(fp, &fh, sizeof(fh), pad);
+	ok = ok && writeAligned(fp, kf.rgb, (long long)c_width * c_height * 4, pad);
+	if (header.flags & CAPTURE_XYZ) {
+		ok = ok && writeAligned(fp, kf.xyz, (long long)c_width * c_height * sizeof(CameraSpacePoint), pad);
+	}
+	if (ok) header.frames++;
+	return ok;
+}
+
+/* Finish the header and close the file */
+void CaptureWriter::close() {
+	if (!fp) return;
+	fseek(fp, 0, SEEK_SET);
+	fwrite(&header, sizeof(header), 1, fp);
+	fclose(fp);
+	fp = NULL;
+}
@@ -0,0 +1,51 @@
+/* *******************************************************************************
+ *	                              spscQueue.h
+ *
+ * Bounded lock-free single producer / single consumer queue.
+ * Used to hand frames from one pipeline stage thread to the next. Neither side
+ * ever blocks: push() fails when the queue is full, pop() when it is empty,
+ * and the caller decides whether to drop, retry or do something else.
+ *********************************************************************************/
+
+#pragma once
+
+#include <atomic>
+#include <stddef.h>
+
+// keep producer and consumer indices on separate cache lines
+const size_t CACHE_LINE = 64;
+
+template <typename T, size_t N>
+class SpscQueue {
+	static_assert(N >= 2 && (N & (N - 1)) == 0, "queue size must be a power of two");
+public:
+	SpscQueue() : head(0), tail(0) {}
+
+	/* Producer side. false if the queue is full */
+	bool push(const T & item) {
+		size_t t = tail.load(std::memory_order_relaxed);
+		if (t - head.load(std::memory_order_acquire) == N) return false;
+		items[t & (N - 1)] = item;
+		tail.store(t + 1, std::memory_order_release);
+		return true;
+	}
+
+	/* Consumer side. false if the queue is empty */
+	bool pop(T & item) {
+		size_t h = head.load(std::memory_order_relaxed);
+		if (h == tail.load(std::memory_order_acquire)) return false;
+		item = items[h & (N - 1)];
+		head.store(h + 1, std::memory_order_release);
+		return true;
+	}
+
+	/* Approximate number of queued items (exact from either end's own thread) */
+	size_t size() const {
+		return tail.load(std::memory_order_acquire) - head.load(std::memory_order_acquire);
+	}
+
+private:
+	alignas(CACHE_LINE) std::atomic<size_t> head; // next slot to pop
+	alignas(CACHE_LINE) std::atomic<size_t> tail; // next slot to push
+	alignas(CACHE_LINE) T items[N];
+};
@@ -0,0 +1,69 @@
+/* *******************************************************************************
+ *	                              liveFeedCat
+ *
+ * Prints a tracker's live feed (kinectTracker3 -live <name>) as text, one
+ * line per tracked frame, for tools that read a pipe. A line is the sensor
+ * time in seconds, then per marker its flag (1 / -1) and x y z, then per
+ * body its flag and x y z of each recorded joint: the kindata.txt columns,
+ * with the sensor's time instead of the time of day. Follows the tracker
+ * across restarts; lost records (reader too slow) are reported on stderr.
+ *
+ * Usage: liveFeedCat <name>
+ * Build: ../liveFeed.cpp
+ *********************************************************************************/
+
+#include <stdio.h>
+
+#include <chrono>
+#include <thread>
+
+#include "../liveFeed.h"
+
+static void printRow(const struct record_schema & schema, const struct record_row & rec) {
+	printf("%.6f", rec.time * 1e-7);
+	for (int m = 0; m < schema.markers; m++) {
+		const struct point_data & p = rec.marker[m];
+		printf(" %d %f %f %f", rec.haveMarker[m] ? 1 : -1, p.X, p.Y, p.Z);
+	}
+	for (int b = 0; b < schema.bodies; b++) {
+		printf(" %d", rec.haveBody[b] ? 1 : -1);
+		for (int j = 0; j < schema.joints; j++) {
+			const struct point_data & p = rec.joint[b][j];
+			printf(" %f %f %f", p.X, p.Y, p.Z);
+		}
+	}
+	printf("\n");
+}
+
+int main(int argc, char ** argv) {
+	if (argc != 2) {
+		printf("usage: liveFeedCat <name>\n");
+		return 1;
+	}
+	LiveFeedReader reader;
+	struct record_row rec;
+	long long lost = 0;
+	for (;;) {
+		if (!reader.open(argv[1])) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(200));
+			continue;
+		}
+		fprintf(stderr, "following %s\n", argv[1]);
+		lost = 0;
+		live_status status;
+		while ((status = reader.next(&rec)) != LIVE_CLOSED) {
+			if (status == LIVE_NONE) {
+				fflush(stdout);
+				std::this_thread::sleep_for(std::chrono::milliseconds(2));
+				continue;
+			}
+			printRow(reader.schema(), rec);
+			if (reader.lost() != lost) {
+				fprintf(stderr, "%lld records lost\n", reader.lost() - lost);
+				lost = reader.lost();
+			}
+		}
+		fprintf(stderr, "%s closed\n", argv[1]);
+		reader.close();
+	}
+}